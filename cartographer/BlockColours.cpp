@@ -0,0 +1,98 @@
+#include "BlockColours.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+
+using namespace Cartographer;
+using namespace std;
+
+namespace
+{
+    // Suffixes of blocks which share the colour of the block they are made from.
+    const array<string_view, 14> derivedSuffixes =
+    {
+        "_stairs", "_slab", "_wall", "_fence_gate", "_fence", "_pressure_plate", "_button",
+        "_wall_hanging_sign", "_hanging_sign", "_wall_sign", "_sign", "_trapdoor", "_door", "_carpet"
+    };
+
+    // Returns true if a name ends with a suffix.
+    const bool EndsWith(string_view name, string_view suffix)
+    {
+        return name.size() >= suffix.size() && name.substr(name.size() - suffix.size()) == suffix;
+    }
+}
+
+// Loads block colours, replacing any previously loaded.
+const bool BlockColours::LoadFromFile(const char* filename, const int& colourCount)
+{
+    // Colours used for terrain must exist in the colour table, and fit in a colour ID.
+    int count = min(colourCount, maxColourCount);
+    if (max({ plant, dirt, stone, water, wood }) >= count)
+        return false;
+
+    ifstream inputData(filename);
+    if (!inputData.is_open())
+        return false;
+
+    colour_.clear();
+
+    string line;
+    while (inputData >> quoted(line, '"'))
+    {
+        // Split name and colour.
+        size_t separator = line.find(',');
+        if (separator == string::npos)
+            continue;
+
+        int colour = atoi(line.c_str() + separator + 1);
+        if (colour < 0 || colour >= count)
+            return false;
+
+        colour_[line.substr(0, separator)] = static_cast<uint8_t>(colour);
+    }
+
+    return true;
+}
+
+// Returns the base colour of a block. Unknown blocks fall back to the colour of similar blocks.
+const uint8_t BlockColours::GetColour(string_view name) const
+{
+    // Remove namespace.
+    size_t separator = name.find(':');
+    if (separator != string_view::npos && name.substr(0, separator) == "minecraft")
+    {
+        name.remove_prefix(separator + 1);
+    }
+
+    auto entry = colour_.find(name);
+    if (entry != colour_.end())
+        return entry->second;
+
+    // Look up the block a derived block is made from. Plural and block names are tried as stairs
+    // drop them, e.g. brick_stairs from bricks and quartz_stairs from quartz_block.
+    for (string_view suffix : derivedSuffixes)
+    {
+        if (!EndsWith(name, suffix))
+            continue;
+
+        string base(name.substr(0, name.size() - suffix.size()));
+        for (const string& candidate : { base, base + "s", base + "_block", base + "_planks" })
+        {
+            entry = colour_.find(candidate);
+            if (entry != colour_.end())
+                return entry->second;
+        }
+        break;
+    }
+
+    // Guess from the type of block.
+    if (EndsWith(name, "_leaves") || EndsWith(name, "_sapling"))
+        return plant;
+    if (EndsWith(name, "_log") || EndsWith(name, "_wood") || EndsWith(name, "_planks"))
+        return wood;
+
+    return stone;
+}
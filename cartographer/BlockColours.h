@@ -0,0 +1,41 @@
+#ifndef BLOCK_COLOURS_H_
+#define BLOCK_COLOURS_H_
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <string_view>
+
+namespace Cartographer
+{
+	// Map colour of each block, indexing the base colours of the colour table. Blocks missing from
+	// the table are matched by the block they are made from, e.g. stone_brick_stairs uses stone_bricks.
+	class BlockColours
+	{
+	public:
+		// Base colours used when rendering terrain.
+		static constexpr uint8_t none = 0;
+		static constexpr uint8_t plant = 7;
+		static constexpr uint8_t dirt = 10;
+		static constexpr uint8_t stone = 11;
+		static constexpr uint8_t water = 12;
+		static constexpr uint8_t wood = 13;
+
+		// Most base colours a map can use, each has four shades in the 256 colour IDs.
+		static constexpr int maxColourCount = 64;
+
+	private:
+		std::map<std::string, uint8_t, std::less<>> colour_;
+
+	public:
+		// File functions. Each line holds a quoted block name and colour, e.g. "grass_block, 1". Fails if
+		// a block uses a colour past the colourCount base colours of the colour table.
+		const bool LoadFromFile(const char* filename, const int& colourCount);
+
+		// Getters. Names may include the minecraft: namespace.
+		const uint8_t GetColour(std::string_view name) const;
+	};
+}
+
+#endif //BLOCK_COLOURS_H_
@@ -0,0 +1,102 @@
+#ifndef BOUNDED_QUEUE_H_
+#define BOUNDED_QUEUE_H_
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+
+namespace Vaux
+{
+	// First in, first out queue with a fixed capacity, shared between threads. Push blocks while the
+	// queue is full, so a fast producer is held back by a slow consumer.
+	template <class Type> class BoundedQueue
+	{
+	private:
+		std::deque<Type> items_;
+		std::mutex mutex_;
+		std::condition_variable notEmpty_;
+		std::condition_variable notFull_;
+		size_t capacity_;
+		size_t peak_;
+		bool closed_;
+
+	public:
+		BoundedQueue(const size_t& capacity);
+		BoundedQueue(const BoundedQueue&) = delete;
+
+		BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+		// Queue functions. Push fails once the queue is closed, Pop fails once it is closed and empty.
+		const bool Push(Type item);
+		const bool Pop(Type* item);
+		void Close();
+
+		// Size functions.
+		const size_t GetCapacity() const;
+		const size_t GetPeakSize();
+	};
+
+	template <class Type> BoundedQueue<Type>::BoundedQueue(const size_t& capacity) : capacity_(capacity ? capacity : 1), peak_(0), closed_(false)
+	{
+		// Default constructor.
+	}
+
+	// Adds an item to the back of the queue, waiting for space if it is full.
+	template <class Type> const bool BoundedQueue<Type>::Push(Type item)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			notFull_.wait(lock, [this] { return closed_ || items_.size() < capacity_; });
+
+			if (closed_)
+				return false;
+
+			items_.push_back(std::move(item));
+			peak_ = (items_.size() > peak_) ? items_.size() : peak_;
+		}
+
+		notEmpty_.notify_one();
+		return true;
+	}
+	// Removes an item from the front of the queue, waiting for one if it is empty.
+	template <class Type> const bool BoundedQueue<Type>::Pop(Type* item)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			notEmpty_.wait(lock, [this] { return closed_ || !items_.empty(); });
+
+			if (items_.empty())
+				return false;
+
+			*item = std::move(items_.front());
+			items_.pop_front();
+		}
+
+		notFull_.notify_one();
+		return true;
+	}
+	// Stops further pushes and wakes every waiting thread. Queued items can still be popped.
+	template <class Type> void BoundedQueue<Type>::Close()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			closed_ = true;
+		}
+
+		notEmpty_.notify_all();
+		notFull_.notify_all();
+	}
+
+	template <class Type> const size_t BoundedQueue<Type>::GetCapacity() const
+	{
+		return capacity_;
+	}
+	template <class Type> const size_t BoundedQueue<Type>::GetPeakSize()
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		return peak_;
+	}
+}
+
+#endif //BOUNDED_QUEUE_H_
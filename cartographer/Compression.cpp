@@ -0,0 +1,331 @@
+#include "Compression.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+
+#include "stb/stb_image.h"
+
+// Compressor is implemented by stb_image_write but isn't declared in its header.
+extern "C" unsigned char* stbi_zlib_compress(unsigned char* data, int data_len, int* out_len, int quality);
+
+using namespace Vaux;
+using namespace std;
+
+namespace
+{
+	// Gzip header flags.
+	const uint8_t flagHeaderCRC = 1 << 1;
+	const uint8_t flagExtra = 1 << 2;
+	const uint8_t flagName = 1 << 3;
+	const uint8_t flagComment = 1 << 4;
+
+	// Builds the CRC32 lookup table for the reflected polynomial 0xEDB88320.
+	const array<uint32_t, 256> BuildCRCTable()
+	{
+		array<uint32_t, 256> table = {};
+
+		for (uint32_t i = 0; i < 256; i++)
+		{
+			uint32_t crc = i;
+			for (int bit = 0; bit < 8; bit++)
+			{
+				crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320u : crc >> 1;
+			}
+			table[i] = crc;
+		}
+
+		return table;
+	}
+
+	uint32_t ReadLittleEndian(const uint8_t* data)
+	{
+		return data[0] | (data[1] << 8) | (data[2] << 16) | (static_cast<uint32_t>(data[3]) << 24);
+	}
+
+	uint64_t ReadLittleEndian64(const uint8_t* data)
+	{
+		return ReadLittleEndian(data) | (static_cast<uint64_t>(ReadLittleEndian(data + 4)) << 32);
+	}
+
+	void WriteLittleEndian(uint8_t* data, const uint32_t& value)
+	{
+		data[0] = static_cast<uint8_t>(value);
+		data[1] = static_cast<uint8_t>(value >> 8);
+		data[2] = static_cast<uint8_t>(value >> 16);
+		data[3] = static_cast<uint8_t>(value >> 24);
+	}
+}
+
+// Compresses data into a single member gzip stream.
+const bool Compression::CompressGzip(span<const uint8_t> input, vector<uint8_t>* output, const int& quality)
+{
+	if (input.size() > INT_MAX)
+		return false;
+
+	// Compress data as a zlib stream.
+	int zlibSize = 0;
+	unsigned char* zlib = stbi_zlib_compress(const_cast<unsigned char*>(input.data()), static_cast<int>(input.size()), &zlibSize, quality);
+	if (!zlib)
+		return false;
+
+	// Strip zlib header and adler checksum, keeping the raw deflate stream.
+	const int zlibHeader = 2;
+	const int zlibTrailer = 4;
+	int deflateSize = zlibSize - zlibHeader - zlibTrailer;
+
+	// Write gzip header (deflate, no flags, no timestamp, unknown OS).
+	const uint8_t header[10] = { 0x1F, 0x8B, 8, 0, 0, 0, 0, 0, 0, 0xFF };
+	output->resize(sizeof(header) + deflateSize + 8);
+	memcpy(output->data(), header, sizeof(header));
+	memcpy(output->data() + sizeof(header), zlib + zlibHeader, deflateSize);
+	free(zlib);
+
+	// Write trailer with checksum and size of uncompressed data.
+	uint8_t* trailer = output->data() + sizeof(header) + deflateSize;
+	WriteLittleEndian(trailer, CRC32(input));
+	WriteLittleEndian(trailer + 4, static_cast<uint32_t>(input.size()));
+
+	// Data compressed successfully.
+	return true;
+}
+// Decompresses the first member of a gzip stream, verifying its checksum.
+const bool Compression::DecompressGzip(span<const uint8_t> input, vector<uint8_t>* output, const size_t& maxSize)
+{
+	const size_t trailerSize = 8;
+
+	// Check gzip signature and compression method.
+	if (input.size() < 18 || input[0] != 0x1F || input[1] != 0x8B || input[2] != 8)
+		return false;
+
+	// Skip optional header fields.
+	uint8_t flags = input[3];
+	size_t position = 10;
+
+	if (flags & flagExtra)
+	{
+		if (position + 2 > input.size())
+			return false;
+
+		position += 2 + (input[position] | (input[position + 1] << 8));
+	}
+	for (uint8_t flag : { flagName, flagComment })
+	{
+		if (flags & flag)
+		{
+			// Skip zero terminated string.
+			while (position < input.size() && input[position] != 0)
+			{
+				position++;
+			}
+			position++;
+		}
+	}
+	if (flags & flagHeaderCRC)
+	{
+		position += 2;
+	}
+
+	if (position + trailerSize > input.size() || input.size() - position > INT_MAX)
+		return false;
+
+	// Read expected size from trailer. Only valid for single member streams, so fall back to growing the output.
+	uint32_t expectedCRC = ReadLittleEndian(input.data() + input.size() - 8);
+	uint32_t expectedSize = ReadLittleEndian(input.data() + input.size() - 4);
+
+	const char* deflate = reinterpret_cast<const char*>(input.data() + position);
+	int deflateSize = static_cast<int>(input.size() - position);
+
+	// The trailer isn't trusted to size the output, a damaged file could claim up to 4 GB.
+	if (expectedSize > maxSize || expectedSize > INT_MAX)
+		return false;
+
+	output->resize(expectedSize);
+	int size = stbi_zlib_decode_noheader_buffer(reinterpret_cast<char*>(output->data()), static_cast<int>(expectedSize), deflate, deflateSize);
+
+	// Otherwise grow the output, giving up once it would pass the limit.
+	size_t capacity = max(static_cast<size_t>(expectedSize), static_cast<size_t>(1 << 16));
+	size_t limit = min(maxSize, static_cast<size_t>(INT_MAX));
+	while (size < 0 && output->size() < limit)
+	{
+		capacity = min(capacity * 2, limit);
+		output->resize(capacity);
+		size = stbi_zlib_decode_noheader_buffer(reinterpret_cast<char*>(output->data()), static_cast<int>(capacity), deflate, deflateSize);
+	}
+
+	if (size < 0)
+		return false;
+
+	output->resize(size);
+
+	// Verify decompressed data.
+	return static_cast<uint32_t>(size) == expectedSize && CRC32(*output) == expectedCRC;
+}
+
+// Decompresses a zlib stream, verifying its checksum. Output capacity is reused between calls where possible.
+const bool Compression::DecompressZlib(span<const uint8_t> input, vector<uint8_t>* output, const size_t& maxSize)
+{
+	const size_t headerSize = 2;
+	const size_t trailerSize = 4;
+	const size_t expansion = 8;
+
+	if (input.size() < headerSize + trailerSize || input.size() > INT_MAX)
+		return false;
+
+	// Check compression method and header checksum.
+	if ((input[0] & 0x0F) != 8 || ((input[0] << 8) | input[1]) % 31 != 0)
+		return false;
+
+	const char* data = reinterpret_cast<const char*>(input.data());
+	int dataSize = static_cast<int>(input.size());
+
+	// Zlib has no size field, so guess from the previous output before falling back to growing it,
+	// giving up once it would pass the limit.
+	size_t limit = min(maxSize, static_cast<size_t>(INT_MAX));
+	size_t guess = min(max(output->capacity(), input.size() * expansion), limit);
+	output->resize(guess);
+	int size = stbi_zlib_decode_buffer(reinterpret_cast<char*>(output->data()), static_cast<int>(guess), data, dataSize);
+
+	while (size < 0 && output->size() < limit)
+	{
+		output->resize(min(output->size() * 2, limit));
+		size = stbi_zlib_decode_buffer(reinterpret_cast<char*>(output->data()), static_cast<int>(output->size()), data, dataSize);
+	}
+
+	if (size < 0)
+		return false;
+
+	output->resize(size);
+
+	// Verify decompressed data.
+	const uint8_t* trailer = input.data() + input.size() - trailerSize;
+	uint32_t expectedAdler = (static_cast<uint32_t>(trailer[0]) << 24) | (trailer[1] << 16) | (trailer[2] << 8) | trailer[3];
+	return Adler32(*output) == expectedAdler;
+}
+
+// Calculates the CRC32 of data, continuing from a previous CRC.
+const uint32_t Compression::CRC32(span<const uint8_t> data, const uint32_t& crc)
+{
+	static const array<uint32_t, 256> table = BuildCRCTable();
+
+	uint32_t value = ~crc;
+	for (const uint8_t& byte : data)
+	{
+		value = table[(value ^ byte) & 0xFF] ^ (value >> 8);
+	}
+
+	return ~value;
+}
+// Updates a zlib Adler-32 checksum.
+const uint32_t Compression::Adler32(span<const uint8_t> data, const uint32_t& adler)
+{
+	// Largest block which can be summed before the sums overflow.
+	const size_t blockSize = 5552;
+
+	uint32_t a = adler & 0xFFFF;
+	uint32_t b = adler >> 16;
+
+	for (size_t start = 0; start < data.size(); start += blockSize)
+	{
+		size_t end = min(start + blockSize, data.size());
+		for (size_t i = start; i < end; i++)
+		{
+			a += data[i];
+			b += a;
+		}
+
+		a %= 65521;
+		b %= 65521;
+	}
+
+	return (b << 16) | a;
+}
+// Returns the Adler-32 checksum of two pieces of data joined together, from the checksum of each
+// piece and the length of the second. Used to join checksums of data handled in parallel.
+const uint32_t Compression::CombineAdler32(const uint32_t& first, const uint32_t& second, const size_t& secondLength)
+{
+	const uint64_t modulus = 65521;
+
+	// Each byte of the second piece adds the first piece's byte sum to b once more.
+	uint64_t firstA = first & 0xFFFF;
+	uint64_t length = secondLength % modulus;
+	uint64_t a = (firstA + (second & 0xFFFF) + modulus - 1) % modulus;
+	uint64_t b = ((first >> 16) + (second >> 16) + length * (firstA + modulus - 1)) % modulus;
+
+	return static_cast<uint32_t>((b << 16) | a);
+}
+// Hashes data using xxHash64.
+const uint64_t Compression::Hash64(span<const uint8_t> data, const uint64_t& seed)
+{
+	const uint64_t prime1 = 11400714785074694791ull;
+	const uint64_t prime2 = 14029467366897019727ull;
+	const uint64_t prime3 = 1609587929392839161ull;
+	const uint64_t prime4 = 9650029242287828579ull;
+	const uint64_t prime5 = 2870177450012600261ull;
+
+	auto round = [&](uint64_t accumulator, const uint64_t& input)
+	{
+		accumulator += input * prime2;
+		return rotl(accumulator, 31) * prime1;
+	};
+
+	const uint8_t* position = data.data();
+	const uint8_t* end = position + data.size();
+	uint64_t hash;
+
+	if (data.size() >= 32)
+	{
+		// Hash 32 byte stripes in four lanes.
+		uint64_t lane[4] = { seed + prime1 + prime2, seed + prime2, seed, seed - prime1 };
+
+		for (; position + 32 <= end; position += 32)
+		{
+			for (int i = 0; i < 4; i++)
+			{
+				lane[i] = round(lane[i], ReadLittleEndian64(position + i * 8));
+			}
+		}
+
+		hash = rotl(lane[0], 1) + rotl(lane[1], 7) + rotl(lane[2], 12) + rotl(lane[3], 18);
+
+		for (int i = 0; i < 4; i++)
+		{
+			hash = (hash ^ round(0, lane[i])) * prime1 + prime4;
+		}
+	}
+	else
+	{
+		hash = seed + prime5;
+	}
+
+	hash += data.size();
+
+	// Hash remaining bytes.
+	for (; position + 8 <= end; position += 8)
+	{
+		hash = rotl(hash ^ round(0, ReadLittleEndian64(position)), 27) * prime1 + prime4;
+	}
+
+	if (position + 4 <= end)
+	{
+		hash = rotl(hash ^ (ReadLittleEndian(position) * prime1), 23) * prime2 + prime3;
+		position += 4;
+	}
+
+	for (; position < end; position++)
+	{
+		hash = rotl(hash ^ (*position * prime5), 11) * prime1;
+	}
+
+	// Final mix.
+	hash ^= hash >> 33;
+	hash *= prime2;
+	hash ^= hash >> 29;
+	hash *= prime3;
+	hash ^= hash >> 32;
+
+	return hash;
+}
@@ -0,0 +1,35 @@
+#ifndef COMPRESSION_H_
+#define COMPRESSION_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace Vaux
+{
+	// Gzip and zlib wrappers around the deflate codecs bundled with stb.
+	class Compression
+	{
+	public:
+		// Largest output accepted by decompression functions unless the caller gives its own limit.
+		static constexpr size_t defaultMaxSize = 64 << 20;
+
+		// Gzip functions. Streams which decompress to more than maxSize bytes are rejected.
+		static const bool CompressGzip(std::span<const uint8_t> input, std::vector<uint8_t>* output, const int& quality = 8);
+		static const bool DecompressGzip(std::span<const uint8_t> input, std::vector<uint8_t>* output, const size_t& maxSize = defaultMaxSize);
+
+		// Zlib functions. Streams which decompress to more than maxSize bytes are rejected.
+		static const bool DecompressZlib(std::span<const uint8_t> input, std::vector<uint8_t>* output, const size_t& maxSize = defaultMaxSize);
+
+		// Checksum functions.
+		static const uint32_t CRC32(std::span<const uint8_t> data, const uint32_t& crc = 0);
+		static const uint32_t Adler32(std::span<const uint8_t> data, const uint32_t& adler = 1);
+		static const uint32_t CombineAdler32(const uint32_t& first, const uint32_t& second, const size_t& secondLength);
+
+		// Hash functions. Hash64 is xxHash64, used to detect changed content.
+		static const uint64_t Hash64(std::span<const uint8_t> data, const uint64_t& seed = 0);
+	};
+}
+
+#endif //COMPRESSION_H_
@@ -0,0 +1,337 @@
+#include "Deflate.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+
+using namespace Vaux;
+using namespace std;
+
+namespace
+{
+	// Fixed Huffman codes from RFC 1951, bit reversed so they can be written least significant bit first.
+	struct FixedCodes
+	{
+		array<uint16_t, 288> literal;
+		array<uint8_t, 288> literalLength;
+		array<uint8_t, 30> distance;
+	};
+
+	const uint32_t ReverseBits(uint32_t code, const int& length)
+	{
+		uint32_t result = 0;
+		for (int i = 0; i < length; i++)
+		{
+			result = (result << 1) | (code & 1);
+			code >>= 1;
+		}
+
+		return result;
+	}
+
+	const FixedCodes BuildFixedCodes()
+	{
+		FixedCodes codes = {};
+
+		for (int symbol = 0; symbol < 288; symbol++)
+		{
+			uint32_t code;
+			int length;
+
+			if (symbol < 144)
+			{
+				code = 0x30 + symbol;
+				length = 8;
+			}
+			else if (symbol < 256)
+			{
+				code = 0x190 + symbol - 144;
+				length = 9;
+			}
+			else if (symbol < 280)
+			{
+				code = symbol - 256;
+				length = 7;
+			}
+			else
+			{
+				code = 0xC0 + symbol - 280;
+				length = 8;
+			}
+
+			codes.literal[symbol] = static_cast<uint16_t>(ReverseBits(code, length));
+			codes.literalLength[symbol] = static_cast<uint8_t>(length);
+		}
+
+		for (int symbol = 0; symbol < 30; symbol++)
+		{
+			codes.distance[symbol] = static_cast<uint8_t>(ReverseBits(symbol, 5));
+		}
+
+		return codes;
+	}
+
+	const FixedCodes fixedCodes = BuildFixedCodes();
+
+	// Hashes the next three bytes of input.
+	inline const uint32_t Hash(const uint8_t* data)
+	{
+		uint32_t value = data[0] | (data[1] << 8) | (data[2] << 16);
+		return (value * 2654435761u) >> (32 - Deflate::hashBits);
+	}
+}
+
+Deflate::Deflate(vector<uint8_t>* output, const Strategy& strategy) : output_(output), strategy_(strategy), position_(0), base_(0), bits_(0), bitCount_(0), blockOpen_(false)
+{
+	// Hash chains are only searched by the default strategy.
+	if (strategy_ == Strategy::DEFAULT)
+	{
+		head_.assign(size_t(1) << hashBits, -1);
+		previous_.assign(windowSize, -1);
+	}
+}
+
+// Queues input for compression. Input is encoded once enough follows it to search for a full length match.
+void Deflate::Write(span<const uint8_t> data)
+{
+	buffer_.insert(buffer_.end(), data.begin(), data.end());
+	Compress(false);
+}
+// Encodes all queued input, then ends the current block with an empty stored block so the
+// output so far can be decoded. Used to split a stream into independently written parts.
+void Deflate::Flush()
+{
+	Compress(true);
+
+	if (blockOpen_)
+		EndBlock();
+
+	// Empty stored block.
+	WriteBits(0, 3);
+	AlignToByte();
+	WriteBits(0x0000, 16);
+	WriteBits(0xFFFF, 16);
+}
+// Encodes all queued input and writes the final block.
+void Deflate::Finish()
+{
+	Compress(true);
+
+	if (blockOpen_)
+		EndBlock();
+
+	// Empty final block using fixed codes.
+	WriteBits(0x3, 3);
+	WriteLiteral(256);
+	AlignToByte();
+}
+
+// Encodes queued input. Unless all input is required, enough input is held back to allow a full length match.
+void Deflate::Compress(const bool& all)
+{
+	if (strategy_ == Strategy::RLE)
+	{
+		CompressRuns(all);
+		return;
+	}
+
+	const int64_t mask = windowSize - 1;
+
+	size_t end = buffer_.size();
+	size_t limit = all ? end : (end > maxMatch ? end - maxMatch : 0);
+
+	// Open a block using fixed Huffman codes.
+	if (position_ < limit && !blockOpen_)
+	{
+		WriteBits(0x2, 3);
+		blockOpen_ = true;
+	}
+
+	while (position_ < limit)
+	{
+		const uint8_t* data = &buffer_[position_];
+		int64_t current = base_ + static_cast<int64_t>(position_);
+		int available = static_cast<int>(min<size_t>(maxMatch, end - position_));
+		int bestLength = 0;
+		int bestDistance = 0;
+
+		if (available >= minMatch)
+		{
+			// Search previous occurrences of the next three bytes, longest match wins.
+			uint32_t hash = Hash(data);
+			int64_t candidate = head_[hash];
+
+			for (int chain = 0; chain < maxChain && candidate >= 0 && current - candidate <= windowSize; chain++)
+			{
+				const uint8_t* match = &buffer_[static_cast<size_t>(candidate - base_)];
+
+				if (match[bestLength] == data[bestLength])
+				{
+					int length = 0;
+					while (length < available && match[length] == data[length])
+					{
+						length++;
+					}
+
+					if (length > bestLength)
+					{
+						bestLength = length;
+						bestDistance = static_cast<int>(current - candidate);
+
+						if (length == available)
+							break;
+					}
+				}
+
+				candidate = previous_[candidate & mask];
+			}
+
+			// Add current position to hash chain.
+			previous_[current & mask] = head_[hash];
+			head_[hash] = current;
+		}
+
+		if (bestLength >= minMatch)
+		{
+			WriteMatch(bestLength, bestDistance);
+
+			// Add positions covered by the match to hash chains.
+			for (int i = 1; i < bestLength && end - (position_ + i) >= minMatch; i++)
+			{
+				uint32_t hash = Hash(data + i);
+				previous_[(current + i) & mask] = head_[hash];
+				head_[hash] = current + i;
+			}
+
+			position_ += bestLength;
+		}
+		else
+		{
+			WriteLiteral(*data);
+			position_++;
+		}
+	}
+
+	Slide();
+}
+// Encodes queued input, matching only runs of the previous byte at a distance of one.
+void Deflate::CompressRuns(const bool& all)
+{
+	size_t end = buffer_.size();
+	size_t limit = all ? end : (end > maxMatch ? end - maxMatch : 0);
+
+	// Open a block using fixed Huffman codes.
+	if (position_ < limit && !blockOpen_)
+	{
+		WriteBits(0x2, 3);
+		blockOpen_ = true;
+	}
+
+	while (position_ < limit)
+	{
+		const uint8_t* data = &buffer_[position_];
+		int length = 0;
+
+		// Any earlier byte is still in the buffer, as history is kept when sliding.
+		if (position_ > 0)
+		{
+			int available = static_cast<int>(min<size_t>(maxMatch, end - position_));
+			while (length < available && data[length] == data[-1])
+			{
+				length++;
+			}
+		}
+
+		if (length >= minMatch)
+		{
+			WriteMatch(length, 1);
+			position_ += length;
+		}
+		else
+		{
+			WriteLiteral(*data);
+			position_++;
+		}
+	}
+
+	Slide();
+}
+// Discards history which has left the window.
+void Deflate::Slide()
+{
+	if (position_ < 4 * static_cast<size_t>(windowSize))
+		return;
+
+	size_t discard = position_ - windowSize;
+	buffer_.erase(buffer_.begin(), buffer_.begin() + discard);
+	base_ += static_cast<int64_t>(discard);
+	position_ -= discard;
+}
+
+// Appends bits to the output, least significant bit first.
+void Deflate::WriteBits(const uint32_t& value, const int& count)
+{
+	bits_ |= static_cast<uint64_t>(value) << bitCount_;
+	bitCount_ += count;
+
+	while (bitCount_ >= 8)
+	{
+		output_->push_back(static_cast<uint8_t>(bits_));
+		bits_ >>= 8;
+		bitCount_ -= 8;
+	}
+}
+// Writes a literal, length or end of block symbol.
+void Deflate::WriteLiteral(const int& symbol)
+{
+	WriteBits(fixedCodes.literal[symbol], fixedCodes.literalLength[symbol]);
+}
+// Writes a length and distance pair.
+void Deflate::WriteMatch(const int& length, const int& distance)
+{
+	// Length symbols 257-284 cover four lengths per extra bit, 285 is the maximum length.
+	int value = length - minMatch;
+	if (value < 8)
+	{
+		WriteLiteral(257 + value);
+	}
+	else if (value == maxMatch - minMatch)
+	{
+		WriteLiteral(285);
+	}
+	else
+	{
+		int extraBits = bit_width(static_cast<unsigned int>(value)) - 3;
+		WriteLiteral(257 + 4 * (extraBits + 1) + ((value >> extraBits) & 3));
+		WriteBits(value & ((1 << extraBits) - 1), extraBits);
+	}
+
+	// Distance codes cover two distances per extra bit.
+	value = distance - 1;
+	if (value < 4)
+	{
+		WriteBits(fixedCodes.distance[value], 5);
+	}
+	else
+	{
+		int extraBits = bit_width(static_cast<unsigned int>(value)) - 2;
+		WriteBits(fixedCodes.distance[2 * (extraBits + 1) + ((value >> extraBits) & 1)], 5);
+		WriteBits(value & ((1 << extraBits) - 1), extraBits);
+	}
+}
+// Writes the end of block symbol.
+void Deflate::EndBlock()
+{
+	WriteLiteral(256);
+	blockOpen_ = false;
+}
+// Pads the output to a whole byte.
+void Deflate::AlignToByte()
+{
+	if (bitCount_ > 0)
+	{
+		output_->push_back(static_cast<uint8_t>(bits_));
+		bits_ = 0;
+		bitCount_ = 0;
+	}
+}
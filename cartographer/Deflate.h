@@ -0,0 +1,69 @@
+#ifndef DEFLATE_H_
+#define DEFLATE_H_
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace Vaux
+{
+	// Streaming deflate encoder (RFC 1951) using LZ77 and fixed Huffman codes. Input can be written
+	// in pieces of any size, compressed data is appended to the output buffer as it becomes available,
+	// so the caller can drain the output between writes.
+	class Deflate
+	{
+	public:
+		// Match search. RLE only matches repeats of the previous byte, which is much faster and
+		// still compresses filtered image rows with large flat areas well.
+		enum class Strategy
+		{
+			DEFAULT,
+			RLE
+		};
+
+		static constexpr int windowSize = 32768;
+		static constexpr int minMatch = 3;
+		static constexpr int maxMatch = 258;
+		static constexpr int hashBits = 15;
+
+		// Number of earlier positions checked for each match.
+		static constexpr int maxChain = 32;
+
+	private:
+		std::vector<uint8_t>* output_;
+		Strategy strategy_;
+
+		// Recent history followed by input which is yet to be encoded.
+		std::vector<uint8_t> buffer_;
+		size_t position_;
+		int64_t base_;
+
+		// Hash chains, holding absolute stream positions.
+		std::vector<int64_t> head_;
+		std::vector<int64_t> previous_;
+
+		uint64_t bits_;
+		int bitCount_;
+		bool blockOpen_;
+
+	public:
+		Deflate(std::vector<uint8_t>* output, const Strategy& strategy = Strategy::DEFAULT);
+
+		// Stream functions. Flush ends the output on a byte boundary, Finish ends the stream.
+		void Write(std::span<const uint8_t> data);
+		void Flush();
+		void Finish();
+
+	private:
+		void Compress(const bool& all);
+		void CompressRuns(const bool& all);
+		void Slide();
+		void WriteBits(const uint32_t& value, const int& count);
+		void WriteLiteral(const int& symbol);
+		void WriteMatch(const int& length, const int& distance);
+		void EndBlock();
+		void AlignToByte();
+	};
+}
+
+#endif //DEFLATE_H_
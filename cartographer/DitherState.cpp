@@ -0,0 +1,65 @@
+#include "DitherState.h"
+#include "MappedFile.h"
+#include "WorldWriter.h"
+
+#include <cstring>
+
+using namespace Cartographer;
+using namespace Vaux;
+using namespace std;
+
+DitherState::DitherState(const int& gridWidth, const int& gridHeight, const uint64_t& paletteHash) : gridWidth_(gridWidth), gridHeight_(gridHeight), paletteHash_(paletteHash)
+{
+    tiles_.resize(static_cast<size_t>(gridWidth) * gridHeight);
+}
+
+// Reads a state file. Returns false if there is no usable state for this grid and palette.
+const bool DitherState::Load(const filesystem::path& path)
+{
+    MappedFile file;
+    if (!file.Open(path.string().c_str()))
+        return false;
+
+    // Check header and size.
+    span<const byte> data = file.GetData();
+    Header header;
+    if (data.size() != sizeof(Header) + tiles_.size() * sizeof(DitherStateTile))
+        return false;
+
+    memcpy(&header, data.data(), sizeof(Header));
+    if (header.magic != magic || header.version != version || header.gridWidth != gridWidth_ || header.gridHeight != gridHeight_ || header.paletteHash != paletteHash_)
+        return false;
+
+    memcpy(tiles_.data(), data.data() + sizeof(Header), tiles_.size() * sizeof(DitherStateTile));
+    return true;
+}
+// Replaces the state file.
+const bool DitherState::Save(const filesystem::path& path) const
+{
+    Header header = { magic, version, gridWidth_, gridHeight_, paletteHash_ };
+
+    vector<uint8_t> data(sizeof(Header) + tiles_.size() * sizeof(DitherStateTile));
+    memcpy(data.data(), &header, sizeof(Header));
+    memcpy(data.data() + sizeof(Header), tiles_.data(), tiles_.size() * sizeof(DitherStateTile));
+
+    return WorldWriter::WriteFileAtomic(path, data);
+}
+
+// Returns the state of a tile, left to right then top to bottom.
+DitherStateTile& DitherState::GetTile(const int& x, const int& y)
+{
+    return tiles_[x + static_cast<size_t>(y) * gridWidth_];
+}
+// Returns the state of a tile, left to right then top to bottom.
+const DitherStateTile& DitherState::GetTile(const int& x, const int& y) const
+{
+    return tiles_[x + static_cast<size_t>(y) * gridWidth_];
+}
+const int DitherState::GetGridWidth() const
+{
+    return gridWidth_;
+}
+const int DitherState::GetGridHeight() const
+{
+    return gridHeight_;
+}
@@ -0,0 +1,71 @@
+#ifndef DITHER_STATE_H_
+#define DITHER_STATE_H_
+
+#include "MCMapData.h"
+#include "Vector4.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+namespace Cartographer
+{
+	// Map of a wall as it was when last dithered. Stored in native byte order.
+	struct DitherStateTile
+	{
+		// Hashes of the resized image under the map, and of the map colours.
+		uint64_t sourceHash;
+		uint64_t colourHash;
+
+		// Hash of the image row below the map, which error from the map's last row spreads into.
+		uint64_t belowHash;
+
+		// Top row of the map once error from the maps above has been spread into it.
+		Vaux::Vector4i top[MCMapData::defaultWidth];
+
+		// Quantisation error of the left and right columns, colour in xyz and alpha in w.
+		Vaux::Vector4i left[MCMapData::defaultHeight];
+		Vaux::Vector4i right[MCMapData::defaultHeight];
+	};
+
+	// Floyd-Steinberg dithering state of a wall of maps, kept beside the maps so an edited image can
+	// be dithered again one part at a time. The error crossing into and out of each map is enough to
+	// dither it alone and get the same colours as dithering the whole wall.
+	class DitherState
+	{
+	public:
+		static constexpr uint32_t magic = 0x53444D43;
+		static constexpr uint32_t version = 2;
+
+	private:
+		struct Header
+		{
+			uint32_t magic;
+			uint32_t version;
+			int32_t gridWidth;
+			int32_t gridHeight;
+			uint64_t paletteHash;
+		};
+
+		int gridWidth_;
+		int gridHeight_;
+		uint64_t paletteHash_;
+		std::vector<DitherStateTile> tiles_;
+
+	public:
+		DitherState(const int& gridWidth, const int& gridHeight, const uint64_t& paletteHash);
+
+		// File functions. A missing state, or one for another grid or palette, loads as false and
+		// leaves every tile cleared.
+		const bool Load(const std::filesystem::path& path);
+		const bool Save(const std::filesystem::path& path) const;
+
+		// Tile functions.
+		DitherStateTile& GetTile(const int& x, const int& y);
+		const DitherStateTile& GetTile(const int& x, const int& y) const;
+		const int GetGridWidth() const;
+		const int GetGridHeight() const;
+	};
+}
+
+#endif //DITHER_STATE_H_
@@ -0,0 +1,447 @@
+#include "FileBatch.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#ifdef __linux__
+#include <atomic>
+#include <cerrno>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+using namespace Vaux;
+using namespace std;
+
+#ifdef __linux__
+// Submission and completion queues shared with the kernel. Each slot of a batch has a registered
+// file descriptor and buffer, so requests refer to them by index rather than being set up per call.
+struct FileBatch::Ring
+{
+	int fd = -1;
+	bool fixedBuffers = false;
+
+	void* sqMemory = MAP_FAILED;
+	void* cqMemory = MAP_FAILED;
+	size_t sqMemorySize = 0, cqMemorySize = 0;
+	io_uring_sqe* sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+	size_t sqesSize = 0;
+
+	unsigned* sqTail = nullptr;
+	unsigned* sqMask = nullptr;
+	unsigned* cqHead = nullptr;
+	unsigned* cqTail = nullptr;
+	unsigned* cqMask = nullptr;
+	io_uring_cqe* cqes = nullptr;
+
+	vector<uint8_t> buffers;
+
+	~Ring()
+	{
+		if (sqes != MAP_FAILED)
+			munmap(sqes, sqesSize);
+		if (cqMemory != MAP_FAILED && cqMemory != sqMemory)
+			munmap(cqMemory, cqMemorySize);
+		if (sqMemory != MAP_FAILED)
+			munmap(sqMemory, sqMemorySize);
+		if (fd >= 0)
+			close(fd);
+	}
+
+	// Creates the queues and registers a file and buffer for every slot.
+	const bool Setup()
+	{
+		// Each file needs an open, a transfer and a close.
+		io_uring_params params = {};
+		fd = static_cast<int>(syscall(__NR_io_uring_setup, static_cast<unsigned>(batchSize * 4), &params));
+		if (fd < 0)
+			return false;
+
+		// Map queues, kernels with a single mapping share it between both.
+		sqMemorySize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+		cqMemorySize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+		bool singleMapping = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+		if (singleMapping)
+			sqMemorySize = cqMemorySize = max(sqMemorySize, cqMemorySize);
+
+		sqMemory = mmap(nullptr, sqMemorySize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+		if (sqMemory == MAP_FAILED)
+			return false;
+
+		cqMemory = singleMapping ? sqMemory : mmap(nullptr, cqMemorySize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+		if (cqMemory == MAP_FAILED)
+			return false;
+
+		sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+		sqes = static_cast<io_uring_sqe*>(mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+		if (sqes == MAP_FAILED)
+			return false;
+
+		uint8_t* sq = static_cast<uint8_t*>(sqMemory);
+		uint8_t* cq = static_cast<uint8_t*>(cqMemory);
+		sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+		sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+		cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+		cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+		cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+		cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+		// Entries are submitted in ring order, so the index array never changes.
+		unsigned* sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+		for (unsigned i = 0; i < params.sq_entries; i++)
+		{
+			sqArray[i] = i;
+		}
+
+		// Reserve an empty file slot per request, files are opened straight into them.
+		vector<int> files(batchSize, -1);
+		if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_FILES, files.data(), static_cast<unsigned>(files.size())) < 0)
+			return false;
+
+		// Opening into a slot needs Linux 5.15. Older kernels ignore the slot and return a normal
+		// descriptor, which would leak, and close whatever descriptor the entry names.
+		io_uring_sqe open = {};
+		open.opcode = IORING_OP_OPENAT;
+		open.fd = AT_FDCWD;
+		open.addr = reinterpret_cast<uint64_t>("/dev/null");
+		open.open_flags = O_RDONLY;
+		open.file_index = 1;
+
+		int opened = Run(open);
+		if (opened != 0)
+		{
+			if (opened > 0)
+				close(opened);
+			return false;
+		}
+
+		io_uring_sqe closeSlot = {};
+		closeSlot.opcode = IORING_OP_CLOSE;
+		closeSlot.file_index = 1;
+		if (Run(closeSlot) != 0)
+			return false;
+
+		// Register buffers, without them transfers use ordinary reads and writes. Registration
+		// can fail where locked memory is limited.
+		buffers.resize(batchSize * bufferSize);
+		vector<iovec> vectors(batchSize);
+		for (size_t i = 0; i < batchSize; i++)
+		{
+			vectors[i].iov_base = buffers.data() + i * bufferSize;
+			vectors[i].iov_len = bufferSize;
+		}
+
+		fixedBuffers = syscall(__NR_io_uring_register, fd, IORING_REGISTER_BUFFERS, vectors.data(), static_cast<unsigned>(vectors.size())) == 0;
+
+		return true;
+	}
+
+	// Submits a single entry and waits for it. Returns its result, or a negative error code.
+	const int Run(const io_uring_sqe& entry)
+	{
+		unsigned tail = *sqTail;
+		sqes[tail & *sqMask] = entry;
+		atomic_ref<unsigned>(*sqTail).store(tail + 1, memory_order_release);
+
+		int submitted;
+		do
+		{
+			submitted = static_cast<int>(syscall(__NR_io_uring_enter, fd, 1, 1, IORING_ENTER_GETEVENTS, nullptr, 0));
+		} while (submitted < 0 && errno == EINTR);
+
+		if (submitted < 0)
+			return -errno;
+
+		unsigned head = *cqHead;
+		if (head == atomic_ref<unsigned>(*cqTail).load(memory_order_acquire))
+			return -EAGAIN;
+
+		int result = cqes[head & *cqMask].res;
+		atomic_ref<unsigned>(*cqHead).store(head + 1, memory_order_release);
+
+		return result;
+	}
+};
+#else
+struct FileBatch::Ring
+{
+};
+#endif
+
+FileBatch::FileBatch(const Backend& backend)
+{
+#ifdef __linux__
+	// Use io_uring where the kernel allows it.
+	if (backend == Backend::IO_URING)
+	{
+		ring_ = make_unique<Ring>();
+		if (!ring_->Setup())
+			ring_.reset();
+	}
+#endif
+}
+FileBatch::~FileBatch()
+{
+	// Default destructor.
+}
+
+// Queues a file to be written with data.
+void FileBatch::Write(const char* filename, span<const uint8_t> data)
+{
+	requests_.push_back({ filename, data, nullptr });
+}
+// Queues a file to be read whole into output.
+void FileBatch::Read(const char* filename, vector<uint8_t>* output)
+{
+	requests_.push_back({ filename, {}, output });
+}
+// Runs all queued requests, returns false if any failed.
+const bool FileBatch::Submit()
+{
+	vector<uint8_t> success(requests_.size(), 0);
+
+	// Submit a batch at a time through the ring.
+	if (ring_)
+	{
+		for (size_t first = 0; first < requests_.size(); first += batchSize)
+		{
+			if (!SubmitRing(first, min(batchSize, requests_.size() - first), &success))
+				break;
+		}
+	}
+
+	// Requests the ring didn't complete are retried with blocking calls. This also covers kernels
+	// which can't open files into registered slots.
+	bool allSucceeded = true;
+	for (size_t i = 0; i < requests_.size(); i++)
+	{
+		if (!success[i] && !SubmitBlocking(requests_[i]))
+		{
+			stats_.failed++;
+			allSucceeded = false;
+		}
+	}
+
+	stats_.files += requests_.size();
+	requests_.clear();
+
+	return allSucceeded;
+}
+
+// Returns the backend in use.
+const FileBatch::Backend FileBatch::GetBackend() const
+{
+	return ring_ ? Backend::IO_URING : Backend::BLOCKING;
+}
+// Returns totals since the batch was created.
+const FileBatch::Stats& FileBatch::GetStats() const
+{
+	return stats_;
+}
+
+// Submits up to batchSize requests as linked open, transfer and close entries, then waits for all of
+// them to complete. Returns false if the ring itself failed.
+const bool FileBatch::SubmitRing(const size_t& first, const size_t& count, vector<uint8_t>* success)
+{
+#ifdef __linux__
+	Ring& ring = *ring_;
+	unsigned tail = *ring.sqTail;
+
+	auto nextEntry = [&]()
+	{
+		io_uring_sqe* entry = &ring.sqes[tail++ & *ring.sqMask];
+		memset(entry, 0, sizeof(io_uring_sqe));
+		return entry;
+	};
+
+	for (size_t slot = 0; slot < count; slot++)
+	{
+		Request& request = requests_[first + slot];
+		bool write = request.output == nullptr;
+		uint8_t* buffer = ring.buffers.data() + slot * bufferSize;
+
+		// Writes which fit are copied into the slot's buffer, larger ones are written from the request.
+		bool fixed = ring.fixedBuffers && (!write || request.data.size() <= bufferSize);
+		if (write && fixed)
+			memcpy(buffer, request.data.data(), request.data.size());
+
+		// Open into the slot's file, the rest of the chain is cancelled if this fails.
+		io_uring_sqe* open = nextEntry();
+		open->opcode = IORING_OP_OPENAT;
+		open->fd = AT_FDCWD;
+		open->addr = reinterpret_cast<uint64_t>(request.filename.c_str());
+		open->len = write ? 0644 : 0;
+		open->open_flags = write ? (O_WRONLY | O_CREAT | O_TRUNC) : O_RDONLY;
+		open->file_index = static_cast<uint32_t>(slot + 1);
+		open->flags = IOSQE_IO_LINK;
+		open->user_data = (first + slot) * 3;
+
+		// Transfer the whole file, reads larger than a buffer are finished with blocking calls. The
+		// close runs even if the transfer fails.
+		io_uring_sqe* transfer = nextEntry();
+		if (write)
+			transfer->opcode = fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+		else
+			transfer->opcode = fixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+		transfer->fd = static_cast<int>(slot);
+		transfer->addr = reinterpret_cast<uint64_t>((write && !fixed) ? request.data.data() : buffer);
+		transfer->len = static_cast<uint32_t>(write ? request.data.size() : bufferSize);
+		transfer->buf_index = fixed ? static_cast<uint16_t>(slot) : 0;
+		transfer->flags = IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK;
+		transfer->user_data = (first + slot) * 3 + 1;
+
+		io_uring_sqe* close = nextEntry();
+		close->opcode = IORING_OP_CLOSE;
+		close->file_index = static_cast<uint32_t>(slot + 1);
+		close->user_data = (first + slot) * 3 + 2;
+	}
+
+	// Publish entries, then submit and wait for completions in one call.
+	atomic_ref<unsigned>(*ring.sqTail).store(tail, memory_order_release);
+
+	unsigned pending = static_cast<unsigned>(count * 3);
+	unsigned submit = pending;
+	vector<int> results(count * 3, -ECANCELED);
+
+	while (pending > 0)
+	{
+		int submitted = static_cast<int>(syscall(__NR_io_uring_enter, ring.fd, submit, pending, IORING_ENTER_GETEVENTS, nullptr, 0));
+		stats_.systemCalls++;
+
+		if (submitted < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			// Requests which didn't complete are left to the blocking fallback.
+			ring_.reset();
+			return false;
+		}
+		submit -= min(submit, static_cast<unsigned>(submitted));
+
+		// Collect completions.
+		unsigned head = *ring.cqHead;
+		unsigned available = atomic_ref<unsigned>(*ring.cqTail).load(memory_order_acquire);
+		while (head != available && pending > 0)
+		{
+			io_uring_cqe& completion = ring.cqes[head++ & *ring.cqMask];
+			results[completion.user_data - first * 3] = completion.res;
+			pending--;
+		}
+		atomic_ref<unsigned>(*ring.cqHead).store(head, memory_order_release);
+	}
+
+	// Check each file was opened, fully transferred and closed.
+	for (size_t slot = 0; slot < count; slot++)
+	{
+		Request& request = requests_[first + slot];
+		int opened = results[slot * 3], transferred = results[slot * 3 + 1], closed = results[slot * 3 + 2];
+		if (opened < 0 || transferred < 0 || closed < 0)
+			continue;
+
+		if (request.output == nullptr)
+		{
+			(*success)[first + slot] = static_cast<size_t>(transferred) == request.data.size();
+		}
+		else if (static_cast<size_t>(transferred) < bufferSize)
+		{
+			const uint8_t* buffer = ring.buffers.data() + slot * bufferSize;
+			request.output->assign(buffer, buffer + transferred);
+			(*success)[first + slot] = true;
+		}
+	}
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+// Transfers a single file with blocking calls, counting each call made.
+const bool FileBatch::SubmitBlocking(const Request& request)
+{
+#ifdef __linux__
+	bool write = request.output == nullptr;
+	int file = open(request.filename.c_str(), write ? (O_WRONLY | O_CREAT | O_TRUNC) : O_RDONLY, 0644);
+	stats_.systemCalls++;
+	if (file < 0)
+		return false;
+
+	bool success = true;
+	if (write)
+	{
+		// Writes can be partial, continue until all data is written.
+		for (size_t done = 0; done < request.data.size() && success; )
+		{
+			ssize_t written = ::write(file, request.data.data() + done, request.data.size() - done);
+			stats_.systemCalls++;
+
+			if (written > 0)
+				done += static_cast<size_t>(written);
+			else if (written < 0 && errno == EINTR)
+				continue;
+			else
+				success = false;
+		}
+	}
+	else
+	{
+		// Read until the end of the file, growing the output as it fills.
+		request.output->resize(bufferSize);
+		size_t done = 0;
+		while (success)
+		{
+			if (done == request.output->size())
+				request.output->resize(done * 2);
+
+			ssize_t bytes = read(file, request.output->data() + done, request.output->size() - done);
+			stats_.systemCalls++;
+
+			if (bytes > 0)
+				done += static_cast<size_t>(bytes);
+			else if (bytes == 0)
+				break;
+			else if (errno != EINTR)
+				success = false;
+		}
+		request.output->resize(done);
+	}
+
+	success = close(file) == 0 && success;
+	stats_.systemCalls++;
+
+	return success;
+#else
+	// Streams hide the calls they make, so each open, transfer and close counts as one.
+	if (request.output == nullptr)
+	{
+		ofstream outputData(request.filename, ios::out | ios::binary | ios::trunc);
+		stats_.systemCalls++;
+		if (!outputData.is_open())
+			return false;
+
+		outputData.write(reinterpret_cast<const char*>(request.data.data()), static_cast<streamsize>(request.data.size()));
+		outputData.close();
+		stats_.systemCalls += 2;
+
+		return !outputData.fail();
+	}
+
+	ifstream inputData(request.filename, ios::in | ios::binary | ios::ate);
+	stats_.systemCalls++;
+	if (!inputData.is_open())
+		return false;
+
+	request.output->resize(static_cast<size_t>(inputData.tellg()));
+	inputData.seekg(0, ios::beg);
+	inputData.read(reinterpret_cast<char*>(request.output->data()), static_cast<streamsize>(request.output->size()));
+	stats_.systemCalls += 2;
+
+	return !inputData.fail();
+#endif
+}
@@ -0,0 +1,74 @@
+#ifndef FILE_BATCH_H_
+#define FILE_BATCH_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace Vaux
+{
+	// Reads and writes many small files together. On Linux, files are opened, transferred through
+	// registered buffers and closed by io_uring, a batch at a time with a single system call.
+	// Elsewhere, or where io_uring is unavailable, each file is handled in turn with blocking calls.
+	class FileBatch
+	{
+	public:
+		enum class Backend
+		{
+			BLOCKING,
+			IO_URING
+		};
+
+		// Files transferred in one io_uring submission, and the registered buffer space for each.
+		static constexpr size_t batchSize = 64;
+		static constexpr size_t bufferSize = 1 << 15;
+
+		struct Stats
+		{
+			size_t files = 0;
+			size_t failed = 0;
+			size_t systemCalls = 0;
+		};
+
+	private:
+		struct Request
+		{
+			std::string filename;
+			std::span<const uint8_t> data;
+			std::vector<uint8_t>* output = nullptr;
+		};
+
+		struct Ring;
+
+		std::vector<Request> requests_;
+		std::unique_ptr<Ring> ring_;
+		Stats stats_;
+
+	public:
+		FileBatch(const Backend& backend = Backend::IO_URING);
+		FileBatch(const FileBatch&) = delete;
+		~FileBatch();
+
+		FileBatch& operator=(const FileBatch&) = delete;
+
+		// Request functions. Written data must stay valid until Submit returns, and read files are
+		// only stored once it does.
+		void Write(const char* filename, std::span<const uint8_t> data);
+		void Read(const char* filename, std::vector<uint8_t>* output);
+		const bool Submit();
+
+		// Status functions. Outside Linux, the blocking backend counts one system call each to open,
+		// transfer and close a file.
+		const Backend GetBackend() const;
+		const Stats& GetStats() const;
+
+	private:
+		const bool SubmitRing(const size_t& first, const size_t& count, std::vector<uint8_t>* success);
+		const bool SubmitBlocking(const Request& request);
+	};
+}
+
+#endif //FILE_BATCH_H_
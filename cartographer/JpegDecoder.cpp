@@ -0,0 +1,770 @@
+#include "JpegDecoder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+using namespace Vaux;
+using namespace std;
+
+namespace
+{
+	// Maps zig-zag coefficient order to natural (row major) order.
+	const int zigzag[64]
+	{
+		0, 1, 8, 16, 9, 2, 3, 10, 17, 24, 32, 25, 18, 11, 4, 5,
+		12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6, 7, 14, 21, 28,
+		35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+		58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63
+	};
+
+	// Number of bits resolved by a single huffman table lookup.
+	const int fastBits = 9;
+
+	struct HuffmanTable
+	{
+		bool defined = false;
+		unsigned char values[256] = {};
+		int maxCode[17] = {};
+		int valueOffset[17] = {};
+		uint16_t fast[1 << fastBits] = {};
+	};
+
+	struct Component
+	{
+		int id = 0;
+		int h = 1, v = 1;
+		int quantTable = 0;
+		int dcTable = 0, acTable = 0;
+		int dcPrediction = 0;
+		int planeWidth = 0, planeHeight = 0;
+		vector<unsigned char> plane;
+	};
+
+	// Reads entropy coded data, removing stuffed bytes and stopping at markers.
+	struct BitReader
+	{
+		const unsigned char* data;
+		size_t size;
+		size_t position;
+		uint32_t buffer;
+		int count;
+		bool marker;
+
+		void Reset(const size_t& start)
+		{
+			position = start;
+			buffer = 0;
+			count = 0;
+			marker = false;
+		}
+
+		void Fill()
+		{
+			while (count <= 24)
+			{
+				unsigned int byte = 0;
+
+				// Pad with zeros once a marker or the end of data has been reached.
+				if (!marker && position < size)
+				{
+					byte = data[position];
+
+					if (byte == 0xFF)
+					{
+						unsigned int next = (position + 1 < size) ? data[position + 1] : 0xD9;
+
+						if (next == 0x00)
+						{
+							// Skip stuffed zero byte.
+							position += 2;
+						}
+						else
+						{
+							// Leave position on the marker.
+							marker = true;
+							byte = 0;
+						}
+					}
+					else
+					{
+						position++;
+					}
+				}
+
+				buffer |= byte << (24 - count);
+				count += 8;
+			}
+		}
+
+		void Skip(const int& bits)
+		{
+			buffer <<= bits;
+			count -= bits;
+		}
+
+		int Receive(const int& bits)
+		{
+			if (bits == 0)
+				return 0;
+
+			Fill();
+			int value = static_cast<int>(buffer >> (32 - bits));
+			Skip(bits);
+			return value;
+		}
+
+		// Converts a received value into a signed coefficient.
+		int ReceiveExtend(const int& bits)
+		{
+			if (bits == 0)
+				return 0;
+
+			int value = Receive(bits);
+			return (value < (1 << (bits - 1))) ? value - (1 << bits) + 1 : value;
+		}
+
+		int DecodeSymbol(const HuffmanTable& table)
+		{
+			Fill();
+
+			// Attempt to resolve short codes with a single lookup.
+			int entry = table.fast[buffer >> (32 - fastBits)];
+			if (entry)
+			{
+				Skip(entry >> 8);
+				return entry & 0xFF;
+			}
+
+			// Fall back to a canonical code search for long codes.
+			for (int length = fastBits + 1; length <= 16; length++)
+			{
+				int code = static_cast<int>(buffer >> (32 - length));
+				if (code < table.maxCode[length])
+				{
+					Skip(length);
+					return table.values[code + table.valueOffset[length]];
+				}
+			}
+
+			// Invalid code.
+			return -1;
+		}
+	};
+
+	struct DecoderState
+	{
+		int width = 0, height = 0;
+		int maxH = 1, maxV = 1;
+		int mcusX = 0, mcusY = 0;
+		int restartInterval = 0;
+		int adobeTransform = -1;
+		bool frame = false;
+		bool scanned = false;
+
+		int quant[4][64] = {};
+		HuffmanTable dc[4];
+		HuffmanTable ac[4];
+		vector<Component> components;
+	};
+
+	// Builds the lookup tables for a huffman table from code lengths and values.
+	const bool BuildHuffman(HuffmanTable* table, const unsigned char* counts, const unsigned char* values, const int& total)
+	{
+		copy(values, values + total, table->values);
+		fill(begin(table->fast), end(table->fast), static_cast<uint16_t>(0));
+
+		int code = 0;
+		int index = 0;
+
+		// Assign canonical codes in order of length.
+		for (int length = 1; length <= 16; length++)
+		{
+			table->valueOffset[length] = index - code;
+
+			for (int i = 0; i < counts[length - 1]; i++)
+			{
+				// Store short codes in the fast lookup table.
+				if (length <= fastBits)
+				{
+					int shift = fastBits - length;
+					for (int j = 0; j < (1 << shift); j++)
+					{
+						table->fast[(code << shift) | j] = static_cast<uint16_t>((length << 8) | values[index]);
+					}
+				}
+
+				code++;
+				index++;
+			}
+
+			// Codes must fit within their length.
+			if (code > (1 << length))
+				return false;
+
+			table->maxCode[length] = counts[length - 1] ? code : -1;
+			code <<= 1;
+		}
+
+		table->defined = true;
+		return true;
+	}
+
+	// Builds the reduced inverse DCT basis for an output block size of n x n.
+	// Each basis function is attenuated by the box filter response of the pixels it replaces.
+	void BuildIDCTTable(const int& n, float* table)
+	{
+		const double pi = 3.14159265358979323846;
+		int factor = 8 / n;
+
+		for (int u = 0; u < n; u++)
+		{
+			// Average the full resolution basis over each group of output pixels.
+			double attenuation = 0.0;
+			for (int j = 0; j < factor; j++)
+			{
+				attenuation += cos((2 * j + 1 - factor) * u * pi / 16.0);
+			}
+			attenuation /= factor;
+
+			double normal = (u == 0) ? sqrt(0.5) : 1.0;
+
+			for (int x = 0; x < n; x++)
+			{
+				table[x * 8 + u] = static_cast<float>(0.5 * normal * attenuation * cos((2 * x + 1) * u * pi / (2.0 * n)));
+			}
+		}
+	}
+
+	// Converts a sample to a byte, rounding to nearest.
+	inline unsigned char ToByte(const float& value)
+	{
+		return static_cast<unsigned char>(clamp(value, 0.f, 255.f) + 0.5f);
+	}
+
+	// Applies the reduced inverse DCT to rows, then columns, writing an N x N block to output.
+	template <int N> void InverseDCT(const float* coefficients, const float* idct, unsigned char* output, const int& stride)
+	{
+		float rows[N * N];
+		for (int v = 0; v < N; v++)
+		{
+			for (int x = 0; x < N; x++)
+			{
+				float sum = 0.f;
+				for (int u = 0; u < N; u++)
+				{
+					sum += idct[x * 8 + u] * coefficients[v * 8 + u];
+				}
+				rows[v * N + x] = sum;
+			}
+		}
+
+		for (int y = 0; y < N; y++)
+		{
+			for (int x = 0; x < N; x++)
+			{
+				float sum = 128.f;
+				for (int v = 0; v < N; v++)
+				{
+					sum += idct[y * 8 + v] * rows[v * N + x];
+				}
+				output[y * stride + x] = ToByte(sum);
+			}
+		}
+	}
+
+	// Decodes a single 8x8 block, writing an n x n reduced block into the component plane.
+	const bool DecodeBlock(BitReader& reader, DecoderState& state, Component& component, const int& n, const float* idct, const int& blockX, const int& blockY)
+	{
+		const int* quant = state.quant[component.quantTable];
+		float coefficients[64] = {};
+
+		// Decode DC coefficient.
+		int symbol = reader.DecodeSymbol(state.dc[component.dcTable]);
+		if (symbol < 0 || symbol > 16)
+			return false;
+
+		component.dcPrediction += reader.ReceiveExtend(symbol);
+		coefficients[0] = static_cast<float>(component.dcPrediction * quant[0]);
+
+		// Decode AC coefficients, only keeping those within the reduced block.
+		for (int k = 1; k < 64;)
+		{
+			symbol = reader.DecodeSymbol(state.ac[component.acTable]);
+			if (symbol < 0)
+				return false;
+
+			int run = symbol >> 4;
+			int bits = symbol & 15;
+
+			if (bits == 0)
+			{
+				// Check for a run of 16 zeros, otherwise end of block.
+				if (run != 15)
+					break;
+
+				k += 16;
+				continue;
+			}
+
+			k += run;
+			if (k > 63)
+				return false;
+
+			int value = reader.ReceiveExtend(bits);
+			int position = zigzag[k];
+
+			if ((position & 7) < n && (position >> 3) < n)
+			{
+				coefficients[position] = static_cast<float>(value * quant[position]);
+			}
+
+			k++;
+		}
+
+		// Apply the reduced inverse DCT.
+		unsigned char* output = component.plane.data() + blockY * n * component.planeWidth + blockX * n;
+		switch (n)
+		{
+		case 4: InverseDCT<4>(coefficients, idct, output, component.planeWidth); break;
+		case 2: InverseDCT<2>(coefficients, idct, output, component.planeWidth); break;
+		default: InverseDCT<1>(coefficients, idct, output, component.planeWidth); break;
+		}
+
+		return true;
+	}
+
+	// Moves the reader past the next restart marker, resetting DC predictions.
+	const bool ProcessRestart(BitReader& reader, DecoderState& state)
+	{
+		size_t position = reader.position;
+
+		while (position + 1 < reader.size && !(reader.data[position] == 0xFF && reader.data[position + 1] >= 0xD0 && reader.data[position + 1] <= 0xD7))
+		{
+			position++;
+		}
+
+		if (position + 1 >= reader.size)
+			return false;
+
+		reader.Reset(position + 2);
+
+		for (Component& component : state.components)
+		{
+			component.dcPrediction = 0;
+		}
+
+		return true;
+	}
+
+	// Decodes entropy coded data for a scan. Returns position of the marker following the scan.
+	const bool DecodeScan(const unsigned char* data, const size_t& size, size_t* position, DecoderState& state, const vector<int>& scanComponents, const int& n, const float* idct)
+	{
+		BitReader reader;
+		reader.data = data;
+		reader.size = size;
+		reader.Reset(*position);
+
+		for (Component& component : state.components)
+		{
+			component.dcPrediction = 0;
+		}
+
+		int restartCount = 0;
+
+		if (scanComponents.size() == 1)
+		{
+			// Non-interleaved scan, blocks are stored in raster order.
+			Component& component = state.components[scanComponents[0]];
+			int componentWidth = (state.width * component.h + state.maxH - 1) / state.maxH;
+			int componentHeight = (state.height * component.v + state.maxV - 1) / state.maxV;
+			int blocksX = (componentWidth + 7) / 8;
+			int blocksY = (componentHeight + 7) / 8;
+
+			for (int y = 0; y < blocksY; y++)
+			{
+				for (int x = 0; x < blocksX; x++)
+				{
+					if (!DecodeBlock(reader, state, component, n, idct, x, y))
+						return false;
+
+					// Check for restart interval.
+					if (state.restartInterval && ++restartCount == state.restartInterval && !(y == blocksY - 1 && x == blocksX - 1))
+					{
+						if (!ProcessRestart(reader, state))
+							return false;
+
+						restartCount = 0;
+					}
+				}
+			}
+		}
+		else
+		{
+			// Interleaved scan, each MCU holds h x v blocks of every component.
+			for (int mcuY = 0; mcuY < state.mcusY; mcuY++)
+			{
+				for (int mcuX = 0; mcuX < state.mcusX; mcuX++)
+				{
+					for (const int& index : scanComponents)
+					{
+						Component& component = state.components[index];
+
+						for (int y = 0; y < component.v; y++)
+						{
+							for (int x = 0; x < component.h; x++)
+							{
+								if (!DecodeBlock(reader, state, component, n, idct, mcuX * component.h + x, mcuY * component.v + y))
+									return false;
+							}
+						}
+					}
+
+					// Check for restart interval.
+					if (state.restartInterval && ++restartCount == state.restartInterval && !(mcuY == state.mcusY - 1 && mcuX == state.mcusX - 1))
+					{
+						if (!ProcessRestart(reader, state))
+							return false;
+
+						restartCount = 0;
+					}
+				}
+			}
+		}
+
+		// Find the next marker which isn't a restart marker.
+		size_t next = reader.position;
+		while (next + 1 < size && !(data[next] == 0xFF && data[next + 1] != 0x00 && data[next + 1] != 0xFF && !(data[next + 1] >= 0xD0 && data[next + 1] <= 0xD7)))
+		{
+			next++;
+		}
+
+		*position = next;
+		return true;
+	}
+
+	int ReadWord(const unsigned char* data)
+	{
+		return (data[0] << 8) | data[1];
+	}
+}
+
+// Checks whether the data begins with a JPEG start of image marker.
+const bool JpegDecoder::IsJpeg(const unsigned char* data, const size_t& size)
+{
+	return size >= 3 && data[0] == 0xFF && data[1] == 0xD8 && data[2] == 0xFF;
+}
+
+// Returns the largest reduction (1, 2, 4 or 8) which keeps the image at least as large as the target fit.
+const int JpegDecoder::SelectScale(const int& width, const int& height, const int& targetWidth, const int& targetHeight)
+{
+	if (width <= 0 || height <= 0 || targetWidth <= 0 || targetHeight <= 0)
+		return 1;
+
+	// Calculate dimensions of image once fit within target.
+	float fit = min(float(targetWidth) / float(width), float(targetHeight) / float(height));
+	int fitWidth = static_cast<int>(width * fit);
+	int fitHeight = static_cast<int>(height * fit);
+
+	for (int scale = maxScale; scale > 1; scale /= 2)
+	{
+		// Check reduced image still covers the fitted image.
+		if ((width + scale - 1) / scale >= fitWidth && (height + scale - 1) / scale >= fitHeight)
+			return scale;
+	}
+
+	return 1;
+}
+
+// Decodes a baseline JPEG at 1/scale of its original size. Progressive and arithmetic coded files are not supported.
+const bool JpegDecoder::Decode(const unsigned char* data, const size_t& size, const int& scale, vector<unsigned char>* output, int* width, int* height, int* channels)
+{
+	if (!IsJpeg(data, size) || (scale != 2 && scale != 4 && scale != 8))
+		return false;
+
+	// Calculate reduced block size, build inverse DCT basis.
+	const int n = 8 / scale;
+	float idct[64];
+	BuildIDCTTable(n, idct);
+
+	DecoderState state;
+	size_t position = 2;
+
+	// Parse markers until end of image.
+	while (position + 4 <= size)
+	{
+		if (data[position] != 0xFF)
+		{
+			position++;
+			continue;
+		}
+
+		int marker = data[position + 1];
+		position += 2;
+
+		// Skip fill bytes and standalone markers.
+		if (marker == 0xFF)
+		{
+			position--;
+			continue;
+		}
+		if (marker == 0xD9)
+			break;
+		if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7))
+			continue;
+
+		int length = ReadWord(data + position);
+		if (length < 2 || position + length > size)
+			return false;
+
+		const unsigned char* segment = data + position + 2;
+		int segmentLength = length - 2;
+
+		switch (marker)
+		{
+		case 0xC0: // Baseline DCT.
+		case 0xC1: // Extended sequential DCT.
+		{
+			if (segmentLength < 6 || segment[0] != 8)
+				return false;
+
+			state.height = ReadWord(segment + 1);
+			state.width = ReadWord(segment + 3);
+			int count = segment[5];
+
+			// Only greyscale and three component images are supported.
+			if (state.width == 0 || state.height == 0 || (count != 1 && count != 3) || segmentLength < 6 + count * 3)
+				return false;
+
+			state.components.resize(count);
+			for (int i = 0; i < count; i++)
+			{
+				Component& component = state.components[i];
+				component.id = segment[6 + i * 3];
+				component.h = segment[7 + i * 3] >> 4;
+				component.v = segment[7 + i * 3] & 15;
+				component.quantTable = segment[8 + i * 3];
+
+				if (component.h < 1 || component.h > 4 || component.v < 1 || component.v > 4 || component.quantTable > 3)
+					return false;
+
+				state.maxH = max(state.maxH, component.h);
+				state.maxV = max(state.maxV, component.v);
+			}
+
+			// Greyscale images are never interleaved, treat as 1x1 sampling.
+			if (count == 1)
+			{
+				state.components[0].h = state.components[0].v = 1;
+				state.maxH = state.maxV = 1;
+			}
+
+			state.mcusX = (state.width + state.maxH * 8 - 1) / (state.maxH * 8);
+			state.mcusY = (state.height + state.maxV * 8 - 1) / (state.maxV * 8);
+
+			// Allocate reduced planes for each component.
+			for (Component& component : state.components)
+			{
+				component.planeWidth = state.mcusX * component.h * n;
+				component.planeHeight = state.mcusY * component.v * n;
+				component.plane.assign(static_cast<size_t>(component.planeWidth) * component.planeHeight, 0);
+			}
+
+			state.frame = true;
+			break;
+		}
+		case 0xC4: // Huffman tables.
+		{
+			int offset = 0;
+			while (offset + 17 <= segmentLength)
+			{
+				int tableClass = segment[offset] >> 4;
+				int tableIndex = segment[offset] & 15;
+				const unsigned char* counts = segment + offset + 1;
+
+				int total = 0;
+				for (int i = 0; i < 16; i++)
+				{
+					total += counts[i];
+				}
+
+				if (tableClass > 1 || tableIndex > 3 || total > 256 || offset + 17 + total > segmentLength)
+					return false;
+
+				HuffmanTable* table = tableClass ? &state.ac[tableIndex] : &state.dc[tableIndex];
+				if (!BuildHuffman(table, counts, segment + offset + 17, total))
+					return false;
+
+				offset += 17 + total;
+			}
+			break;
+		}
+		case 0xDB: // Quantisation tables.
+		{
+			int offset = 0;
+			while (offset < segmentLength)
+			{
+				int precision = segment[offset] >> 4;
+				int tableIndex = segment[offset] & 15;
+				int entrySize = precision ? 2 : 1;
+
+				if (tableIndex > 3 || offset + 1 + 64 * entrySize > segmentLength)
+					return false;
+
+				// Store quantisation values in natural order.
+				for (int i = 0; i < 64; i++)
+				{
+					const unsigned char* entry = segment + offset + 1 + i * entrySize;
+					state.quant[tableIndex][zigzag[i]] = precision ? ReadWord(entry) : entry[0];
+				}
+
+				offset += 1 + 64 * entrySize;
+			}
+			break;
+		}
+		case 0xDD: // Restart interval.
+		{
+			if (segmentLength < 2)
+				return false;
+
+			state.restartInterval = ReadWord(segment);
+			break;
+		}
+		case 0xEE: // Adobe colour transform.
+		{
+			if (segmentLength >= 12 && equal(segment, segment + 5, "Adobe"))
+			{
+				state.adobeTransform = segment[11];
+			}
+			break;
+		}
+		case 0xDA: // Start of scan.
+		{
+			if (!state.frame || segmentLength < 1)
+				return false;
+
+			int count = segment[0];
+			if (count < 1 || count > 4 || segmentLength < 1 + count * 2 + 3)
+				return false;
+
+			// Match scan components with frame components.
+			vector<int> scanComponents;
+			for (int i = 0; i < count; i++)
+			{
+				int id = segment[1 + i * 2];
+				int tables = segment[2 + i * 2];
+
+				auto match = find_if(state.components.begin(), state.components.end(), [&](const Component& c) { return c.id == id; });
+				if (match == state.components.end())
+					return false;
+
+				match->dcTable = tables >> 4;
+				match->acTable = tables & 15;
+
+				if (match->dcTable > 3 || match->acTable > 3 || !state.dc[match->dcTable].defined || !state.ac[match->acTable].defined)
+					return false;
+
+				scanComponents.push_back(static_cast<int>(match - state.components.begin()));
+			}
+
+			// Decode entropy coded segment.
+			position += length;
+			if (!DecodeScan(data, size, &position, state, scanComponents, n, idct))
+				return false;
+
+			state.scanned = true;
+			continue;
+		}
+		case 0xC2: case 0xC3: case 0xC5: case 0xC6: case 0xC7:
+		case 0xC9: case 0xCA: case 0xCB: case 0xCD: case 0xCE: case 0xCF:
+		{
+			// Progressive, lossless and arithmetic coding are not supported.
+			return false;
+		}
+		default:
+		{
+			// Ignore application and comment segments.
+			break;
+		}
+		}
+
+		position += length;
+	}
+
+	if (!state.scanned)
+		return false;
+
+	// Calculate reduced output dimensions.
+	int outputWidth = (state.width * n + 7) / 8;
+	int outputHeight = (state.height * n + 7) / 8;
+	int componentCount = static_cast<int>(state.components.size());
+
+	// Treat three component images as RGB when flagged by an Adobe marker or component IDs.
+	bool rgb = componentCount == 3 && (state.adobeTransform == 0 ||
+		(state.components[0].id == 'R' && state.components[1].id == 'G' && state.components[2].id == 'B'));
+
+	output->resize(static_cast<size_t>(outputWidth) * outputHeight * 4);
+	unsigned char* pixel = output->data();
+
+	// Precalculate upsampled column for each component.
+	vector<int> columns(static_cast<size_t>(outputWidth) * componentCount);
+	for (int c = 0; c < componentCount; c++)
+	{
+		for (int x = 0; x < outputWidth; x++)
+		{
+			columns[c * outputWidth + x] = x * state.components[c].h / state.maxH;
+		}
+	}
+
+	for (int y = 0; y < outputHeight; y++)
+	{
+		// Find source rows for each component.
+		const unsigned char* rows[3] = {};
+		for (int c = 0; c < componentCount; c++)
+		{
+			const Component& component = state.components[c];
+			rows[c] = component.plane.data() + (y * component.v / state.maxV) * component.planeWidth;
+		}
+
+		for (int x = 0; x < outputWidth; x++)
+		{
+			if (componentCount == 1)
+			{
+				unsigned char grey = rows[0][columns[x]];
+				pixel[0] = pixel[1] = pixel[2] = grey;
+			}
+			else
+			{
+				int c0 = rows[0][columns[x]];
+				int c1 = rows[1][columns[outputWidth + x]];
+				int c2 = rows[2][columns[outputWidth * 2 + x]];
+
+				if (rgb)
+				{
+					pixel[0] = static_cast<unsigned char>(c0);
+					pixel[1] = static_cast<unsigned char>(c1);
+					pixel[2] = static_cast<unsigned char>(c2);
+				}
+				else
+				{
+					// Convert YCbCr to RGB.
+					float cb = static_cast<float>(c1 - 128);
+					float cr = static_cast<float>(c2 - 128);
+
+					pixel[0] = ToByte(c0 + 1.402f * cr);
+					pixel[1] = ToByte(c0 - 0.344136f * cb - 0.714136f * cr);
+					pixel[2] = ToByte(c0 + 1.772f * cb);
+				}
+			}
+
+			pixel[3] = 255;
+			pixel += 4;
+		}
+	}
+
+	*width = outputWidth;
+	*height = outputHeight;
+	*channels = componentCount;
+
+	return true;
+}
@@ -0,0 +1,26 @@
+#ifndef JPEG_DECODER_H_
+#define JPEG_DECODER_H_
+
+#include <cstddef>
+#include <vector>
+
+namespace Vaux
+{
+	// Baseline JPEG decoder which outputs images at 1/2, 1/4 or 1/8 of their full size.
+	// Scaling is performed in the DCT domain, so the full size image is never reconstructed.
+	class JpegDecoder
+	{
+	public:
+		static const int maxScale = 8;
+
+	public:
+		// Header functions.
+		static const bool IsJpeg(const unsigned char* data, const size_t& size);
+		static const int SelectScale(const int& width, const int& height, const int& targetWidth, const int& targetHeight);
+
+		// Decode function. Output is stored as RGBA8.
+		static const bool Decode(const unsigned char* data, const size_t& size, const int& scale, std::vector<unsigned char>* output, int* width, int* height, int* channels);
+	};
+}
+
+#endif //JPEG_DECODER_H_
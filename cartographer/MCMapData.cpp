@@ -1,21 +1,35 @@
 #include "MCMapData.h"
+#include "Compression.h"
+#include "MappedFile.h"
+#include "NBT.h"
+
+#include <algorithm>
+#include <cstring>
 #include <fstream>
 
 using namespace Cartographer;
+using namespace Vaux;
 using namespace std;
 
-MCMapData::MCMapData(const int& width, const int& height) : width_(width), height_(height)
+namespace
 {
-    // Reserve space in colour vector.
-    colourID_.reserve(width_ * height_);
-
-    for (int i = 0; i < width_ * height_; i++)
+    // Converts a pre 1.16 numeric dimension ID into a dimension name.
+    string DimensionName(const int64_t& id)
     {
-        // Initialise colour vector.
-        colourID_.push_back(0);
+        switch (id)
+        {
+        case -1: return "minecraft:the_nether";
+        case 1: return "minecraft:the_end";
+        default: return "minecraft:overworld";
+        }
     }
 }
-MCMapData::MCMapData(const char* filename, const int& width, const int& height)
+
+MCMapData::MCMapData(const int& width, const int& height) : width_(width), height_(height), colourID_(static_cast<size_t>(width) * height, 0)
+{
+    // Default constructor.
+}
+MCMapData::MCMapData(const char* filename, const int& width, const int& height) : MCMapData(width, height)
 {
     // Load from file.
     LoadFromFile(filename, width, height);
@@ -37,17 +51,34 @@ const int& MCMapData::GetHeight() const
 }
 
 // Returns a colour ID from position (x, y) in the map.
-const int& MCMapData::Get(const int& x, const int& y) const
+const uint8_t& MCMapData::Get(const int& x, const int& y) const
 {
     return colourID_[x + y * width_];
 }
 // Sets a colour ID at position (x, y) in the map
 void MCMapData::Set(const int& x, const int& y, const int& val)
 {
-    colourID_[x + y * width_] = val;
+    colourID_[x + y * width_] = static_cast<uint8_t>(val);
+}
+
+// Returns colour IDs for the whole map.
+span<const uint8_t> MCMapData::GetData() const
+{
+    return colourID_;
+}
+// Returns colour IDs for the whole map.
+span<uint8_t> MCMapData::GetData()
+{
+    return colourID_;
+}
+
+// Returns a view of the tile at (x, y), counted in tiles of the given size.
+const MCMapView MCMapData::GetTile(const int& x, const int& y, const int& width, const int& height) const
+{
+    return MCMapView(*this, x * width, y * height, width, height);
 }
 
-// Loads map data from a binary map file.
+// Loads map data from a binary map file. Missing data is filled with transparent pixels.
 const bool MCMapData::LoadFromFile(const char* filename, const int& width, const int& height)
 {
     // Open map file.
@@ -57,34 +88,37 @@ const bool MCMapData::LoadFromFile(const char* filename, const int& width, const
     // Check if file was succesfully opened.
     if (inputData.is_open())
     {
-        // Update local width and height.
+        // Update local width and height, initialise colour IDs.
         width_ = width;
         height_ = height;
+        colourID_.assign(static_cast<size_t>(width_) * height_, 0);
 
-        // Initialise colour ID vector, reserve memory.
-        vector<int> colourID;
-        colourID.reserve(width_ * height_);
+        // Only read as much data as the map can hold.
+        size_t fileSize = static_cast<size_t>(inputData.tellg());
+        size_t size = min(fileSize, colourID_.size());
 
-        streampos size = sizeof(unsigned char);
-        unsigned char* memblock = new unsigned char[size];
+        if (fileSize >= mappedFileThreshold)
+        {
+            // Map large files rather than reading them through a stream.
+            inputData.close();
 
-        // Set seek position.
-        inputData.seekg(0, ios::beg);
+            MappedFile file;
+            if (!file.Open(filename))
+                return false;
 
-        for (int i = 0; i < width_ * height_; i++)
+            // The file may have changed since it was measured, so size the copy from the mapping.
+            memcpy(colourID_.data(), file.GetData().data(), min(file.GetData().size(), colourID_.size()));
+        }
+        else
         {
-            // Read current memory block (break if out of data).
-            if (!inputData.read(reinterpret_cast<char*>(memblock), size)) break;
+            // Read colour IDs in a single call, failing if the file was cut short.
+            inputData.seekg(0, ios::beg);
+            inputData.read(reinterpret_cast<char*>(colourID_.data()), size);
+            if (static_cast<size_t>(inputData.gcount()) != size)
+                return false;
 
-            // Convert memory block from binary to integer, store in colour array.
-            colourID.push_back((unsigned int)*memblock);
+            inputData.close();
         }
-
-        // Close map file, delete memory block.
-        inputData.close();
-
-        // Update colourID with new data.
-        colourID_ = colourID;
     }
     else
     {
@@ -97,23 +131,226 @@ const bool MCMapData::LoadFromFile(const char* filename, const int& width, const
 }
 // Saves map data to a binary file.
 const bool MCMapData::SaveToFile(const char* filename) const
+{
+    return MCMapView(*this).SaveToFile(filename);
+}
+// Loads map data from a gzip compressed map_<id>.dat file.
+const bool MCMapData::LoadFromDatFile(const char* filename, MCMapInfo* info)
+{
+    // Open map file.
+    ifstream inputData;
+    inputData.open(filename, ios::in | ios::binary | ios::ate);
+
+    // Check if file was succesfully opened.
+    if (!inputData.is_open())
+        return false;
+
+    // Read compressed file in a single call.
+    vector<uint8_t> fileData(static_cast<size_t>(inputData.tellg()));
+    inputData.seekg(0, ios::beg);
+    inputData.read(reinterpret_cast<char*>(fileData.data()), fileData.size());
+    inputData.close();
+
+    return LoadFromDat(fileData, info);
+}
+// Saves map data to a gzip compressed map_<id>.dat file.
+const bool MCMapData::SaveToDatFile(const char* filename, const MCMapInfo& info) const
+{
+    return MCMapView(*this).SaveToDatFile(filename, info);
+}
+// Loads map data from the contents of a map_<id>.dat file. Tags are read in a single pass,
+// only metadata and colours are extracted. Metadata is ignored if info is null.
+const bool MCMapData::LoadFromDat(span<const uint8_t> data, MCMapInfo* info)
+{
+    // Decompress file.
+    vector<uint8_t> nbt;
+    if (!Compression::DecompressGzip(data, &nbt, maxDatSize))
+        return false;
+
+    NBTReader reader(nbt);
+    NBTTag type;
+    string_view name;
+
+    // Check for root compound.
+    if (!reader.ReadHeader(&type, &name) || type != NBTTag::COMPOUND)
+        return false;
+
+    bool coloursFound = false;
+
+    // Loop through tags in root compound.
+    while (reader.ReadHeader(&type, &name) && type != NBTTag::END)
+    {
+        if (name == "DataVersion" && info)
+        {
+            info->dataVersion = static_cast<int>(reader.ReadInteger(type));
+        }
+        else if (name == "data" && type == NBTTag::COMPOUND)
+        {
+            // Loop through tags in data compound.
+            while (reader.ReadHeader(&type, &name) && type != NBTTag::END)
+            {
+                if (name == "colors" && type == NBTTag::BYTE_ARRAY)
+                {
+                    // Copy colours, filling any missing data with transparent pixels.
+                    span<const uint8_t> colours = reader.ReadByteArray();
+
+                    width_ = defaultWidth;
+                    height_ = defaultHeight;
+                    colourID_.assign(static_cast<size_t>(width_) * height_, 0);
+                    memcpy(colourID_.data(), colours.data(), min(colours.size(), colourID_.size()));
+
+                    coloursFound = reader.IsValid();
+
+                    // Stop once colours are read if metadata isn't required.
+                    if (!info)
+                        return coloursFound;
+                }
+                else if (info && name == "dimension")
+                {
+                    info->dimension = (type == NBTTag::STRING) ? string(reader.ReadString()) : DimensionName(reader.ReadInteger(type));
+                }
+                else if (info && name == "scale")
+                {
+                    info->scale = static_cast<int>(reader.ReadInteger(type));
+                }
+                else if (info && name == "xCenter")
+                {
+                    info->xCenter = static_cast<int>(reader.ReadInteger(type));
+                }
+                else if (info && name == "zCenter")
+                {
+                    info->zCenter = static_cast<int>(reader.ReadInteger(type));
+                }
+                else if (info && name == "locked")
+                {
+                    info->locked = reader.ReadInteger(type) != 0;
+                }
+                else if (info && name == "trackingPosition")
+                {
+                    info->trackingPosition = reader.ReadInteger(type) != 0;
+                }
+                else if (info && name == "unlimitedTracking")
+                {
+                    info->unlimitedTracking = reader.ReadInteger(type) != 0;
+                }
+                else
+                {
+                    reader.Skip(type);
+                }
+            }
+        }
+        else
+        {
+            reader.Skip(type);
+        }
+    }
+
+    return coloursFound && reader.IsValid();
+}
+// Encodes map data as the gzip compressed contents of a map_<id>.dat file.
+const bool MCMapData::SaveToDat(vector<uint8_t>* output, const MCMapInfo& info) const
+{
+    return MCMapView(*this).SaveToDat(output, info);
+}
+
+MCMapView::MCMapView(const MCMapData& map) : MCMapView(map, 0, 0, map.GetWidth(), map.GetHeight())
+{
+    // Whole map constructor.
+}
+MCMapView::MCMapView(const MCMapData& map, const int& x, const int& y, const int& width, const int& height) : data_(map.GetData().data() + x + static_cast<size_t>(y) * map.GetWidth()), width_(width), height_(height), stride_(map.GetWidth())
+{
+    // Region constructor, the region must lie within the map.
+}
+
+// Returns width of view.
+const int& MCMapView::GetWidth() const
+{
+    return width_;
+}
+// Returns height of view.
+const int& MCMapView::GetHeight() const
+{
+    return height_;
+}
+
+// Returns a colour ID from position (x, y) in the view.
+const uint8_t& MCMapView::Get(const int& x, const int& y) const
+{
+    return data_[x + y * stride_];
+}
+// Returns colour IDs for a single row of the view.
+span<const uint8_t> MCMapView::GetRow(const int& y) const
+{
+    return span<const uint8_t>(data_ + y * stride_, width_);
+}
+// Returns true if rows are stored back to back, so the view can be accessed as a single block.
+const bool MCMapView::IsContiguous() const
+{
+    return stride_ == static_cast<size_t>(width_) || height_ <= 1;
+}
+
+// Returns a hash of the viewed colour IDs, equal to the hash of the same colours stored contiguously.
+const uint64_t MCMapView::GetHash() const
+{
+    if (IsContiguous())
+        return Compression::Hash64(span<const uint8_t>(data_, static_cast<size_t>(width_) * height_));
+
+    // Gather rows, the hash needs a single block.
+    vector<uint8_t> colours;
+    colours.reserve(static_cast<size_t>(width_) * height_);
+    for (int y = 0; y < height_; y++)
+    {
+        span<const uint8_t> row = GetRow(y);
+        colours.insert(colours.end(), row.begin(), row.end());
+    }
+
+    return Compression::Hash64(colours);
+}
+// Returns true if both views have the same size and colour IDs.
+const bool MCMapView::HasSameColours(const MCMapView& other) const
+{
+    if (width_ != other.width_ || height_ != other.height_)
+        return false;
+
+    for (int y = 0; y < height_; y++)
+    {
+        if (!equal(GetRow(y).begin(), GetRow(y).end(), other.GetRow(y).begin()))
+            return false;
+    }
+
+    return true;
+}
+
+// Saves viewed colour IDs to a binary file.
+const bool MCMapView::SaveToFile(const char* filename) const
 {
     // Open output file.
     ofstream outputData;
-    outputData.open(filename, ios::out | ios::binary | ios::ate);
+    outputData.open(filename, ios::out | ios::binary | ios::trunc);
 
     // Check if file was succesfully opened.
     if (outputData.is_open())
     {
-        // Loop through each colour in vector.
-        for (int i = 0; i < width_ * height_; i++)
+        if (IsContiguous())
+        {
+            // Write colour IDs in a single call.
+            outputData.write(reinterpret_cast<const char*>(data_), static_cast<streamsize>(width_) * height_);
+        }
+        else
         {
-            // Convert colour ID to char, store in map file.
-            outputData << (char)colourID_[i];
+            // Write colour IDs row by row.
+            for (int y = 0; y < height_; y++)
+            {
+                outputData.write(reinterpret_cast<const char*>(GetRow(y).data()), width_);
+            }
         }
 
         // Close output file.
         outputData.close();
+
+        // Check write was successful.
+        if (!outputData)
+            return false;
     }
     else
     {
@@ -121,6 +358,66 @@ const bool MCMapData::SaveToFile(const char* filename) const
         return false;
     }
 
-    // File loaded successfully.
+    // File saved successfully.
     return true;
-}
\ No newline at end of file
+}
+// Saves viewed colour IDs to a gzip compressed map_<id>.dat file.
+const bool MCMapView::SaveToDatFile(const char* filename, const MCMapInfo& info) const
+{
+    // Encode map file.
+    vector<uint8_t> fileData;
+    if (!SaveToDat(&fileData, info))
+        return false;
+
+    // Open output file.
+    ofstream outputData;
+    outputData.open(filename, ios::out | ios::binary | ios::trunc);
+
+    // Check if file was succesfully opened.
+    if (!outputData.is_open())
+        return false;
+
+    // Write compressed file in a single call.
+    outputData.write(reinterpret_cast<const char*>(fileData.data()), fileData.size());
+    outputData.close();
+
+    return !outputData.fail();
+}
+// Encodes viewed colour IDs as the gzip compressed contents of a map_<id>.dat file.
+const bool MCMapView::SaveToDat(vector<uint8_t>* output, const MCMapInfo& info) const
+{
+    // Minecraft only supports 128x128 maps.
+    if (width_ != MCMapData::defaultWidth || height_ != MCMapData::defaultHeight)
+        return false;
+
+    // Build NBT data, reserving space for colours and metadata.
+    vector<uint8_t> nbt;
+    nbt.reserve(static_cast<size_t>(width_) * height_ + 512);
+
+    NBTWriter writer(&nbt);
+    writer.BeginCompound("");
+    writer.BeginCompound("data");
+    writer.WriteString("dimension", info.dimension);
+    writer.WriteByte("locked", info.locked);
+    writer.WriteByte("scale", static_cast<int8_t>(info.scale));
+    writer.WriteByte("trackingPosition", info.trackingPosition);
+    writer.WriteByte("unlimitedTracking", info.unlimitedTracking);
+    writer.WriteInt("xCenter", info.xCenter);
+    writer.WriteInt("zCenter", info.zCenter);
+    writer.WriteEmptyList("banners", NBTTag::COMPOUND);
+    writer.WriteEmptyList("frames", NBTTag::COMPOUND);
+
+    // Write colours straight from the source map, row by row.
+    writer.BeginByteArray("colors", width_ * height_);
+    for (int y = 0; y < height_; y++)
+    {
+        writer.WriteBytes(GetRow(y));
+    }
+
+    writer.EndCompound();
+    writer.WriteInt("DataVersion", info.dataVersion);
+    writer.EndCompound();
+
+    // Compress NBT data.
+    return Compression::CompressGzip(nbt, output);
+}
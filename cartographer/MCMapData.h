@@ -1,19 +1,42 @@
 #ifndef MC_MAP_DATA_H_
 #define MC_MAP_DATA_H_
 
+#include <cstdint>
+#include <span>
+#include <string>
 #include <vector>
 
 namespace Cartographer
 {
+	// Metadata stored alongside the colours in a Minecraft map_<id>.dat file.
+	struct MCMapInfo
+	{
+		int scale = 0;
+		std::string dimension = "minecraft:overworld";
+		int xCenter = 0, zCenter = 0;
+		bool locked = true;
+		bool trackingPosition = false;
+		bool unlimitedTracking = false;
+		int dataVersion = 3465;
+	};
+
+	class MCMapView;
+
 	class MCMapData
 	{
 	public:
-		static const int defaultWidth = 128;
-		static const int defaultHeight = 128;
+		static constexpr int defaultWidth = 128;
+		static constexpr int defaultHeight = 128;
+
+		// Files at least this large are memory mapped rather than read.
+		static constexpr size_t mappedFileThreshold = 1 << 20;
+
+		// Largest decompressed map_<id>.dat file accepted, colours plus room for banners and frames.
+		static constexpr size_t maxDatSize = 1 << 20;
 
 	private:
 		int width_, height_;
-		std::vector<int> colourID_;
+		std::vector<uint8_t> colourID_;
 
 	public:
 		// Constructors and Destructors.
@@ -26,12 +49,57 @@ namespace Cartographer
 		const int& GetHeight() const;
 		
 		// Getters and setters.
-		const int& Get(const int& x, const int& y) const;
+		const uint8_t& Get(const int& x, const int& y) const;
 		void Set(const int& x, const int& y, const int& val);
 
+		// Raw colour ID access, stored row by row.
+		std::span<const uint8_t> GetData() const;
+		std::span<uint8_t> GetData();
+
+		// Returns a view of the map tile at (x, y), when the map is a wall of several maps.
+		const MCMapView GetTile(const int& x, const int& y, const int& width = defaultWidth, const int& height = defaultHeight) const;
+
 		// File functions.
 		const bool LoadFromFile(const char* filename, const int& width = defaultWidth, const int& height = defaultHeight);
 		const bool SaveToFile(const char* filename) const;
+
+		// Minecraft map_<id>.dat functions (gzip compressed NBT).
+		const bool LoadFromDatFile(const char* filename, MCMapInfo* info = nullptr);
+		const bool SaveToDatFile(const char* filename, const MCMapInfo& info = MCMapInfo()) const;
+		const bool LoadFromDat(std::span<const uint8_t> data, MCMapInfo* info = nullptr);
+		const bool SaveToDat(std::vector<uint8_t>* output, const MCMapInfo& info = MCMapInfo()) const;
+	};
+
+	// Read only view of a rectangular region of a map. Rows are strided through the
+	// source map, so tiles of a larger map can be saved without being copied.
+	class MCMapView
+	{
+	private:
+		const uint8_t* data_;
+		int width_, height_;
+		size_t stride_;
+
+	public:
+		MCMapView(const MCMapData& map);
+		MCMapView(const MCMapData& map, const int& x, const int& y, const int& width, const int& height);
+
+		// Size functions.
+		const int& GetWidth() const;
+		const int& GetHeight() const;
+
+		// Getters.
+		const uint8_t& Get(const int& x, const int& y) const;
+		std::span<const uint8_t> GetRow(const int& y) const;
+		const bool IsContiguous() const;
+
+		// Content functions, comparing colour IDs only.
+		const uint64_t GetHash() const;
+		const bool HasSameColours(const MCMapView& other) const;
+
+		// File functions.
+		const bool SaveToFile(const char* filename) const;
+		const bool SaveToDatFile(const char* filename, const MCMapInfo& info = MCMapInfo()) const;
+		const bool SaveToDat(std::vector<uint8_t>* output, const MCMapInfo& info = MCMapInfo()) const;
 	};
 }
 
@@ -0,0 +1,152 @@
+#include "MCPalette.h"
+#include "Compression.h"
+#include "PngWriter.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#if defined(__AVX2__)
+#define CARTOGRAPHER_AVX2
+#include <immintrin.h>
+#endif
+
+using namespace Cartographer;
+using namespace Vaux;
+using namespace std;
+
+namespace
+{
+    // Converts a run of colour IDs into RGBA8 pixels.
+    void ExpandRun(const uint32_t* colour, const uint8_t* input, uint8_t* output, const size_t& count)
+    {
+        size_t i = 0;
+
+#ifdef CARTOGRAPHER_AVX2
+        // Widen eight IDs to 32 bits and gather their colours from the table.
+        for (; i + 8 <= count; i += 8)
+        {
+            __m256i id = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(input + i)));
+            __m256i pixels = _mm256_i32gather_epi32(reinterpret_cast<const int*>(colour), id, 4);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(output + i * 4), pixels);
+        }
+#endif
+
+        // Copies compile to a single 32 bit store per pixel.
+        for (; i < count; i++)
+        {
+            memcpy(output + i * 4, &colour[input[i]], 4);
+        }
+    }
+}
+
+MCPalette::MCPalette(const vector<Vector3i>& paletteData)
+{
+    // IDs without a colour are drawn in the debug colour.
+    uint32_t debug;
+    memcpy(&debug, debugColour, sizeof(debug));
+    colour_.fill(debug);
+
+    for (int i = 0; i < transparentCount; i++)
+    {
+        colour_[i] = 0;
+    }
+
+    for (int i = transparentCount; i < size && i < static_cast<int>(paletteData.size()); i++)
+    {
+        // Pack colour in memory order, so expanding a pixel is a single store.
+        uint8_t rgba[4] =
+        {
+            static_cast<uint8_t>(clamp(paletteData[i].x, 0, 255)),
+            static_cast<uint8_t>(clamp(paletteData[i].y, 0, 255)),
+            static_cast<uint8_t>(clamp(paletteData[i].z, 0, 255)),
+            255
+        };
+
+        memcpy(&colour_[i], rgba, sizeof(rgba));
+    }
+}
+
+// Returns the packed RGBA colour of a map colour ID.
+const uint32_t& MCPalette::Get(const uint8_t& id) const
+{
+    return colour_[id];
+}
+// Returns a hash of every colour, used to detect output drawn with another palette.
+const uint64_t MCPalette::GetHash() const
+{
+    return Compression::Hash64(span<const uint8_t>(reinterpret_cast<const uint8_t*>(colour_.data()), colour_.size() * sizeof(uint32_t)));
+}
+
+// Converts colour IDs into RGBA8 pixels. Whole maps are expanded in one pass, tiles row by row.
+void MCPalette::Expand(const MCMapView& map, uint8_t* output) const
+{
+    if (map.IsContiguous() && map.GetHeight() > 0)
+    {
+        ExpandRun(colour_.data(), map.GetRow(0).data(), output, static_cast<size_t>(map.GetWidth()) * map.GetHeight());
+        return;
+    }
+
+    for (int y = 0; y < map.GetHeight(); y++)
+    {
+        span<const uint8_t> row = map.GetRow(y);
+        ExpandRun(colour_.data(), row.data(), output + static_cast<size_t>(y) * map.GetWidth() * 4, row.size());
+    }
+}
+// Converts a row of colour IDs into RGBA8 pixels, each repeated zoom times for nearest neighbour upscaling.
+void MCPalette::ExpandZoomed(span<const uint8_t> row, const int& zoom, uint8_t* output) const
+{
+    if (zoom <= 1)
+    {
+        ExpandRun(colour_.data(), row.data(), output, row.size());
+        return;
+    }
+
+    size_t pixelSize = static_cast<size_t>(zoom) * 4;
+    for (size_t x = 0; x < row.size(); x++)
+    {
+        uint8_t* pixel = output + x * pixelSize;
+        memcpy(pixel, &colour_[row[x]], 4);
+
+        // Double the copied run until the pixel is filled.
+        for (size_t filled = 4; filled < pixelSize; filled *= 2)
+        {
+            memcpy(pixel + filled, pixel, min(filled, pixelSize - filled));
+        }
+    }
+}
+
+// Saves a map as an indexed PNG file.
+const bool MCPalette::SaveIndexedPng(const char* filename, const MCMapView& map, const PngWriter::Mode& mode, ThreadPool* pool) const
+{
+    ofstream file(filename, ios::out | ios::binary | ios::trunc);
+    if (!file.is_open() || !SaveIndexedPng(file, map, mode, pool))
+        return false;
+
+    file.close();
+    return !file.fail();
+}
+// Writes a map as an indexed PNG image to a stream. The palette is trimmed to the highest ID used.
+const bool MCPalette::SaveIndexedPng(ostream& stream, const MCMapView& map, const PngWriter::Mode& mode, ThreadPool* pool) const
+{
+    uint8_t highest = 0;
+    for (int y = 0; y < map.GetHeight(); y++)
+    {
+        span<const uint8_t> row = map.GetRow(y);
+        if (!row.empty())
+            highest = max(highest, *max_element(row.begin(), row.end()));
+    }
+
+    PngWriter writer(mode, pool);
+    span<const uint8_t> colours(reinterpret_cast<const uint8_t*>(colour_.data()), (static_cast<size_t>(highest) + 1) * 4);
+    if (!writer.OpenIndexed(stream, map.GetWidth(), map.GetHeight(), colours))
+        return false;
+
+    for (int y = 0; y < map.GetHeight(); y++)
+    {
+        if (!writer.WriteRow(map.GetRow(y)))
+            return false;
+    }
+
+    return writer.Close();
+}
@@ -0,0 +1,54 @@
+#ifndef MC_PALETTE_H_
+#define MC_PALETTE_H_
+
+#include "MCMapData.h"
+#include "PngWriter.h"
+#include "Vector3.h"
+
+#include <array>
+#include <cstdint>
+#include <ostream>
+#include <span>
+#include <vector>
+
+namespace Cartographer
+{
+	// Precomputed RGBA colour for every possible map colour ID, used to render maps
+	// without per pixel palette lookups or branches. IDs past the end of the colour
+	// table are drawn in a debug colour, so corrupt maps are visible rather than read
+	// out of bounds.
+	class MCPalette
+	{
+	public:
+		static constexpr int size = 256;
+
+		// IDs below this value are transparent.
+		static constexpr int transparentCount = 4;
+
+		// Colour of IDs missing from the colour table, as RGBA.
+		static constexpr uint8_t debugColour[4] = { 255, 0, 255, 255 };
+
+	private:
+		// Colours packed as RGBA8 in memory order.
+		std::array<uint32_t, size> colour_;
+
+	public:
+		MCPalette(const std::vector<Vaux::Vector3i>& paletteData);
+
+		// Getters.
+		const uint32_t& Get(const uint8_t& id) const;
+		const uint64_t GetHash() const;
+
+		// Render functions. Output must hold width * height * 4 bytes.
+		void Expand(const MCMapView& map, uint8_t* output) const;
+
+		// Converts one row of colour IDs, repeating each pixel zoom times. Output must hold width * zoom * 4 bytes.
+		void ExpandZoomed(std::span<const uint8_t> row, const int& zoom, uint8_t* output) const;
+
+		// File functions. Colour IDs are written as palette indices, without expanding them to RGBA.
+		const bool SaveIndexedPng(const char* filename, const MCMapView& map, const Vaux::PngWriter::Mode& mode = Vaux::PngWriter::Mode::BALANCED, Vaux::ThreadPool* pool = nullptr) const;
+		const bool SaveIndexedPng(std::ostream& stream, const MCMapView& map, const Vaux::PngWriter::Mode& mode = Vaux::PngWriter::Mode::BALANCED, Vaux::ThreadPool* pool = nullptr) const;
+	};
+}
+
+#endif //MC_PALETTE_H_
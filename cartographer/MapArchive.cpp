@@ -0,0 +1,310 @@
+#include "MapArchive.h"
+#include "Compression.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+
+using namespace Cartographer;
+using namespace Vaux;
+using namespace std;
+
+// Maps an archive file. Returns false if there is no usable archive.
+const bool MapArchive::Open(const filesystem::path& path)
+{
+    Close();
+
+    if (!file_.Open(path.string().c_str()))
+        return false;
+
+    // Check header, and that the index lies within the file.
+    span<const byte> data = file_.GetData();
+    Header header;
+    if (data.size() < sizeof(Header))
+    {
+        Close();
+        return false;
+    }
+
+    memcpy(&header, data.data(), sizeof(Header));
+    if (header.magic != magic || header.version != version || header.indexOffset % alignof(MapArchiveEntry) != 0 ||
+        header.indexOffset > data.size() || header.count > (data.size() - header.indexOffset) / sizeof(MapArchiveEntry))
+    {
+        Close();
+        return false;
+    }
+
+    entries_ = span<const MapArchiveEntry>(reinterpret_cast<const MapArchiveEntry*>(data.data() + header.indexOffset), static_cast<size_t>(header.count));
+    return true;
+}
+// Unmaps the archive.
+void MapArchive::Close()
+{
+    entries_ = {};
+    file_.Close();
+}
+
+// Returns the entry for a map ID, or null if the map isn't in the archive.
+const MapArchiveEntry* MapArchive::Find(const int& id) const
+{
+    auto entry = lower_bound(entries_.begin(), entries_.end(), id, [](const MapArchiveEntry& a, const int& id) { return a.id < id; });
+
+    if (entry == entries_.end() || entry->id != id)
+        return nullptr;
+
+    return &*entry;
+}
+// Returns all entries, sorted by ID.
+span<const MapArchiveEntry> MapArchive::GetEntries() const
+{
+    return entries_;
+}
+// Returns the highest map ID in the archive, or -1 if it is empty.
+const int MapArchive::GetLastID() const
+{
+    return entries_.empty() ? -1 : entries_.back().id;
+}
+
+// Reads a map from the archive, along with its info.
+const bool MapArchive::Read(const MapArchiveEntry& entry, MCMapData* map, MCMapInfo* info) const
+{
+    span<const byte> data = file_.GetData();
+    if (entry.offset > data.size() || entry.size > data.size() - entry.offset)
+        return false;
+
+    span<const uint8_t> stored(reinterpret_cast<const uint8_t*>(data.data() + entry.offset), static_cast<size_t>(entry.size));
+
+    // Decompress colours if needed.
+    vector<uint8_t> decompressed;
+    if (entry.flags & compressed)
+    {
+        if (!Compression::DecompressGzip(stored, &decompressed, static_cast<size_t>(MCMapData::defaultWidth) * MCMapData::defaultHeight))
+            return false;
+
+        stored = decompressed;
+    }
+
+    *map = MCMapData();
+    if (stored.size() != map->GetData().size() || Compression::Hash64(stored) != entry.colourHash)
+        return false;
+
+    copy(stored.begin(), stored.end(), map->GetData().begin());
+
+    if (info)
+    {
+        info->scale = entry.scale;
+        info->dimension = string(entry.dimension, strnlen(entry.dimension, sizeof(entry.dimension)));
+        info->xCenter = entry.xCenter;
+        info->zCenter = entry.zCenter;
+        info->locked = (entry.flags & locked) != 0;
+        info->trackingPosition = (entry.flags & trackingPosition) != 0;
+        info->unlimitedTracking = (entry.flags & unlimitedTracking) != 0;
+        info->dataVersion = entry.dataVersion;
+    }
+
+    return true;
+}
+
+// Writes new maps and a merged index after the existing contents, then updates the header.
+const bool MapArchive::Append(const filesystem::path& path, span<const MCMapView> maps, span<const int> ids, span<const MCMapInfo> info, const bool& compress, ThreadPool& pool)
+{
+    if (ids.size() != maps.size() || info.size() != maps.size())
+        return false;
+
+    // Read the existing index. A file which isn't an archive is never overwritten. The archive stays
+    // mapped so stored maps can be copied if it is compacted.
+    MapArchive archive;
+    bool exists = filesystem::exists(path);
+    if (exists && !archive.Open(path))
+        return false;
+
+    // Encode maps in parallel.
+    vector<vector<uint8_t>> payloads(maps.size());
+    vector<MapArchiveEntry> added(maps.size());
+    atomic<bool> success = true;
+
+    pool.ParallelFor(maps.size(), [&](size_t i)
+    {
+        const MCMapView& map = maps[i];
+        if (map.GetWidth() != MCMapData::defaultWidth || map.GetHeight() != MCMapData::defaultHeight || info[i].dimension.size() >= sizeof(MapArchiveEntry::dimension))
+        {
+            success = false;
+            return;
+        }
+
+        vector<uint8_t> colours;
+        colours.reserve(static_cast<size_t>(map.GetWidth()) * map.GetHeight());
+        for (int y = 0; y < map.GetHeight(); y++)
+        {
+            span<const uint8_t> row = map.GetRow(y);
+            colours.insert(colours.end(), row.begin(), row.end());
+        }
+
+        MapArchiveEntry& entry = added[i];
+        memset(&entry, 0, sizeof(MapArchiveEntry));
+        entry.id = ids[i];
+        entry.colourHash = Compression::Hash64(colours);
+        entry.scale = info[i].scale;
+        entry.xCenter = info[i].xCenter;
+        entry.zCenter = info[i].zCenter;
+        entry.dataVersion = info[i].dataVersion;
+        memcpy(entry.dimension, info[i].dimension.data(), info[i].dimension.size());
+        entry.flags = (info[i].locked ? locked : 0) | (info[i].trackingPosition ? trackingPosition : 0) | (info[i].unlimitedTracking ? unlimitedTracking : 0);
+
+        // Keep the compressed colours only if they are smaller.
+        if (compress && Compression::CompressGzip(colours, &payloads[i]) && payloads[i].size() < colours.size())
+        {
+            entry.flags |= compressed;
+        }
+        else
+        {
+            payloads[i] = move(colours);
+        }
+
+        entry.size = payloads[i].size();
+    });
+
+    if (!success)
+        return false;
+
+    // New maps replace stored maps with the same ID, later maps replacing earlier ones. Each entry
+    // keeps the new map it came from, or none if it is already stored.
+    const size_t none = maps.size();
+    vector<pair<MapArchiveEntry, size_t>> merged;
+    for (const MapArchiveEntry& entry : archive.GetEntries())
+    {
+        merged.push_back({ entry, none });
+    }
+    for (size_t i = 0; i < added.size(); i++)
+    {
+        merged.push_back({ added[i], i });
+    }
+    stable_sort(merged.begin(), merged.end(), [](const pair<MapArchiveEntry, size_t>& a, const pair<MapArchiveEntry, size_t>& b) { return a.first.id < b.first.id; });
+
+    vector<MapArchiveEntry> index;
+    vector<size_t> source;
+    index.reserve(merged.size());
+    source.reserve(merged.size());
+    for (const pair<MapArchiveEntry, size_t>& entry : merged)
+    {
+        if (!index.empty() && index.back().id == entry.first.id)
+        {
+            index.back() = entry.first;
+            source.back() = entry.second;
+        }
+        else
+        {
+            index.push_back(entry.first);
+            source.push_back(entry.second);
+        }
+    }
+
+    // Replaced maps and old indexes are never read again. Once they would outweigh the maps still in
+    // use, the archive is rewritten without them rather than appended to.
+    uint64_t indexSize = index.size() * sizeof(MapArchiveEntry);
+    uint64_t liveSize = sizeof(Header) + indexSize;
+    for (const MapArchiveEntry& entry : index)
+    {
+        liveSize += entry.size;
+    }
+
+    uint64_t appendedSize = (exists ? archive.file_.GetData().size() : sizeof(Header)) + indexSize;
+    for (const vector<uint8_t>& payload : payloads)
+    {
+        appendedSize += payload.size();
+    }
+
+    bool compact = exists && appendedSize > liveSize * 2;
+
+    // Writes maps from offset onwards followed by the index, then points the header at the index.
+    // Stored maps are only written when compacting, otherwise they stay where they are.
+    auto writeArchive = [&](ostream& archiveData, uint64_t offset)
+    {
+        span<const byte> storedData = archive.file_.GetData();
+        for (size_t i = 0; i < index.size(); i++)
+        {
+            if (source[i] != none)
+            {
+                index[i].offset = offset;
+                archiveData.write(reinterpret_cast<const char*>(payloads[source[i]].data()), static_cast<streamsize>(payloads[source[i]].size()));
+                offset += index[i].size;
+            }
+            else if (compact)
+            {
+                if (index[i].offset > storedData.size() || index[i].size > storedData.size() - index[i].offset)
+                    return false;
+
+                archiveData.write(reinterpret_cast<const char*>(storedData.data() + index[i].offset), static_cast<streamsize>(index[i].size));
+                index[i].offset = offset;
+                offset += index[i].size;
+            }
+        }
+
+        // Write the index, aligned so it can be used in place once mapped.
+        const char padding[alignof(MapArchiveEntry)] = {};
+        size_t paddingSize = (alignof(MapArchiveEntry) - offset % alignof(MapArchiveEntry)) % alignof(MapArchiveEntry);
+        archiveData.write(padding, static_cast<streamsize>(paddingSize));
+        offset += paddingSize;
+
+        archiveData.write(reinterpret_cast<const char*>(index.data()), static_cast<streamsize>(indexSize));
+        archiveData.flush();
+
+        // Only point the header at the new index once everything else is written.
+        Header header = { magic, version, index.size(), offset };
+        archiveData.seekp(0, ios::beg);
+        archiveData.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+
+        return !archiveData.fail();
+    };
+
+    // Compact into a new file, then move it over the archive.
+    if (compact)
+    {
+        filesystem::path temporaryPath = path;
+        temporaryPath += ".tmp";
+
+        ofstream archiveData(temporaryPath, ios::out | ios::binary | ios::trunc);
+        Header header = { magic, version, 0, sizeof(Header) };
+        archiveData.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+
+        bool written = archiveData.is_open() && writeArchive(archiveData, sizeof(Header));
+        archiveData.close();
+        archive.Close();
+
+        error_code error;
+        if (written && !archiveData.fail())
+            filesystem::rename(temporaryPath, path, error);
+
+        if (!written || archiveData.fail() || error)
+        {
+            filesystem::remove(temporaryPath, error);
+            return false;
+        }
+
+        return true;
+    }
+
+    archive.Close();
+
+    // Open the archive, writing an empty header if it is new.
+    fstream archiveData;
+    if (!exists)
+    {
+        archiveData.open(path, ios::out | ios::binary | ios::trunc);
+        Header header = { magic, version, 0, sizeof(Header) };
+        archiveData.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+        archiveData.close();
+    }
+
+    archiveData.open(path, ios::in | ios::out | ios::binary);
+    if (!archiveData.is_open())
+        return false;
+
+    // Append maps after everything already stored.
+    archiveData.seekp(0, ios::end);
+    bool written = writeArchive(archiveData, static_cast<uint64_t>(archiveData.tellp()));
+    archiveData.close();
+
+    return written && !archiveData.fail();
+}
@@ -0,0 +1,82 @@
+#ifndef MAP_ARCHIVE_H_
+#define MAP_ARCHIVE_H_
+
+#include "MCMapData.h"
+#include "MappedFile.h"
+#include "ThreadPool.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <vector>
+
+namespace Cartographer
+{
+	// Map stored in an archive. Stored in native byte order.
+	struct MapArchiveEntry
+	{
+		int32_t id;
+		uint32_t flags;
+		uint64_t offset;
+		uint64_t size;
+		uint64_t colourHash;
+		int32_t scale;
+		int32_t xCenter;
+		int32_t zCenter;
+		int32_t dataVersion;
+		char dimension[64];
+	};
+
+	// Many maps in a single file. Map colours are stored one after another, optionally gzip
+	// compressed, followed by an index of fixed size entries sorted by ID. The file is memory mapped,
+	// so any map is read without loading the others.
+	//
+	// Appending writes new maps and a new index after the existing data, then points the header at
+	// the new index, so an interrupted append leaves the archive as it was. Once replaced maps and
+	// old indexes take more space than the maps in use, the archive is compacted into a new file
+	// which replaces it.
+	class MapArchive
+	{
+	public:
+		static constexpr uint32_t magic = 0x52414D43;
+		static constexpr uint32_t version = 1;
+
+		// Entry flags.
+		static constexpr uint32_t compressed = 1 << 0;
+		static constexpr uint32_t locked = 1 << 1;
+		static constexpr uint32_t trackingPosition = 1 << 2;
+		static constexpr uint32_t unlimitedTracking = 1 << 3;
+
+	private:
+		struct Header
+		{
+			uint32_t magic;
+			uint32_t version;
+			uint64_t count;
+			uint64_t indexOffset;
+		};
+
+		Vaux::MappedFile file_;
+		std::span<const MapArchiveEntry> entries_;
+
+	public:
+		// File functions. Must be closed before the archive is appended to.
+		const bool Open(const std::filesystem::path& path);
+		void Close();
+
+		// Entry functions.
+		const MapArchiveEntry* Find(const int& id) const;
+		std::span<const MapArchiveEntry> GetEntries() const;
+		const int GetLastID() const;
+
+		// Map functions. Colours are checked against their hash when read.
+		const bool Read(const MapArchiveEntry& entry, MCMapData* map, MCMapInfo* info = nullptr) const;
+
+		// Adds maps with the given IDs and info, creating the archive if needed. Maps replace any
+		// stored with the same ID. Maps are compressed in parallel, and stored uncompressed if that
+		// is smaller or compression is off.
+		static const bool Append(const std::filesystem::path& path, std::span<const MCMapView> maps, std::span<const int> ids, std::span<const MCMapInfo> info, const bool& compress, Vaux::ThreadPool& pool);
+	};
+}
+
+#endif //MAP_ARCHIVE_H_
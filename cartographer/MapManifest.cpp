@@ -0,0 +1,80 @@
+#include "MapManifest.h"
+#include "WorldWriter.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace Cartographer;
+using namespace Vaux;
+using namespace std;
+
+// Maps a manifest file. Returns false if there is no usable manifest.
+const bool MapManifest::Load(const filesystem::path& path)
+{
+    Close();
+
+    if (!file_.Open(path.string().c_str()))
+        return false;
+
+    // Check header and size.
+    span<const byte> data = file_.GetData();
+    Header header;
+    if (data.size() < sizeof(Header))
+    {
+        Close();
+        return false;
+    }
+
+    memcpy(&header, data.data(), sizeof(Header));
+    if (header.magic != magic || header.version != version || header.count != (data.size() - sizeof(Header)) / sizeof(MapManifestEntry))
+    {
+        Close();
+        return false;
+    }
+
+    entries_ = span<const MapManifestEntry>(reinterpret_cast<const MapManifestEntry*>(data.data() + sizeof(Header)), static_cast<size_t>(header.count));
+    settingsHash_ = header.settingsHash;
+    return true;
+}
+// Unmaps the manifest. Must be called before the manifest file is replaced.
+void MapManifest::Close()
+{
+    entries_ = {};
+    settingsHash_ = 0;
+    file_.Close();
+}
+// Sorts entries by ID and replaces the manifest file.
+const bool MapManifest::Save(const filesystem::path& path, vector<MapManifestEntry>* entries, const uint64_t& settingsHash)
+{
+    sort(entries->begin(), entries->end(), [](const MapManifestEntry& a, const MapManifestEntry& b) { return a.id < b.id; });
+
+    Header header = { magic, version, entries->size(), settingsHash };
+
+    vector<uint8_t> data(sizeof(Header) + entries->size() * sizeof(MapManifestEntry));
+    memcpy(data.data(), &header, sizeof(Header));
+    if (!entries->empty())
+        memcpy(data.data() + sizeof(Header), entries->data(), entries->size() * sizeof(MapManifestEntry));
+
+    return WorldWriter::WriteFileAtomic(path, data);
+}
+
+// Returns the entry for a map ID, or null if the map isn't in the manifest.
+const MapManifestEntry* MapManifest::Find(const int& id) const
+{
+    auto entry = lower_bound(entries_.begin(), entries_.end(), id, [](const MapManifestEntry& a, const int& id) { return a.id < id; });
+
+    if (entry == entries_.end() || entry->id != id)
+        return nullptr;
+
+    return &*entry;
+}
+// Returns all entries, sorted by ID.
+span<const MapManifestEntry> MapManifest::GetEntries() const
+{
+    return entries_;
+}
+// Returns the settings hash the manifest was saved with.
+const uint64_t MapManifest::GetSettingsHash() const
+{
+    return settingsHash_;
+}
@@ -0,0 +1,61 @@
+#ifndef MAP_MANIFEST_H_
+#define MAP_MANIFEST_H_
+
+#include "MappedFile.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <vector>
+
+namespace Cartographer
+{
+	// Map file as it was when last rendered. Stored in native byte order.
+	struct MapManifestEntry
+	{
+		int32_t id;
+		int32_t scale;
+		int32_t xCenter;
+		int32_t zCenter;
+		uint64_t size;
+		int64_t modified;
+		uint64_t colourHash;
+		uint64_t dimensionHash;
+	};
+
+	// Fixed size records of rendered maps, sorted by ID. The file is memory mapped, so entries are
+	// looked up without reading the whole manifest.
+	class MapManifest
+	{
+	public:
+		static constexpr uint32_t magic = 0x4E414D43;
+		static constexpr uint32_t version = 2;
+
+	private:
+		struct Header
+		{
+			uint32_t magic;
+			uint32_t version;
+			uint64_t count;
+			uint64_t settingsHash;
+		};
+
+		Vaux::MappedFile file_;
+		std::span<const MapManifestEntry> entries_;
+		uint64_t settingsHash_ = 0;
+
+	public:
+		// File functions. Missing or invalid manifests load as empty. The settings hash identifies the
+		// palette and options the maps were rendered with.
+		const bool Load(const std::filesystem::path& path);
+		void Close();
+		static const bool Save(const std::filesystem::path& path, std::vector<MapManifestEntry>* entries, const uint64_t& settingsHash);
+
+		// Entry functions.
+		const MapManifestEntry* Find(const int& id) const;
+		std::span<const MapManifestEntry> GetEntries() const;
+		const uint64_t GetSettingsHash() const;
+	};
+}
+
+#endif //MAP_MANIFEST_H_
@@ -0,0 +1,189 @@
+#include "MappedFile.h"
+
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace Vaux;
+using namespace std;
+
+namespace
+{
+	// Placeholder for empty files, which can't be mapped.
+	const std::byte emptyData[1] = {};
+}
+
+MappedFile::MappedFile() : data_(nullptr), size_(0)
+#ifdef _WIN32
+	, file_(nullptr), mapping_(nullptr)
+#endif
+{
+	// Default constructor.
+}
+MappedFile::MappedFile(const char* filename) : MappedFile()
+{
+	// Map file.
+	Open(filename);
+}
+MappedFile::MappedFile(MappedFile&& other) noexcept : MappedFile()
+{
+	*this = std::move(other);
+}
+MappedFile::~MappedFile()
+{
+	// Unmap file.
+	Close();
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+	if (this != &other)
+	{
+		// Release current mapping, take ownership of other.
+		Close();
+		swap(data_, other.data_);
+		swap(size_, other.size_);
+#ifdef _WIN32
+		swap(file_, other.file_);
+		swap(mapping_, other.mapping_);
+#endif
+	}
+
+	return *this;
+}
+
+// Maps an entire file into memory for reading.
+const bool MappedFile::Open(const char* filename)
+{
+	// Close existing mapping.
+	Close();
+
+#ifdef _WIN32
+	// Open file.
+	HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	// Get file size.
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size))
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	file_ = file;
+	size_ = static_cast<size_t>(size.QuadPart);
+
+	// Check for empty file.
+	if (size_ == 0)
+	{
+		data_ = emptyData;
+		return true;
+	}
+
+	// Create read only view of file.
+	mapping_ = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping_)
+	{
+		data_ = static_cast<const std::byte*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+	}
+#else
+	// Open file.
+	int file = open(filename, O_RDONLY);
+	if (file < 0)
+		return false;
+
+	// Get file size.
+	struct stat status;
+	if (fstat(file, &status) != 0)
+	{
+		close(file);
+		return false;
+	}
+
+	size_ = static_cast<size_t>(status.st_size);
+
+	// Check for empty file.
+	if (size_ == 0)
+	{
+		close(file);
+		data_ = emptyData;
+		return true;
+	}
+
+	// Create read only view of file, descriptor is no longer required once mapped.
+	void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, file, 0);
+	close(file);
+
+	if (data != MAP_FAILED)
+	{
+		madvise(data, size_, MADV_SEQUENTIAL);
+		data_ = static_cast<const std::byte*>(data);
+	}
+#endif
+
+	// Check if mapping was successful.
+	if (!data_)
+	{
+		Close();
+		return false;
+	}
+
+	// File mapped successfully.
+	return true;
+}
+// Unmaps file.
+void MappedFile::Close()
+{
+	if (data_ && data_ != emptyData)
+	{
+#ifdef _WIN32
+		UnmapViewOfFile(data_);
+#else
+		munmap(const_cast<std::byte*>(data_), size_);
+#endif
+	}
+
+#ifdef _WIN32
+	if (mapping_)
+	{
+		CloseHandle(mapping_);
+	}
+	if (file_)
+	{
+		CloseHandle(file_);
+	}
+
+	file_ = nullptr;
+	mapping_ = nullptr;
+#endif
+
+	data_ = nullptr;
+	size_ = 0;
+}
+// Returns true if a file is currently mapped.
+const bool MappedFile::IsOpen() const
+{
+	return data_ != nullptr;
+}
+
+// Returns mapped file contents.
+span<const std::byte> MappedFile::GetData() const
+{
+	return span<const std::byte>(data_, size_);
+}
+// Returns size of mapped file in bytes.
+const size_t& MappedFile::GetSize() const
+{
+	return size_;
+}
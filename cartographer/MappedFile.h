@@ -0,0 +1,42 @@
+#ifndef MAPPED_FILE_H_
+#define MAPPED_FILE_H_
+
+#include <cstddef>
+#include <span>
+
+namespace Vaux
+{
+	// Read only memory mapping of a file.
+	class MappedFile
+	{
+	private:
+		const std::byte* data_;
+		size_t size_;
+
+#ifdef _WIN32
+		void* file_;
+		void* mapping_;
+#endif
+
+	public:
+		MappedFile();
+		MappedFile(const char* filename);
+		MappedFile(MappedFile&& other) noexcept;
+		MappedFile(const MappedFile&) = delete;
+		~MappedFile();
+
+		MappedFile& operator=(MappedFile&& other) noexcept;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		// File functions.
+		const bool Open(const char* filename);
+		void Close();
+		const bool IsOpen() const;
+
+		// Data functions.
+		std::span<const std::byte> GetData() const;
+		const size_t& GetSize() const;
+	};
+}
+
+#endif //MAPPED_FILE_H_
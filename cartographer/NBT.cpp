@@ -0,0 +1,271 @@
+#include "NBT.h"
+
+using namespace Cartographer;
+using namespace std;
+
+NBTWriter::NBTWriter(vector<uint8_t>* output) : output_(output)
+{
+    // Default constructor.
+}
+
+// Begins a named compound tag. Must be matched with a call to EndCompound.
+void NBTWriter::BeginCompound(string_view name)
+{
+    WriteHeader(NBTTag::COMPOUND, name);
+}
+// Ends the current compound tag.
+void NBTWriter::EndCompound()
+{
+    output_->push_back(static_cast<uint8_t>(NBTTag::END));
+}
+
+// Writes a named byte tag.
+void NBTWriter::WriteByte(string_view name, const int8_t& value)
+{
+    WriteHeader(NBTTag::BYTE, name);
+    WritePayload(static_cast<uint8_t>(value), 1);
+}
+// Writes a named short tag.
+void NBTWriter::WriteShort(string_view name, const int16_t& value)
+{
+    WriteHeader(NBTTag::SHORT, name);
+    WritePayload(static_cast<uint16_t>(value), 2);
+}
+// Writes a named int tag.
+void NBTWriter::WriteInt(string_view name, const int32_t& value)
+{
+    WriteHeader(NBTTag::INT, name);
+    WritePayload(static_cast<uint32_t>(value), 4);
+}
+// Writes a named long tag.
+void NBTWriter::WriteLong(string_view name, const int64_t& value)
+{
+    WriteHeader(NBTTag::LONG, name);
+    WritePayload(static_cast<uint64_t>(value), 8);
+}
+// Writes a named string tag.
+void NBTWriter::WriteString(string_view name, string_view value)
+{
+    WriteHeader(NBTTag::STRING, name);
+    WritePayload(value.size(), 2);
+    output_->insert(output_->end(), value.begin(), value.end());
+}
+// Writes a named byte array tag.
+void NBTWriter::WriteByteArray(string_view name, span<const uint8_t> value)
+{
+    BeginByteArray(name, static_cast<int32_t>(value.size()));
+    WriteBytes(value);
+}
+// Writes a named byte array header. Exactly length bytes must follow through WriteBytes.
+void NBTWriter::BeginByteArray(string_view name, const int32_t& length)
+{
+    WriteHeader(NBTTag::BYTE_ARRAY, name);
+    WritePayload(static_cast<uint32_t>(length), 4);
+}
+// Appends raw bytes to the current byte array.
+void NBTWriter::WriteBytes(span<const uint8_t> value)
+{
+    output_->insert(output_->end(), value.begin(), value.end());
+}
+// Writes a named list tag with no elements.
+void NBTWriter::WriteEmptyList(string_view name, const NBTTag& type)
+{
+    WriteHeader(NBTTag::LIST, name);
+    output_->push_back(static_cast<uint8_t>(type));
+    WritePayload(0, 4);
+}
+
+// Writes tag type and name.
+void NBTWriter::WriteHeader(const NBTTag& type, string_view name)
+{
+    output_->push_back(static_cast<uint8_t>(type));
+    WritePayload(name.size(), 2);
+    output_->insert(output_->end(), name.begin(), name.end());
+}
+// Writes an integer in big endian byte order.
+void NBTWriter::WritePayload(const uint64_t& value, const int& bytes)
+{
+    for (int i = bytes - 1; i >= 0; i--)
+    {
+        output_->push_back(static_cast<uint8_t>(value >> (i * 8)));
+    }
+}
+
+NBTReader::NBTReader(span<const uint8_t> data) : data_(data), position_(0), depth_(0), valid_(true)
+{
+    // Default constructor.
+}
+
+// Reads the type and name of the next tag. End tags have no name.
+const bool NBTReader::ReadHeader(NBTTag* type, string_view* name)
+{
+    if (!SkipBytes(1))
+        return false;
+
+    *type = static_cast<NBTTag>(data_[position_ - 1]);
+    *name = string_view();
+
+    // Check tag type is known.
+    if (*type > NBTTag::LONG_ARRAY)
+    {
+        valid_ = false;
+        return false;
+    }
+
+    if (*type != NBTTag::END)
+    {
+        *name = ReadString();
+    }
+
+    return valid_;
+}
+// Skips the payload of a tag, including any nested tags.
+const bool NBTReader::Skip(const NBTTag& type)
+{
+    // Limit nesting of lists and compounds.
+    if ((type == NBTTag::LIST || type == NBTTag::COMPOUND) && depth_ >= maxDepth)
+    {
+        valid_ = false;
+        return false;
+    }
+
+    switch (type)
+    {
+    case NBTTag::END: return true;
+    case NBTTag::BYTE: return SkipBytes(1);
+    case NBTTag::SHORT: return SkipBytes(2);
+    case NBTTag::INT: case NBTTag::FLOAT: return SkipBytes(4);
+    case NBTTag::LONG: case NBTTag::DOUBLE: return SkipBytes(8);
+    case NBTTag::BYTE_ARRAY: return SkipBytes(ReadPayload(4));
+    case NBTTag::STRING: return SkipBytes(ReadPayload(2));
+    case NBTTag::INT_ARRAY: return SkipBytes(ReadPayload(4) * 4);
+    case NBTTag::LONG_ARRAY: return SkipBytes(ReadPayload(4) * 8);
+    case NBTTag::LIST:
+    {
+        NBTTag elementType = static_cast<NBTTag>(ReadPayload(1));
+        int32_t length = static_cast<int32_t>(ReadPayload(4));
+
+        depth_++;
+        for (int32_t i = 0; i < length && valid_ && elementType != NBTTag::END; i++)
+        {
+            Skip(elementType);
+        }
+        depth_--;
+
+        return valid_;
+    }
+    case NBTTag::COMPOUND:
+    {
+        NBTTag childType;
+        string_view childName;
+
+        // Skip child tags until end of compound.
+        depth_++;
+        while (ReadHeader(&childType, &childName) && childType != NBTTag::END)
+        {
+            Skip(childType);
+        }
+        depth_--;
+
+        return valid_;
+    }
+    default:
+    {
+        valid_ = false;
+        return false;
+    }
+    }
+}
+
+// Reads the payload of a byte, short, int or long tag.
+const int64_t NBTReader::ReadInteger(const NBTTag& type)
+{
+    switch (type)
+    {
+    case NBTTag::BYTE: return static_cast<int8_t>(ReadPayload(1));
+    case NBTTag::SHORT: return static_cast<int16_t>(ReadPayload(2));
+    case NBTTag::INT: return static_cast<int32_t>(ReadPayload(4));
+    case NBTTag::LONG: return static_cast<int64_t>(ReadPayload(8));
+    default:
+    {
+        Skip(type);
+        return 0;
+    }
+    }
+}
+// Reads the payload of a string tag. The view refers to the reader's data.
+const string_view NBTReader::ReadString()
+{
+    size_t length = static_cast<size_t>(ReadPayload(2));
+    if (!SkipBytes(length))
+        return string_view();
+
+    return string_view(reinterpret_cast<const char*>(data_.data() + position_ - length), length);
+}
+// Reads the payload of a byte array tag. The span refers to the reader's data.
+const span<const uint8_t> NBTReader::ReadByteArray()
+{
+    size_t length = static_cast<size_t>(ReadPayload(4));
+    if (!SkipBytes(length))
+        return span<const uint8_t>();
+
+    return data_.subspan(position_ - length, length);
+}
+// Reads the payload of a long array tag as raw big endian data, eight bytes per element.
+const span<const uint8_t> NBTReader::ReadLongArray()
+{
+    size_t length = static_cast<size_t>(ReadPayload(4)) * 8;
+    if (!SkipBytes(length))
+        return span<const uint8_t>();
+
+    return data_.subspan(position_ - length, length);
+}
+
+// Reads the element type and length of a list tag.
+const bool NBTReader::ReadListHeader(NBTTag* type, int32_t* length)
+{
+    *type = static_cast<NBTTag>(ReadPayload(1));
+    *length = static_cast<int32_t>(ReadPayload(4));
+
+    // Check element type is known.
+    if (*type > NBTTag::LONG_ARRAY || *length < 0)
+    {
+        valid_ = false;
+        *length = 0;
+    }
+
+    return valid_;
+}
+
+// Returns false if the data was truncated or malformed.
+const bool NBTReader::IsValid() const
+{
+    return valid_;
+}
+
+// Reads a big endian integer.
+const uint64_t NBTReader::ReadPayload(const int& bytes)
+{
+    if (!SkipBytes(bytes))
+        return 0;
+
+    uint64_t value = 0;
+    for (int i = bytes; i > 0; i--)
+    {
+        value = (value << 8) | data_[position_ - i];
+    }
+
+    return value;
+}
+// Advances past a number of bytes, checking they are available.
+const bool NBTReader::SkipBytes(const size_t& bytes)
+{
+    if (!valid_ || bytes > data_.size() - position_)
+    {
+        valid_ = false;
+        return false;
+    }
+
+    position_ += bytes;
+    return true;
+}
@@ -0,0 +1,98 @@
+#ifndef NBT_H_
+#define NBT_H_
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Cartographer
+{
+	// Named Binary Tag types, as used by Minecraft save files.
+	enum class NBTTag : uint8_t
+	{
+		END,
+		BYTE,
+		SHORT,
+		INT,
+		LONG,
+		FLOAT,
+		DOUBLE,
+		BYTE_ARRAY,
+		STRING,
+		LIST,
+		COMPOUND,
+		INT_ARRAY,
+		LONG_ARRAY
+	};
+
+	// Writes uncompressed big endian NBT data into a buffer.
+	class NBTWriter
+	{
+	private:
+		std::vector<uint8_t>* output_;
+
+	public:
+		NBTWriter(std::vector<uint8_t>* output);
+
+		// Compound functions.
+		void BeginCompound(std::string_view name);
+		void EndCompound();
+
+		// Tag functions.
+		void WriteByte(std::string_view name, const int8_t& value);
+		void WriteShort(std::string_view name, const int16_t& value);
+		void WriteInt(std::string_view name, const int32_t& value);
+		void WriteLong(std::string_view name, const int64_t& value);
+		void WriteString(std::string_view name, std::string_view value);
+		void WriteByteArray(std::string_view name, std::span<const uint8_t> value);
+		void WriteEmptyList(std::string_view name, const NBTTag& type);
+
+		// Byte array functions, for arrays written in several parts.
+		void BeginByteArray(std::string_view name, const int32_t& length);
+		void WriteBytes(std::span<const uint8_t> value);
+
+	private:
+		void WriteHeader(const NBTTag& type, std::string_view name);
+		void WritePayload(const uint64_t& value, const int& bytes);
+	};
+
+	// Reads uncompressed NBT data one tag at a time, without building a tree.
+	class NBTReader
+	{
+	public:
+		static constexpr int maxDepth = 512;
+
+	private:
+		std::span<const uint8_t> data_;
+		size_t position_;
+		int depth_;
+		bool valid_;
+
+	public:
+		NBTReader(std::span<const uint8_t> data);
+
+		// Tag functions. Each tag header must be followed by reading or skipping its payload.
+		const bool ReadHeader(NBTTag* type, std::string_view* name);
+		const bool Skip(const NBTTag& type);
+
+		// Payload functions.
+		const int64_t ReadInteger(const NBTTag& type);
+		const std::string_view ReadString();
+		const std::span<const uint8_t> ReadByteArray();
+		const std::span<const uint8_t> ReadLongArray();
+
+		// List functions. Each element must then be read or skipped in turn.
+		const bool ReadListHeader(NBTTag* type, int32_t* length);
+
+		// State functions.
+		const bool IsValid() const;
+
+	private:
+		const uint64_t ReadPayload(const int& bytes);
+		const bool SkipBytes(const size_t& bytes);
+	};
+}
+
+#endif //NBT_H_
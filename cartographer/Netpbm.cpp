@@ -0,0 +1,213 @@
+#include "Netpbm.h"
+#include "NetpbmWriter.h"
+
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <span>
+#include <string>
+#include <string_view>
+
+using namespace Vaux;
+using namespace std;
+
+namespace
+{
+	struct Header
+	{
+		int width = 0, height = 0;
+		int channels = 0;
+		size_t offset = 0;
+	};
+
+	inline const bool IsSpace(const unsigned char& c)
+	{
+		return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+	}
+
+	// Reads the next decimal value of a PGM or PPM header, skipping whitespace and comments.
+	const bool ReadValue(const unsigned char* data, const size_t& size, size_t* position, int* value)
+	{
+		while (*position < size && (IsSpace(data[*position]) || data[*position] == '#'))
+		{
+			// Comments run to the end of the line.
+			if (data[*position] == '#')
+			{
+				while (*position < size && data[*position] != '\n')
+				{
+					(*position)++;
+				}
+			}
+			else
+			{
+				(*position)++;
+			}
+		}
+
+		long long result = 0;
+		size_t start = *position;
+		while (*position < size && data[*position] >= '0' && data[*position] <= '9' && result <= INT_MAX)
+		{
+			result = result * 10 + (data[*position] - '0');
+			(*position)++;
+		}
+
+		*value = static_cast<int>(result);
+		return *position > start && result <= INT_MAX;
+	}
+
+	// Reads the header lines of a PAM image up to ENDHDR.
+	const bool ReadPamHeader(const unsigned char* data, const size_t& size, Header* header)
+	{
+		int maxValue = 0;
+		size_t position = 3;
+
+		while (position < size)
+		{
+			// Split next line into a token and its value.
+			size_t end = position;
+			while (end < size && data[end] != '\n')
+			{
+				end++;
+			}
+
+			string_view line(reinterpret_cast<const char*>(data + position), end - position);
+			position = end + 1;
+
+			size_t split = line.find(' ');
+			string_view token = line.substr(0, split);
+			int value = (split != string_view::npos) ? atoi(string(line.substr(split + 1)).c_str()) : 0;
+
+			if (token == "WIDTH")
+				header->width = value;
+			else if (token == "HEIGHT")
+				header->height = value;
+			else if (token == "DEPTH")
+				header->channels = value;
+			else if (token == "MAXVAL")
+				maxValue = value;
+			else if (token == "ENDHDR")
+			{
+				header->offset = position;
+				return maxValue == 255 && position <= size;
+			}
+		}
+
+		return false;
+	}
+
+	// Reads an image header. Only 8 bit samples are supported.
+	const bool ReadHeader(const unsigned char* data, const size_t& size, Header* header)
+	{
+		if (!Netpbm::IsNetpbm(data, size))
+			return false;
+
+		if (data[1] == '7')
+		{
+			if (!ReadPamHeader(data, size, header))
+				return false;
+		}
+		else
+		{
+			// Single whitespace character separates the maximum value from pixel data.
+			int maxValue = 0;
+			size_t position = 2;
+			if (!ReadValue(data, size, &position, &header->width) || !ReadValue(data, size, &position, &header->height) || !ReadValue(data, size, &position, &maxValue))
+				return false;
+
+			if (maxValue != 255 || position >= size || !IsSpace(data[position]))
+				return false;
+
+			header->channels = (data[1] == '5') ? 1 : 3;
+			header->offset = position + 1;
+		}
+
+		// Check pixel data is complete.
+		if (header->width <= 0 || header->height <= 0 || header->channels < 1 || header->channels > 4)
+			return false;
+
+		return static_cast<size_t>(header->width) * header->height * header->channels <= size - header->offset;
+	}
+}
+
+// Returns true if data starts with a binary PGM, PPM or PAM signature.
+const bool Netpbm::IsNetpbm(const unsigned char* data, const size_t& size)
+{
+	return size >= 3 && data[0] == 'P' && data[1] >= '5' && data[1] <= '7' && IsSpace(data[2]);
+}
+// Reads image dimensions and channels from the header.
+const bool Netpbm::ReadInfo(const unsigned char* data, const size_t& size, int* width, int* height, int* channels)
+{
+	Header header;
+	if (!ReadHeader(data, size, &header))
+		return false;
+
+	*width = header.width;
+	*height = header.height;
+	*channels = header.channels;
+
+	return true;
+}
+
+// Decodes an image to RGBA8. Grey images are expanded to RGB, missing alpha is opaque.
+const bool Netpbm::Decode(const unsigned char* data, const size_t& size, vector<unsigned char>* output, int* width, int* height, int* channels)
+{
+	Header header;
+	if (!ReadHeader(data, size, &header))
+		return false;
+
+	size_t count = static_cast<size_t>(header.width) * header.height;
+	output->resize(count * 4);
+
+	const unsigned char* input = data + header.offset;
+	unsigned char* pixel = output->data();
+
+	switch (header.channels)
+	{
+	case 4:
+		memcpy(pixel, input, count * 4);
+		break;
+	case 3:
+		for (size_t i = 0; i < count; i++, input += 3, pixel += 4)
+		{
+			pixel[0] = input[0];
+			pixel[1] = input[1];
+			pixel[2] = input[2];
+			pixel[3] = 255;
+		}
+		break;
+	default:
+		for (size_t i = 0; i < count; i++, input += header.channels, pixel += 4)
+		{
+			pixel[0] = input[0];
+			pixel[1] = input[0];
+			pixel[2] = input[0];
+			pixel[3] = (header.channels == 2) ? input[1] : 255;
+		}
+		break;
+	}
+
+	*width = header.width;
+	*height = header.height;
+	*channels = header.channels;
+
+	return true;
+}
+
+// Saves RGBA8 pixels as a PPM or PAM file, a row at a time.
+const bool Netpbm::Save(const char* filename, const unsigned char* data, const int& width, const int& height, const int& channels)
+{
+	NetpbmWriter writer;
+	if (!writer.Open(filename, width, height, channels))
+		return false;
+
+	size_t rowSize = static_cast<size_t>(width) * 4;
+	bool success = true;
+	for (int y = 0; y < height && success; y++)
+	{
+		success = writer.WriteRow(span<const uint8_t>(data + y * rowSize, rowSize));
+	}
+
+	return writer.Close() && success;
+}
@@ -0,0 +1,26 @@
+#ifndef NETPBM_H_
+#define NETPBM_H_
+
+#include <cstddef>
+#include <vector>
+
+namespace Vaux
+{
+	// Binary PGM (P5), PPM (P6) and PAM (P7) images with 8 bit samples. Pixel data is stored raw after a
+	// short text header, so images are read with single bulk copies and written a row at a time.
+	class Netpbm
+	{
+	public:
+		// Header functions.
+		static const bool IsNetpbm(const unsigned char* data, const size_t& size);
+		static const bool ReadInfo(const unsigned char* data, const size_t& size, int* width, int* height, int* channels);
+
+		// Decode function. Output is stored as RGBA8.
+		static const bool Decode(const unsigned char* data, const size_t& size, std::vector<unsigned char>* output, int* width, int* height, int* channels);
+
+		// Save function. Input is RGBA8, saved as a PPM without alpha for three channels or a PAM for four.
+		static const bool Save(const char* filename, const unsigned char* data, const int& width, const int& height, const int& channels);
+	};
+}
+
+#endif //NETPBM_H_
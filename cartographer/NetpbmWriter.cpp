@@ -0,0 +1,75 @@
+#include "NetpbmWriter.h"
+
+#include <string>
+
+using namespace Vaux;
+using namespace std;
+
+NetpbmWriter::NetpbmWriter() : width_(0), height_(0), channels_(0), row_(0)
+{
+	// Default constructor.
+}
+NetpbmWriter::~NetpbmWriter()
+{
+	// Default destructor.
+}
+
+// Creates the file and writes the text header, as a PPM for three channels or a PAM for four.
+const bool NetpbmWriter::Open(const char* filename, const int& width, const int& height, const int& channels)
+{
+	if (width <= 0 || height <= 0 || (channels != 3 && channels != 4))
+		return false;
+
+	file_.open(filename, ios::out | ios::binary | ios::trunc);
+	if (!file_.is_open())
+		return false;
+
+	width_ = width;
+	height_ = height;
+	channels_ = channels;
+	row_ = 0;
+
+	string header = (channels == 4) ?
+		"P7\nWIDTH " + to_string(width) + "\nHEIGHT " + to_string(height) + "\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n" :
+		"P6\n" + to_string(width) + " " + to_string(height) + "\n255\n";
+
+	file_.write(header.data(), static_cast<streamsize>(header.size()));
+	return file_.good();
+}
+// Writes the next row of pixels, dropping alpha for PPM files.
+const bool NetpbmWriter::WriteRow(span<const uint8_t> row)
+{
+	if (!file_.is_open() || row_ >= height_ || row.size() != static_cast<size_t>(width_) * 4)
+		return false;
+
+	row_++;
+
+	if (channels_ == 4)
+	{
+		file_.write(reinterpret_cast<const char*>(row.data()), static_cast<streamsize>(row.size()));
+		return file_.good();
+	}
+
+	buffer_.resize(static_cast<size_t>(width_) * 3);
+	uint8_t* output = buffer_.data();
+	for (size_t i = 0; i < row.size(); i += 4, output += 3)
+	{
+		output[0] = row[i];
+		output[1] = row[i + 1];
+		output[2] = row[i + 2];
+	}
+
+	file_.write(reinterpret_cast<const char*>(buffer_.data()), static_cast<streamsize>(buffer_.size()));
+	return file_.good();
+}
+// Closes the file. Fails if fewer rows than the height were written.
+const bool NetpbmWriter::Close()
+{
+	if (!file_.is_open())
+		return false;
+
+	bool complete = row_ == height_;
+	file_.close();
+
+	return complete && !file_.fail();
+}
@@ -0,0 +1,36 @@
+#ifndef NETPBM_WRITER_H_
+#define NETPBM_WRITER_H_
+
+#include <cstdint>
+#include <fstream>
+#include <span>
+#include <vector>
+
+namespace Vaux
+{
+	// Writes a binary PPM (P6) or PAM (P7) file one row at a time. Rows are RGBA8, alpha is dropped
+	// for three channel PPM files, so only a row is held in memory regardless of image size.
+	class NetpbmWriter
+	{
+	private:
+		std::ofstream file_;
+		int width_, height_, channels_;
+		int row_;
+
+		std::vector<uint8_t> buffer_;
+
+	public:
+		NetpbmWriter();
+		NetpbmWriter(const NetpbmWriter&) = delete;
+		~NetpbmWriter();
+
+		NetpbmWriter& operator=(const NetpbmWriter&) = delete;
+
+		// File functions. Exactly height rows of width * 4 bytes must be written before the file is closed.
+		const bool Open(const char* filename, const int& width, const int& height, const int& channels);
+		const bool WriteRow(std::span<const uint8_t> row);
+		const bool Close();
+	};
+}
+
+#endif //NETPBM_WRITER_H_
@@ -0,0 +1,339 @@
+#include "PngWriter.h"
+#include "Compression.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+using namespace Vaux;
+using namespace std;
+
+namespace
+{
+	enum Filter : uint8_t
+	{
+		FILTER_NONE,
+		FILTER_SUB,
+		FILTER_UP,
+		FILTER_AVERAGE,
+		FILTER_PAETH
+	};
+
+	void WriteBigEndian(uint8_t* data, const uint32_t& value)
+	{
+		data[0] = static_cast<uint8_t>(value >> 24);
+		data[1] = static_cast<uint8_t>(value >> 16);
+		data[2] = static_cast<uint8_t>(value >> 8);
+		data[3] = static_cast<uint8_t>(value);
+	}
+
+	// Predicts a byte from its left, upper and upper left neighbours.
+	inline const uint8_t Paeth(const int& a, const int& b, const int& c)
+	{
+		int p = a + b - c;
+		int pa = abs(p - a);
+		int pb = abs(p - b);
+		int pc = abs(p - c);
+
+		if (pa <= pb && pa <= pc)
+			return static_cast<uint8_t>(a);
+
+		return static_cast<uint8_t>(pb <= pc ? b : c);
+	}
+}
+
+PngWriter::PngWriter(const Mode& mode, ThreadPool* pool) : mode_(pool != nullptr || mode != Mode::PARALLEL ? mode : Mode::BALANCED), pool_(pool), stream_(nullptr), width_(0), height_(0), channels_(0), row_(0), indexed_(false),
+	deflate_(&compressed_, mode == Mode::FAST ? Deflate::Strategy::RLE : Deflate::Strategy::DEFAULT), adler_(1)
+{
+	// Default constructor.
+}
+PngWriter::~PngWriter()
+{
+	// Default destructor.
+}
+
+// Creates an RGB or RGBA file and writes the image header.
+const bool PngWriter::Open(const char* filename, const int& width, const int& height, const int& channels)
+{
+	file_.open(filename, ios::out | ios::binary | ios::trunc);
+	return file_.is_open() && Open(file_, width, height, channels);
+}
+// Writes an RGB or RGBA image to a stream, such as standard output.
+const bool PngWriter::Open(ostream& stream, const int& width, const int& height, const int& channels)
+{
+	if (channels != 3 && channels != 4)
+		return false;
+
+	return Start(stream, width, height, channels, (channels == 4) ? 6 : 2);
+}
+// Creates an indexed file, with a palette of RGBA8 colours. Rows hold one palette index per pixel.
+const bool PngWriter::OpenIndexed(const char* filename, const int& width, const int& height, span<const uint8_t> palette)
+{
+	file_.open(filename, ios::out | ios::binary | ios::trunc);
+	return file_.is_open() && OpenIndexed(file_, width, height, palette);
+}
+// Writes an indexed image to a stream.
+const bool PngWriter::OpenIndexed(ostream& stream, const int& width, const int& height, span<const uint8_t> palette)
+{
+	size_t count = palette.size() / 4;
+	if (count == 0 || count > maxPaletteSize || palette.size() % 4 != 0)
+		return false;
+
+	if (!Start(stream, width, height, 1, 3))
+		return false;
+
+	indexed_ = true;
+
+	// Write colours, then alpha up to the last transparent entry. Later entries are opaque.
+	vector<uint8_t> colours(count * 3);
+	size_t alphaCount = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		memcpy(colours.data() + i * 3, palette.data() + i * 4, 3);
+		if (palette[i * 4 + 3] != 255)
+			alphaCount = i + 1;
+	}
+
+	WriteChunk("PLTE", colours);
+
+	if (alphaCount > 0)
+	{
+		vector<uint8_t> alpha(alphaCount);
+		for (size_t i = 0; i < alphaCount; i++)
+		{
+			alpha[i] = palette[i * 4 + 3];
+		}
+
+		WriteChunk("tRNS", alpha);
+	}
+
+	return stream_->good();
+}
+// Filters and compresses the next row of pixels. Rows hold width * channels bytes.
+const bool PngWriter::WriteRow(span<const uint8_t> row)
+{
+	if (stream_ == nullptr || row_ >= height_ || row.size() != previous_.size())
+		return false;
+
+	// Queue rows until there are enough blocks to keep every thread busy.
+	if (mode_ == Mode::PARALLEL)
+	{
+		pending_.insert(pending_.end(), row.begin(), row.end());
+		row_++;
+
+		if (pending_.size() >= blockSize * 2 * pool_->GetThreadCount())
+			CompressPending();
+
+		return stream_->good();
+	}
+
+	FilterRow(row, previous_.data(), row_ == 0, &filtered_, &candidate_);
+	deflate_.Write(filtered_);
+	adler_ = Compression::Adler32(filtered_, adler_);
+
+	memcpy(previous_.data(), row.data(), row.size());
+	row_++;
+
+	// Write out compressed data in large chunks.
+	if (compressed_.size() >= chunkSize)
+	{
+		WriteChunk("IDAT", compressed_);
+		compressed_.clear();
+	}
+
+	return stream_->good();
+}
+// Completes the compressed stream and closes the file. Streams are flushed but left open.
+const bool PngWriter::Close()
+{
+	if (stream_ == nullptr)
+		return false;
+
+	bool complete = row_ == height_;
+
+	if (!pending_.empty())
+		CompressPending();
+
+	// End zlib stream.
+	deflate_.Finish();
+	uint8_t trailer[4];
+	WriteBigEndian(trailer, adler_);
+	compressed_.insert(compressed_.end(), trailer, trailer + 4);
+
+	WriteChunk("IDAT", compressed_);
+	compressed_.clear();
+	WriteChunk("IEND", {});
+
+	if (file_.is_open())
+		file_.close();
+	else
+		stream_->flush();
+
+	bool success = complete && !stream_->fail();
+	stream_ = nullptr;
+
+	return success;
+}
+
+// Writes the image header, 8 bits per channel with no interlacing.
+const bool PngWriter::Start(ostream& stream, const int& width, const int& height, const int& channels, const uint8_t& colourType)
+{
+	if (width <= 0 || height <= 0)
+		return false;
+
+	stream_ = &stream;
+	width_ = width;
+	height_ = height;
+	channels_ = channels;
+	row_ = 0;
+	indexed_ = false;
+	pending_.clear();
+
+	size_t stride = static_cast<size_t>(width_) * channels_;
+	previous_.assign(stride, 0);
+	filtered_.resize(stride + 1);
+	candidate_.resize(stride + 1);
+
+	// Write signature.
+	const uint8_t signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	stream_->write(reinterpret_cast<const char*>(signature), sizeof(signature));
+
+	// Write header.
+	uint8_t header[13] = {};
+	WriteBigEndian(header, static_cast<uint32_t>(width_));
+	WriteBigEndian(header + 4, static_cast<uint32_t>(height_));
+	header[8] = 8;
+	header[9] = colourType;
+	WriteChunk("IHDR", header);
+
+	// Start zlib stream, 32K window with no preset dictionary.
+	compressed_ = { 0x78, 0x01 };
+	adler_ = 1;
+
+	return stream_->good();
+}
+// Selects the filter giving the smallest sum of absolute differences, a standard estimate of
+// which filter will compress best. Fast mode only compares the sub and up filters.
+void PngWriter::FilterRow(span<const uint8_t> row, const uint8_t* up, const bool& first, vector<uint8_t>* filtered, vector<uint8_t>* candidate) const
+{
+	size_t size = row.size();
+	long long bestScore = -1;
+
+	// Rows repeating the one above, as in enlarged images, filter to zeros with the up filter.
+	if (!first && memcmp(row.data(), up, size) == 0)
+	{
+		(*filtered)[0] = FILTER_UP;
+		memset(filtered->data() + 1, 0, size);
+		return;
+	}
+
+	// Neighbouring palette indices aren't related like colour values, so indexed rows aren't predicted.
+	if (indexed_)
+	{
+		(*filtered)[0] = FILTER_NONE;
+		memcpy(filtered->data() + 1, row.data(), size);
+		return;
+	}
+
+	uint8_t firstFilter = (mode_ == Mode::FAST) ? FILTER_SUB : FILTER_NONE;
+	uint8_t lastFilter = (mode_ == Mode::FAST) ? FILTER_UP : FILTER_PAETH;
+
+	for (uint8_t filter = firstFilter; filter <= lastFilter; filter++)
+	{
+		(*candidate)[0] = filter;
+		uint8_t* output = candidate->data() + 1;
+
+		for (size_t i = 0; i < size; i++)
+		{
+			int left = (i >= static_cast<size_t>(channels_)) ? row[i - channels_] : 0;
+			int upperLeft = (i >= static_cast<size_t>(channels_)) ? up[i - channels_] : 0;
+
+			switch (filter)
+			{
+			case FILTER_NONE: output[i] = row[i]; break;
+			case FILTER_SUB: output[i] = static_cast<uint8_t>(row[i] - left); break;
+			case FILTER_UP: output[i] = static_cast<uint8_t>(row[i] - up[i]); break;
+			case FILTER_AVERAGE: output[i] = static_cast<uint8_t>(row[i] - ((left + up[i]) >> 1)); break;
+			default: output[i] = static_cast<uint8_t>(row[i] - Paeth(left, up[i], upperLeft)); break;
+			}
+		}
+
+		// Score bytes as signed values, small differences score low.
+		long long score = 0;
+		for (size_t i = 0; i < size; i++)
+		{
+			score += abs(static_cast<int8_t>(output[i]));
+		}
+
+		if (bestScore < 0 || score < bestScore)
+		{
+			bestScore = score;
+			swap(*filtered, *candidate);
+		}
+	}
+}
+// Filters and compresses queued rows in blocks on the thread pool. Each block is compressed
+// separately and ends with a sync flush, so the blocks join into a single stream.
+void PngWriter::CompressPending()
+{
+	size_t stride = previous_.size();
+	size_t rows = pending_.size() / stride;
+	size_t blockRows = max<size_t>(1, blockSize / stride);
+	size_t blockCount = (rows + blockRows - 1) / blockRows;
+	int firstRow = row_ - static_cast<int>(rows);
+
+	vector<vector<uint8_t>> blocks(blockCount);
+	vector<uint32_t> checksums(blockCount);
+
+	pool_->ParallelFor(blockCount, [&](size_t block)
+	{
+		vector<uint8_t> filtered(stride + 1), candidate(stride + 1);
+		Deflate deflate(&blocks[block]);
+		uint32_t adler = 1;
+
+		for (size_t y = block * blockRows; y < min(rows, (block + 1) * blockRows); y++)
+		{
+			const uint8_t* up = (y == 0) ? previous_.data() : &pending_[(y - 1) * stride];
+			FilterRow(span<const uint8_t>(&pending_[y * stride], stride), up, firstRow == 0 && y == 0, &filtered, &candidate);
+			deflate.Write(filtered);
+			adler = Compression::Adler32(filtered, adler);
+		}
+
+		deflate.Flush();
+		checksums[block] = adler;
+	});
+
+	// Join blocks in order, writing out compressed data in large chunks.
+	for (size_t block = 0; block < blockCount; block++)
+	{
+		size_t blockLength = (min(rows, (block + 1) * blockRows) - block * blockRows) * (stride + 1);
+		adler_ = Compression::CombineAdler32(adler_, checksums[block], blockLength);
+		compressed_.insert(compressed_.end(), blocks[block].begin(), blocks[block].end());
+
+		if (compressed_.size() >= chunkSize)
+		{
+			WriteChunk("IDAT", compressed_);
+			compressed_.clear();
+		}
+	}
+
+	// Keep the last row for filtering the next.
+	memcpy(previous_.data(), &pending_[(rows - 1) * stride], stride);
+	pending_.clear();
+}
+// Writes a chunk with its length and checksum.
+void PngWriter::WriteChunk(const char* type, span<const uint8_t> data)
+{
+	uint8_t length[4];
+	WriteBigEndian(length, static_cast<uint32_t>(data.size()));
+
+	uint32_t crc = Compression::CRC32(span<const uint8_t>(reinterpret_cast<const uint8_t*>(type), 4));
+	crc = Compression::CRC32(data, crc);
+	uint8_t checksum[4];
+	WriteBigEndian(checksum, crc);
+
+	stream_->write(reinterpret_cast<const char*>(length), 4);
+	stream_->write(type, 4);
+	stream_->write(reinterpret_cast<const char*>(data.data()), data.size());
+	stream_->write(reinterpret_cast<const char*>(checksum), 4);
+}
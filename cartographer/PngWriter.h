@@ -0,0 +1,84 @@
+#ifndef PNG_WRITER_H_
+#define PNG_WRITER_H_
+
+#include "Deflate.h"
+#include "ThreadPool.h"
+
+#include <cstdint>
+#include <fstream>
+#include <ostream>
+#include <span>
+#include <vector>
+
+namespace Vaux
+{
+	// Writes an 8 bit RGB, RGBA or indexed PNG file or stream one row at a time, so the full image is never held in memory.
+	class PngWriter
+	{
+	public:
+		// Speed and size trade off. Fast picks between two filters per row and only encodes runs,
+		// balanced tries every filter and searches for matches. Parallel gives the same filtering as
+		// balanced, compressing blocks of rows on separate threads joined by sync flushes. Parallel
+		// needs a thread pool and can't be used from one of its tasks, without one it runs as balanced.
+		enum class Mode
+		{
+			FAST,
+			BALANCED,
+			PARALLEL
+		};
+
+		// Compressed data is written out in IDAT chunks of at least this size.
+		static constexpr size_t chunkSize = 1 << 16;
+
+		// Largest palette of an indexed image.
+		static constexpr int maxPaletteSize = 256;
+
+		// Image bytes compressed by each task in parallel mode. Blocks don't share match history,
+		// so smaller blocks compress slightly worse.
+		static constexpr size_t blockSize = 1 << 18;
+
+	private:
+		Mode mode_;
+		ThreadPool* pool_;
+
+		std::ofstream file_;
+		std::ostream* stream_;
+		int width_, height_, channels_;
+		int row_;
+		bool indexed_;
+
+		std::vector<uint8_t> compressed_;
+		Deflate deflate_;
+		uint32_t adler_;
+
+		std::vector<uint8_t> previous_;
+		std::vector<uint8_t> filtered_;
+		std::vector<uint8_t> candidate_;
+
+		// Rows waiting to be compressed in parallel.
+		std::vector<uint8_t> pending_;
+
+	public:
+		PngWriter(const Mode& mode = Mode::BALANCED, ThreadPool* pool = nullptr);
+		PngWriter(const PngWriter&) = delete;
+		~PngWriter();
+
+		PngWriter& operator=(const PngWriter&) = delete;
+
+		// File functions. Exactly height rows must be written before the file is closed.
+		const bool Open(const char* filename, const int& width, const int& height, const int& channels = 4);
+		const bool Open(std::ostream& stream, const int& width, const int& height, const int& channels = 4);
+		const bool OpenIndexed(const char* filename, const int& width, const int& height, std::span<const uint8_t> palette);
+		const bool OpenIndexed(std::ostream& stream, const int& width, const int& height, std::span<const uint8_t> palette);
+		const bool WriteRow(std::span<const uint8_t> row);
+		const bool Close();
+
+	private:
+		const bool Start(std::ostream& stream, const int& width, const int& height, const int& channels, const uint8_t& colourType);
+		void FilterRow(std::span<const uint8_t> row, const uint8_t* up, const bool& first, std::vector<uint8_t>* filtered, std::vector<uint8_t>* candidate) const;
+		void CompressPending();
+		void WriteChunk(const char* type, std::span<const uint8_t> data);
+	};
+}
+
+#endif //PNG_WRITER_H_
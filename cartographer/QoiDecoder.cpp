@@ -0,0 +1,142 @@
+#include "QoiDecoder.h"
+
+#include <cstdint>
+#include <cstring>
+
+using namespace Vaux;
+using namespace std;
+
+namespace
+{
+	enum Op : uint8_t
+	{
+		OP_INDEX = 0x00,
+		OP_DIFF = 0x40,
+		OP_LUMA = 0x80,
+		OP_RUN = 0xC0,
+		OP_RGB = 0xFE,
+		OP_RGBA = 0xFF
+	};
+
+	const size_t headerSize = 14;
+	const size_t endSize = 8;
+
+	// Largest image accepted, as stated by the format.
+	const unsigned long long maxPixels = 400000000;
+
+	const uint32_t ReadBigEndian(const unsigned char* data)
+	{
+		return (static_cast<uint32_t>(data[0]) << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+	}
+
+	// Position of a colour in the table of recently seen colours.
+	inline const int Hash(const uint8_t* pixel)
+	{
+		return (pixel[0] * 3 + pixel[1] * 5 + pixel[2] * 7 + pixel[3] * 11) & 63;
+	}
+}
+
+// Returns true if data starts with the QOI signature.
+const bool QoiDecoder::IsQoi(const unsigned char* data, const size_t& size)
+{
+	return size >= headerSize && memcmp(data, "qoif", 4) == 0;
+}
+// Reads image dimensions and channels from the header.
+const bool QoiDecoder::ReadInfo(const unsigned char* data, const size_t& size, int* width, int* height, int* channels)
+{
+	if (!IsQoi(data, size))
+		return false;
+
+	uint32_t w = ReadBigEndian(data + 4);
+	uint32_t h = ReadBigEndian(data + 8);
+	if (w == 0 || h == 0 || static_cast<unsigned long long>(w) * h > maxPixels || (data[12] != 3 && data[12] != 4))
+		return false;
+
+	*width = static_cast<int>(w);
+	*height = static_cast<int>(h);
+	*channels = data[12];
+
+	return true;
+}
+
+// Decodes an image to RGBA8. Images ending early are rejected.
+const bool QoiDecoder::Decode(const unsigned char* data, const size_t& size, vector<unsigned char>* output, int* width, int* height, int* channels)
+{
+	int w, h, c;
+	if (!ReadInfo(data, size, &w, &h, &c))
+		return false;
+
+	size_t count = static_cast<size_t>(w) * h;
+	output->resize(count * 4);
+
+	uint8_t index[64][4] = {};
+	uint8_t pixel[4] = { 0, 0, 0, 255 };
+	int run = 0;
+
+	const unsigned char* input = data + headerSize;
+	const unsigned char* end = data + size - endSize;
+	uint8_t* out = output->data();
+
+	for (size_t i = 0; i < count; i++, out += 4)
+	{
+		if (run > 0)
+		{
+			run--;
+		}
+		else
+		{
+			// Ops are at most five bytes, so can't read past the end marker.
+			if (input >= end)
+				return false;
+
+			uint8_t op = *input++;
+
+			if (op == OP_RGB)
+			{
+				memcpy(pixel, input, 3);
+				input += 3;
+			}
+			else if (op == OP_RGBA)
+			{
+				memcpy(pixel, input, 4);
+				input += 4;
+			}
+			else
+			{
+				switch (op & 0xC0)
+				{
+				case OP_INDEX:
+					memcpy(pixel, index[op], 4);
+					break;
+				case OP_DIFF:
+					pixel[0] += ((op >> 4) & 3) - 2;
+					pixel[1] += ((op >> 2) & 3) - 2;
+					pixel[2] += (op & 3) - 2;
+					break;
+				case OP_LUMA:
+				{
+					int green = (op & 63) - 32;
+					uint8_t next = *input++;
+					pixel[0] += green + ((next >> 4) & 15) - 8;
+					pixel[1] += green;
+					pixel[2] += green + (next & 15) - 8;
+					break;
+				}
+				default:
+					run = op & 63;
+					break;
+				}
+			}
+
+			memcpy(index[Hash(pixel)], pixel, 4);
+		}
+
+		memcpy(out, pixel, 4);
+	}
+
+	*width = w;
+	*height = h;
+	*channels = c;
+
+	return true;
+}
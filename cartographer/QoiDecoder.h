@@ -0,0 +1,22 @@
+#ifndef QOI_DECODER_H_
+#define QOI_DECODER_H_
+
+#include <cstddef>
+#include <vector>
+
+namespace Vaux
+{
+	// QOI (Quite OK Image) decoder.
+	class QoiDecoder
+	{
+	public:
+		// Header functions.
+		static const bool IsQoi(const unsigned char* data, const size_t& size);
+		static const bool ReadInfo(const unsigned char* data, const size_t& size, int* width, int* height, int* channels);
+
+		// Decode function. Output is stored as RGBA8.
+		static const bool Decode(const unsigned char* data, const size_t& size, std::vector<unsigned char>* output, int* width, int* height, int* channels);
+	};
+}
+
+#endif //QOI_DECODER_H_
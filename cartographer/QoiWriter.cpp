@@ -0,0 +1,188 @@
+#include "QoiWriter.h"
+
+#include <cstring>
+
+using namespace Vaux;
+using namespace std;
+
+namespace
+{
+	enum Op : uint8_t
+	{
+		OP_INDEX = 0x00,
+		OP_DIFF = 0x40,
+		OP_LUMA = 0x80,
+		OP_RUN = 0xC0,
+		OP_RGB = 0xFE,
+		OP_RGBA = 0xFF
+	};
+
+	// Longest run stored by a single op.
+	const int maxRun = 62;
+
+	void WriteBigEndian(uint8_t* data, const uint32_t& value)
+	{
+		data[0] = static_cast<uint8_t>(value >> 24);
+		data[1] = static_cast<uint8_t>(value >> 16);
+		data[2] = static_cast<uint8_t>(value >> 8);
+		data[3] = static_cast<uint8_t>(value);
+	}
+
+	// Position of a colour in the table of recently seen colours.
+	inline const int Hash(const uint8_t* pixel)
+	{
+		return (pixel[0] * 3 + pixel[1] * 5 + pixel[2] * 7 + pixel[3] * 11) & 63;
+	}
+}
+
+QoiWriter::QoiWriter() : width_(0), height_(0), channels_(0), row_(0), index_(), previous_(), run_(0)
+{
+	// Default constructor.
+}
+QoiWriter::~QoiWriter()
+{
+	// Default destructor.
+}
+
+// Creates the file and writes the image header. Rows hold width * channels bytes, with three or four channels.
+const bool QoiWriter::Open(const char* filename, const int& width, const int& height, const int& channels)
+{
+	if (width <= 0 || height <= 0 || (channels != 3 && channels != 4))
+		return false;
+
+	file_.open(filename, ios::out | ios::binary | ios::trunc);
+	if (!file_.is_open())
+		return false;
+
+	width_ = width;
+	height_ = height;
+	channels_ = channels;
+	row_ = 0;
+
+	// Encoding starts from opaque black, with an empty colour table.
+	memset(index_, 0, sizeof(index_));
+	memcpy(previous_, "\0\0\0\xFF", 4);
+	run_ = 0;
+
+	// Write header, sRGB colours.
+	buffer_.assign(14, 0);
+	memcpy(buffer_.data(), "qoif", 4);
+	WriteBigEndian(buffer_.data() + 4, static_cast<uint32_t>(width_));
+	WriteBigEndian(buffer_.data() + 8, static_cast<uint32_t>(height_));
+	buffer_[12] = static_cast<uint8_t>(channels_);
+
+	return file_.good();
+}
+// Encodes the next row of pixels. Runs and the colour table continue from the previous row.
+const bool QoiWriter::WriteRow(span<const uint8_t> row)
+{
+	if (!file_.is_open() || row_ >= height_ || row.size() != static_cast<size_t>(width_) * channels_)
+		return false;
+
+	// Reserve space for the largest encoding of the row, plus ending a run from the row above.
+	size_t start = buffer_.size();
+	buffer_.resize(start + static_cast<size_t>(width_) * (channels_ + 1) + 1);
+	uint8_t* output = buffer_.data() + start;
+
+	uint8_t pixel[4] = { 0, 0, 0, 255 };
+	for (size_t i = 0; i < row.size(); i += channels_)
+	{
+		memcpy(pixel, &row[i], channels_);
+
+		// Extend a run of the previous colour.
+		if (memcmp(pixel, previous_, 4) == 0)
+		{
+			if (++run_ == maxRun)
+			{
+				*output++ = static_cast<uint8_t>(OP_RUN | (run_ - 1));
+				run_ = 0;
+			}
+
+			continue;
+		}
+
+		if (run_ > 0)
+		{
+			*output++ = static_cast<uint8_t>(OP_RUN | (run_ - 1));
+			run_ = 0;
+		}
+
+		// Reference a recently seen colour.
+		int hash = Hash(pixel);
+		if (memcmp(index_[hash], pixel, 4) == 0)
+		{
+			*output++ = static_cast<uint8_t>(OP_INDEX | hash);
+			memcpy(previous_, pixel, 4);
+			continue;
+		}
+
+		memcpy(index_[hash], pixel, 4);
+
+		if (pixel[3] == previous_[3])
+		{
+			// Store small differences from the previous colour, wrapping around.
+			int8_t red = static_cast<int8_t>(pixel[0] - previous_[0]);
+			int8_t green = static_cast<int8_t>(pixel[1] - previous_[1]);
+			int8_t blue = static_cast<int8_t>(pixel[2] - previous_[2]);
+			int8_t redGreen = static_cast<int8_t>(red - green);
+			int8_t blueGreen = static_cast<int8_t>(blue - green);
+
+			if (red >= -2 && red <= 1 && green >= -2 && green <= 1 && blue >= -2 && blue <= 1)
+			{
+				*output++ = static_cast<uint8_t>(OP_DIFF | ((red + 2) << 4) | ((green + 2) << 2) | (blue + 2));
+			}
+			else if (green >= -32 && green <= 31 && redGreen >= -8 && redGreen <= 7 && blueGreen >= -8 && blueGreen <= 7)
+			{
+				*output++ = static_cast<uint8_t>(OP_LUMA | (green + 32));
+				*output++ = static_cast<uint8_t>(((redGreen + 8) << 4) | (blueGreen + 8));
+			}
+			else
+			{
+				*output++ = OP_RGB;
+				memcpy(output, pixel, 3);
+				output += 3;
+			}
+		}
+		else
+		{
+			*output++ = OP_RGBA;
+			memcpy(output, pixel, 4);
+			output += 4;
+		}
+
+		memcpy(previous_, pixel, 4);
+	}
+
+	buffer_.resize(output - buffer_.data());
+	row_++;
+
+	// Write out encoded data in large blocks.
+	if (buffer_.size() >= bufferSize)
+	{
+		file_.write(reinterpret_cast<const char*>(buffer_.data()), buffer_.size());
+		buffer_.clear();
+	}
+
+	return file_.good();
+}
+// Ends any open run, writes the end marker and closes the file.
+const bool QoiWriter::Close()
+{
+	if (!file_.is_open())
+		return false;
+
+	bool complete = row_ == height_;
+
+	// End open run, then write end marker.
+	if (run_ > 0)
+		buffer_.push_back(static_cast<uint8_t>(OP_RUN | (run_ - 1)));
+
+	const uint8_t end[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+	buffer_.insert(buffer_.end(), end, end + 8);
+	file_.write(reinterpret_cast<const char*>(buffer_.data()), buffer_.size());
+	buffer_.clear();
+
+	file_.close();
+
+	return complete && !file_.fail();
+}
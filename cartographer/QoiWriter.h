@@ -0,0 +1,45 @@
+#ifndef QOI_WRITER_H_
+#define QOI_WRITER_H_
+
+#include <cstdint>
+#include <fstream>
+#include <span>
+#include <vector>
+
+namespace Vaux
+{
+	// Writes an RGB or RGBA QOI (Quite OK Image) file one row at a time. QOI is lossless and encodes
+	// many times faster than PNG, at a somewhat larger size.
+	class QoiWriter
+	{
+	public:
+		// Encoded data is written out in blocks of at least this size.
+		static constexpr size_t bufferSize = 1 << 16;
+
+	private:
+		std::ofstream file_;
+		int width_, height_, channels_;
+		int row_;
+
+		std::vector<uint8_t> buffer_;
+
+		// Encoder state, carried across rows.
+		uint8_t index_[64][4];
+		uint8_t previous_[4];
+		int run_;
+
+	public:
+		QoiWriter();
+		QoiWriter(const QoiWriter&) = delete;
+		~QoiWriter();
+
+		QoiWriter& operator=(const QoiWriter&) = delete;
+
+		// File functions. Exactly height rows must be written before the file is closed.
+		const bool Open(const char* filename, const int& width, const int& height, const int& channels = 4);
+		const bool WriteRow(std::span<const uint8_t> row);
+		const bool Close();
+	};
+}
+
+#endif //QOI_WRITER_H_
@@ -0,0 +1,119 @@
+#include "RegionFile.h"
+#include "Compression.h"
+
+#include <algorithm>
+#include <string>
+
+using namespace Cartographer;
+using namespace Vaux;
+using namespace std;
+
+namespace
+{
+    // Chunk compression types.
+    constexpr uint8_t compressionGzip = 1;
+    constexpr uint8_t compressionZlib = 2;
+    constexpr uint8_t compressionNone = 3;
+
+    // Set when the chunk is stored in a separate c.<x>.<z>.mcc file.
+    constexpr uint8_t compressionExternal = 128;
+
+    // Reads a big endian integer.
+    const uint32_t ReadBigEndian(const byte* data, const int& bytes)
+    {
+        uint32_t value = 0;
+        for (int i = 0; i < bytes; i++)
+        {
+            value = (value << 8) | static_cast<uint8_t>(data[i]);
+        }
+
+        return value;
+    }
+}
+
+// Maps a region file. Returns false if the file is missing or too small to hold its header.
+const bool RegionFile::Open(const filesystem::path& path)
+{
+    Close();
+
+    if (!file_.Open(path.string().c_str()))
+        return false;
+
+    // Location and timestamp tables each take one sector.
+    if (file_.GetSize() < sectorSize * 2)
+    {
+        Close();
+        return false;
+    }
+
+    return true;
+}
+// Unmaps the region file.
+void RegionFile::Close()
+{
+    file_.Close();
+}
+// Returns true if a region file is mapped.
+const bool RegionFile::IsOpen() const
+{
+    return file_.IsOpen();
+}
+
+// Returns true if the region contains a chunk, without reading it.
+const bool RegionFile::HasChunk(const int& x, const int& z) const
+{
+    return GetLocation(x, z) != 0;
+}
+// Decompresses a chunk into uncompressed NBT data. Returns false if the chunk hasn't been generated.
+const bool RegionFile::ReadChunk(const int& x, const int& z, vector<uint8_t>* nbt) const
+{
+    uint32_t location = GetLocation(x, z);
+    if (location == 0)
+        return false;
+
+    // Check chunk starts after the header and within the file. The last sector may be unpadded.
+    size_t offset = static_cast<size_t>(location >> 8) * sectorSize;
+    size_t sectors = location & 0xFF;
+    if (offset < sectorSize * 2 || offset >= file_.GetSize())
+        return false;
+
+    const byte* data = file_.GetData().data() + offset;
+    size_t available = min(sectors * sectorSize, file_.GetSize() - offset);
+    if (available < 5)
+        return false;
+
+    // Length includes the compression type.
+    size_t length = ReadBigEndian(data, 4);
+    uint8_t compression = static_cast<uint8_t>(data[4]);
+    if (length < 1 || length > available - 4 || (compression & compressionExternal))
+        return false;
+
+    span<const uint8_t> payload(reinterpret_cast<const uint8_t*>(data + 5), length - 1);
+
+    switch (compression)
+    {
+    case compressionGzip: return Compression::DecompressGzip(payload, nbt, maxChunkSize);
+    case compressionZlib: return Compression::DecompressZlib(payload, nbt, maxChunkSize);
+    case compressionNone:
+    {
+        nbt->assign(payload.begin(), payload.end());
+        return true;
+    }
+    default: return false;
+    }
+}
+
+// Returns the path of a region file within a region directory.
+const filesystem::path RegionFile::GetPath(const filesystem::path& regionPath, const int& x, const int& z)
+{
+    return regionPath / ("r." + to_string(x) + "." + to_string(z) + ".mca");
+}
+
+// Reads a chunk's sector offset and count from the location table.
+const uint32_t RegionFile::GetLocation(const int& x, const int& z) const
+{
+    if (!file_.IsOpen() || x < 0 || x >= size || z < 0 || z >= size)
+        return 0;
+
+    return ReadBigEndian(file_.GetData().data() + (z * size + x) * 4, 4);
+}
@@ -0,0 +1,44 @@
+#ifndef REGION_FILE_H_
+#define REGION_FILE_H_
+
+#include "MappedFile.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+namespace Cartographer
+{
+	// Anvil region file (r.<x>.<z>.mca) holding 32x32 chunks of a world. The file is memory mapped and
+	// chunks are decompressed on request, so several threads can read chunks from one region at once.
+	class RegionFile
+	{
+	public:
+		static constexpr int size = 32;
+		static constexpr size_t sectorSize = 4096;
+
+		// Largest decompressed chunk accepted, so a damaged chunk can't inflate without limit.
+		static constexpr size_t maxChunkSize = 16 << 20;
+
+	private:
+		Vaux::MappedFile file_;
+
+	public:
+		// File functions.
+		const bool Open(const std::filesystem::path& path);
+		void Close();
+		const bool IsOpen() const;
+
+		// Chunk functions. Coordinates are relative to the region, from 0 to 31.
+		const bool HasChunk(const int& x, const int& z) const;
+		const bool ReadChunk(const int& x, const int& z, std::vector<uint8_t>* nbt) const;
+
+		// Path functions. Coordinates are region coordinates, chunk coordinates divided by 32.
+		static const std::filesystem::path GetPath(const std::filesystem::path& regionPath, const int& x, const int& z);
+
+	private:
+		const uint32_t GetLocation(const int& x, const int& z) const;
+	};
+}
+
+#endif //REGION_FILE_H_
@@ -0,0 +1,662 @@
+#include "TerrainRenderer.h"
+#include "NBT.h"
+#include "RegionFile.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <climits>
+#include <map>
+#include <memory>
+#include <string_view>
+#include <utility>
+
+using namespace Cartographer;
+using namespace Vaux;
+using namespace std;
+
+namespace
+{
+    // Blocks per side of a chunk and per section of a chunk.
+    const int chunkSize = 16;
+    const int sectionHeight = 16;
+    const int columnCount = chunkSize * chunkSize;
+
+    // Width of the area covered by a map of the largest scale. Maps of every scale nest within these
+    // areas, so each area is rendered in turn to bound memory use.
+    const int areaSize = MCMapData::defaultWidth << TerrainRenderer::maxScale;
+
+    // Shades of each base colour, in colour table order.
+    const uint8_t shadeLow = 0;
+    const uint8_t shadeNormal = 1;
+    const uint8_t shadeHigh = 2;
+
+    // Height and colour weights used for dimensions with a ceiling, which show a noise pattern.
+    const float ceilingHeight = 100.0f;
+    const int ceilingDirtWeight = 10;
+    const int ceilingStoneWeight = 100;
+
+    // Section of a chunk. Block names refer to the chunk data, colours are looked up when first used.
+    struct Section
+    {
+        int y = 0;
+        vector<string_view> names;
+        vector<bool> waterlogged;
+        vector<uint8_t> colours;
+        span<const uint8_t> data;
+        int bits = 0;
+    };
+
+    // Decoded chunk. Spans refer to the uncompressed chunk data.
+    struct Chunk
+    {
+        vector<Section> sections;
+        span<const uint8_t> heightmap;
+        int minSection = 0;
+        bool hasMinSection = false;
+        bool generated = true;
+    };
+
+    // Top coloured block of each column in a chunk, with the depth of any water above it.
+    struct Columns
+    {
+        array<uint8_t, columnCount> colour;
+        array<int16_t, columnCount> height;
+        array<uint8_t, columnCount> depth;
+    };
+
+    // Map being rendered. Holds an extra row above the map, used to shade the first row.
+    struct Canvas
+    {
+        size_t index = 0;
+        int scale = 0;
+        int64_t left = 0, top = 0;
+        vector<uint8_t> colour;
+        vector<float> height;
+        vector<float> depth;
+    };
+
+    // Chunk to decode, within a mapped region file.
+    struct ChunkTask
+    {
+        const RegionFile* region;
+        int64_t x, z;
+    };
+
+    // Rounds a division towards negative infinity.
+    const int64_t FloorDivide(const int64_t& a, const int64_t& b)
+    {
+        return (a >= 0) ? a / b : -((-a + b - 1) / b);
+    }
+
+    // Reads a big endian 64 bit integer.
+    const uint64_t ReadBigEndian64(const uint8_t* data)
+    {
+        uint64_t value = 0;
+        for (int i = 0; i < 8; i++)
+        {
+            value = (value << 8) | data[i];
+        }
+
+        return value;
+    }
+
+    // Reads a value packed into an array of longs. Values don't span longs.
+    const uint32_t ReadPacked(span<const uint8_t> data, const int& bits, const int& index)
+    {
+        int perLong = 64 / bits;
+        size_t offset = static_cast<size_t>(index / perLong) * 8;
+        if (offset + 8 > data.size())
+            return 0;
+
+        return static_cast<uint32_t>((ReadBigEndian64(data.data() + offset) >> ((index % perLong) * bits)) & ((uint64_t(1) << bits) - 1));
+    }
+
+    // Reads the block names of a section palette.
+    const bool ReadPalette(NBTReader& reader, Section* section)
+    {
+        NBTTag type;
+        int32_t length;
+        if (!reader.ReadListHeader(&type, &length))
+            return false;
+
+        for (int32_t i = 0; i < length && reader.IsValid(); i++)
+        {
+            if (type != NBTTag::COMPOUND)
+            {
+                reader.Skip(type);
+                continue;
+            }
+
+            string_view name;
+            bool waterlogged = false;
+
+            NBTTag childType;
+            string_view childName;
+            while (reader.ReadHeader(&childType, &childName) && childType != NBTTag::END)
+            {
+                if (childName == "Name" && childType == NBTTag::STRING)
+                {
+                    name = reader.ReadString();
+                }
+                else if (childName == "Properties" && childType == NBTTag::COMPOUND)
+                {
+                    // Waterlogged blocks are drawn as water.
+                    NBTTag propertyType;
+                    string_view propertyName;
+                    while (reader.ReadHeader(&propertyType, &propertyName) && propertyType != NBTTag::END)
+                    {
+                        if (propertyName == "waterlogged" && propertyType == NBTTag::STRING)
+                            waterlogged = reader.ReadString() == "true";
+                        else
+                            reader.Skip(propertyType);
+                    }
+                }
+                else
+                {
+                    reader.Skip(childType);
+                }
+            }
+
+            section->names.push_back(name);
+            section->waterlogged.push_back(waterlogged);
+        }
+
+        return reader.IsValid();
+    }
+
+    // Reads a section's height and block states.
+    const bool ReadSection(NBTReader& reader, Section* section)
+    {
+        NBTTag type;
+        string_view name;
+        while (reader.ReadHeader(&type, &name) && type != NBTTag::END)
+        {
+            if (name == "Y")
+            {
+                section->y = static_cast<int>(reader.ReadInteger(type));
+            }
+            else if (name == "block_states" && type == NBTTag::COMPOUND)
+            {
+                NBTTag stateType;
+                string_view stateName;
+                while (reader.ReadHeader(&stateType, &stateName) && stateType != NBTTag::END)
+                {
+                    if (stateName == "palette" && stateType == NBTTag::LIST)
+                        ReadPalette(reader, section);
+                    else if (stateName == "data" && stateType == NBTTag::LONG_ARRAY)
+                        section->data = reader.ReadLongArray();
+                    else
+                        reader.Skip(stateType);
+                }
+            }
+            else
+            {
+                reader.Skip(type);
+            }
+        }
+
+        // Sections with a single block have no data. Indices use at least four bits.
+        if (!section->data.empty() && section->names.size() > 1)
+        {
+            section->bits = max(4, static_cast<int>(bit_width(section->names.size() - 1)));
+        }
+
+        return reader.IsValid();
+    }
+
+    // Reads the sections and surface heightmap of a chunk. Returns false for chunks saved before 1.18.
+    const bool ReadChunk(span<const uint8_t> data, Chunk* chunk)
+    {
+        NBTReader reader(data);
+
+        NBTTag type;
+        string_view name;
+        if (!reader.ReadHeader(&type, &name) || type != NBTTag::COMPOUND)
+            return false;
+
+        while (reader.ReadHeader(&type, &name) && type != NBTTag::END)
+        {
+            if (name == "Level")
+            {
+                // Chunk format before 1.18.
+                return false;
+            }
+            else if (name == "yPos")
+            {
+                chunk->minSection = static_cast<int>(reader.ReadInteger(type));
+                chunk->hasMinSection = true;
+            }
+            else if (name == "Status" && type == NBTTag::STRING)
+            {
+                // Chunks on the edge of explored areas are saved before terrain generation finishes.
+                string_view status = reader.ReadString();
+                chunk->generated = status == "minecraft:full" || status == "full";
+            }
+            else if (name == "sections" && type == NBTTag::LIST)
+            {
+                NBTTag elementType;
+                int32_t length;
+                reader.ReadListHeader(&elementType, &length);
+
+                for (int32_t i = 0; i < length && reader.IsValid(); i++)
+                {
+                    if (elementType != NBTTag::COMPOUND)
+                    {
+                        reader.Skip(elementType);
+                        continue;
+                    }
+
+                    chunk->sections.emplace_back();
+                    ReadSection(reader, &chunk->sections.back());
+                }
+            }
+            else if (name == "Heightmaps" && type == NBTTag::COMPOUND)
+            {
+                NBTTag mapType;
+                string_view mapName;
+                while (reader.ReadHeader(&mapType, &mapName) && mapType != NBTTag::END)
+                {
+                    if (mapName == "WORLD_SURFACE" && mapType == NBTTag::LONG_ARRAY)
+                        chunk->heightmap = reader.ReadLongArray();
+                    else
+                        reader.Skip(mapType);
+                }
+            }
+            else
+            {
+                reader.Skip(type);
+            }
+        }
+
+        return reader.IsValid();
+    }
+
+    // Returns the colour of a block within a section.
+    const uint8_t GetBlockColour(Section& section, const BlockColours& colours, const int& x, const int& y, const int& z)
+    {
+        if (section.names.empty())
+            return BlockColours::none;
+
+        // Look up palette colours when the section is first reached.
+        if (section.colours.empty())
+        {
+            for (size_t i = 0; i < section.names.size(); i++)
+            {
+                section.colours.push_back(section.waterlogged[i] ? BlockColours::water : colours.GetColour(section.names[i]));
+            }
+        }
+
+        uint32_t entry = (section.bits > 0) ? ReadPacked(section.data, section.bits, (y * chunkSize + z) * chunkSize + x) : 0;
+        return (entry < section.colours.size()) ? section.colours[entry] : BlockColours::none;
+    }
+
+    // Finds the top coloured block of each column, and the depth of water above it.
+    void FindColumns(Chunk& chunk, const BlockColours& colours, Columns* columns)
+    {
+        // Index sections by height.
+        int minSection = chunk.hasMinSection ? chunk.minSection : INT_MAX;
+        int maxSection = INT_MIN;
+        for (const Section& section : chunk.sections)
+        {
+            if (!chunk.hasMinSection)
+                minSection = min(minSection, section.y);
+            maxSection = max(maxSection, section.y);
+        }
+
+        int minY = minSection * sectionHeight;
+        int maxY = (maxSection + 1) * sectionHeight - 1;
+
+        columns->colour.fill(BlockColours::none);
+        columns->height.fill(static_cast<int16_t>(minY));
+        columns->depth.fill(0);
+
+        if (chunk.sections.empty() || maxSection < minSection)
+            return;
+
+        vector<Section*> sections(maxSection - minSection + 1, nullptr);
+        for (Section& section : chunk.sections)
+        {
+            if (section.y >= minSection)
+                sections[section.y - minSection] = &section;
+        }
+
+        auto getBlock = [&](const int& x, const int& y, const int& z)
+        {
+            Section* section = sections[(y - minY) / sectionHeight];
+            return section ? GetBlockColour(*section, colours, x, (y - minY) % sectionHeight, z) : BlockColours::none;
+        };
+
+        // Heightmap values are packed into the fewest bits that fit the world height.
+        int heightmapBits = 0;
+        if (!chunk.heightmap.empty())
+        {
+            size_t longs = chunk.heightmap.size() / 8;
+            heightmapBits = static_cast<int>(64 / ((columnCount + longs - 1) / longs));
+        }
+
+        for (int z = 0; z < chunkSize; z++)
+        {
+            for (int x = 0; x < chunkSize; x++)
+            {
+                int column = z * chunkSize + x;
+
+                // Start from the highest non air block.
+                int y = maxY;
+                if (heightmapBits > 0)
+                {
+                    y = min(maxY, minY + static_cast<int>(ReadPacked(chunk.heightmap, heightmapBits, column)) - 1);
+                }
+
+                // Skip blocks without a map colour, e.g. glass.
+                uint8_t colour = BlockColours::none;
+                while (y >= minY && (colour = getBlock(x, y, z)) == BlockColours::none)
+                {
+                    y--;
+                }
+
+                if (y < minY)
+                    continue;
+
+                // Count water depth.
+                int depth = 0;
+                for (int waterY = y; waterY >= minY && colour == BlockColours::water && getBlock(x, waterY, z) == BlockColours::water; waterY--)
+                {
+                    depth++;
+                }
+
+                columns->colour[column] = colour;
+                columns->height[column] = static_cast<int16_t>(y);
+                columns->depth[column] = static_cast<uint8_t>(min(depth, 255));
+            }
+        }
+    }
+
+    // Fills columns with the noise pattern shown by dimensions with a ceiling.
+    void FillCeiling(const int64_t& chunkX, const int64_t& chunkZ, Columns* columns)
+    {
+        for (int z = 0; z < chunkSize; z++)
+        {
+            for (int x = 0; x < chunkSize; x++)
+            {
+                // Integer arithmetic wraps as in Minecraft.
+                uint32_t noise = static_cast<uint32_t>(chunkX * chunkSize + x) + static_cast<uint32_t>(chunkZ * chunkSize + z) * 231871u;
+                noise = noise * noise * 31287121u + noise * 11u;
+
+                int column = z * chunkSize + x;
+                columns->colour[column] = ((noise >> 20) & 1) ? BlockColours::stone : BlockColours::dirt;
+                columns->height[column] = static_cast<int16_t>(ceilingHeight);
+                columns->depth[column] = 0;
+            }
+        }
+    }
+
+    // Averages the columns of a chunk into the pixels of a canvas covering it. Each pixel shows the
+    // most common colour of its blocks.
+    void DrawColumns(const Columns& columns, const int64_t& chunkX, const int64_t& chunkZ, const bool& ceiling, Canvas* canvas)
+    {
+        const int pixelSize = 1 << canvas->scale;
+        const int width = MCMapData::defaultWidth;
+        const int64_t canvasTop = canvas->top - pixelSize;
+
+        // Find pixels within the chunk. Map edges are aligned to the largest pixel size.
+        int64_t left = max(chunkX * chunkSize, canvas->left);
+        int64_t right = min((chunkX + 1) * chunkSize, canvas->left + static_cast<int64_t>(width) * pixelSize);
+        int64_t top = max(chunkZ * chunkSize, canvasTop);
+        int64_t bottom = min((chunkZ + 1) * chunkSize, canvasTop + static_cast<int64_t>(width + 1) * pixelSize);
+
+        for (int64_t z = top; z < bottom; z += pixelSize)
+        {
+            for (int64_t x = left; x < right; x += pixelSize)
+            {
+                array<int, BlockColours::maxColourCount> counts = {};
+                int totalHeight = 0;
+                int totalDepth = 0;
+
+                for (int blockZ = 0; blockZ < pixelSize; blockZ++)
+                {
+                    int column = static_cast<int>(z - chunkZ * chunkSize + blockZ) * chunkSize + static_cast<int>(x - chunkX * chunkSize);
+                    for (int blockX = 0; blockX < pixelSize; blockX++, column++)
+                    {
+                        uint8_t colour = columns.colour[column];
+                        counts[colour] += ceiling ? (colour == BlockColours::dirt ? ceilingDirtWeight : ceilingStoneWeight) : 1;
+                        totalHeight += columns.height[column];
+                        totalDepth += columns.depth[column];
+                    }
+                }
+
+                size_t pixel = static_cast<size_t>((z - canvasTop) / pixelSize) * width + static_cast<size_t>((x - canvas->left) / pixelSize);
+                float area = static_cast<float>(pixelSize * pixelSize);
+
+                canvas->colour[pixel] = static_cast<uint8_t>(max_element(counts.begin(), counts.end()) - counts.begin());
+                canvas->height[pixel] = totalHeight / area;
+                canvas->depth[pixel] = totalDepth / area;
+            }
+        }
+    }
+
+    // Shades each pixel of a canvas by comparing its height to the pixel north of it.
+    void ShadeCanvas(const Canvas& canvas, MCMapData* map)
+    {
+        const int width = MCMapData::defaultWidth;
+        const int height = MCMapData::defaultHeight;
+        const double pixelSize = static_cast<double>(1 << canvas.scale);
+
+        for (int x = 0; x < width; x++)
+        {
+            double previousHeight = canvas.height[x];
+            for (int z = 0; z < height; z++)
+            {
+                size_t pixel = static_cast<size_t>(z + 1) * width + x;
+                uint8_t colour = canvas.colour[pixel];
+                double currentHeight = canvas.height[pixel];
+                int dither = (x + z) & 1;
+
+                uint8_t shade = shadeNormal;
+                if (colour == BlockColours::water)
+                {
+                    // Water is shaded by depth.
+                    double depth = canvas.depth[pixel] * 0.1 + dither * 0.2;
+                    shade = (depth < 0.5) ? shadeHigh : (depth > 0.9) ? shadeLow : shadeNormal;
+                }
+                else
+                {
+                    double slope = (currentHeight - previousHeight) * 4.0 / (pixelSize + 4.0) + (dither - 0.5) * 0.4;
+                    shade = (slope > 0.6) ? shadeHigh : (slope < -0.6) ? shadeLow : shadeNormal;
+                }
+
+                map->Set(x, z, (colour == BlockColours::none) ? 0 : colour * 4 + shade);
+                previousHeight = currentHeight;
+            }
+        }
+    }
+}
+
+TerrainRenderer::TerrainRenderer(const filesystem::path& worldPath, const string& dimension, const BlockColours& colours) : regionPath_(GetRegionPath(worldPath, dimension)), colours_(colours), ceiling_(dimension == "minecraft:the_nether")
+{
+    // Default constructor.
+}
+
+// Returns the placement of a map containing a block, aligned to the grid used by Minecraft.
+const MCMapInfo TerrainRenderer::GetMapInfo(const int& x, const int& z, const int& scale, const string& dimension)
+{
+    MCMapInfo info;
+    info.scale = clamp(scale, 0, maxScale);
+    info.dimension = dimension;
+
+    int64_t size = static_cast<int64_t>(MCMapData::defaultWidth) << info.scale;
+    info.xCenter = static_cast<int>(FloorDivide(x + 64, size) * size + size / 2 - 64);
+    info.zCenter = static_cast<int>(FloorDivide(z + 64, size) * size + size / 2 - 64);
+
+    return info;
+}
+// Returns the maps of one scale which cover a square area around a block.
+const vector<MCMapInfo> TerrainRenderer::GetMapsInArea(const int& x, const int& z, const int& radius, const int& scale, const string& dimension)
+{
+    int64_t size = static_cast<int64_t>(MCMapData::defaultWidth) << clamp(scale, 0, maxScale);
+    int64_t area = clamp(radius, 0, maxRadius);
+
+    vector<MCMapInfo> info;
+    for (int64_t mapZ = FloorDivide(int64_t(z) - area + 64, size); mapZ <= FloorDivide(int64_t(z) + area + 64, size); mapZ++)
+    {
+        for (int64_t mapX = FloorDivide(int64_t(x) - area + 64, size); mapX <= FloorDivide(int64_t(x) + area + 64, size); mapX++)
+        {
+            info.push_back(GetMapInfo(static_cast<int>(mapX * size - 64), static_cast<int>(mapZ * size - 64), scale, dimension));
+        }
+    }
+
+    return info;
+}
+
+// Renders maps from terrain. Maps are rendered one area at a time, decoding the chunks of an area
+// in parallel then shading each map.
+const bool TerrainRenderer::Render(span<const MCMapInfo> info, vector<MCMapData>* maps, ThreadPool& pool, Result* result) const
+{
+    auto start = chrono::steady_clock::now();
+
+    atomic<size_t> chunkCount = 0, missingCount = 0, failedCount = 0;
+
+    maps->assign(info.size(), MCMapData());
+
+    // Group maps by the area containing them.
+    map<pair<int64_t, int64_t>, vector<Canvas>> areas;
+    for (size_t i = 0; i < info.size(); i++)
+    {
+        Canvas canvas;
+        canvas.index = i;
+        canvas.scale = clamp(info[i].scale, 0, maxScale);
+
+        int64_t halfSize = static_cast<int64_t>(MCMapData::defaultWidth / 2) << canvas.scale;
+        canvas.left = info[i].xCenter - halfSize;
+        canvas.top = info[i].zCenter - halfSize;
+
+        areas[{ FloorDivide(canvas.left + 64, areaSize), FloorDivide(canvas.top + 64, areaSize) }].push_back(move(canvas));
+    }
+
+    for (auto& [area, canvases] : areas)
+    {
+        // Find the chunks covered by maps in this area, including the row above each map.
+        vector<pair<int64_t, int64_t>> chunks;
+        for (Canvas& canvas : canvases)
+        {
+            size_t pixels = static_cast<size_t>(MCMapData::defaultWidth) * (MCMapData::defaultHeight + 1);
+            canvas.colour.assign(pixels, BlockColours::none);
+            canvas.height.assign(pixels, 0.0f);
+            canvas.depth.assign(pixels, 0.0f);
+
+            int64_t size = static_cast<int64_t>(MCMapData::defaultWidth) << canvas.scale;
+            int64_t pixelSize = int64_t(1) << canvas.scale;
+            for (int64_t z = FloorDivide(canvas.top - pixelSize, chunkSize); z <= FloorDivide(canvas.top + size - 1, chunkSize); z++)
+            {
+                for (int64_t x = FloorDivide(canvas.left, chunkSize); x <= FloorDivide(canvas.left + size - 1, chunkSize); x++)
+                {
+                    chunks.push_back({ z, x });
+                }
+            }
+        }
+
+        sort(chunks.begin(), chunks.end());
+        chunks.erase(unique(chunks.begin(), chunks.end()), chunks.end());
+
+        // Map the region files of the chunks.
+        map<pair<int64_t, int64_t>, unique_ptr<RegionFile>> regions;
+        vector<ChunkTask> tasks;
+        tasks.reserve(chunks.size());
+        for (const auto& [z, x] : chunks)
+        {
+            pair<int64_t, int64_t> regionKey = { FloorDivide(x, RegionFile::size), FloorDivide(z, RegionFile::size) };
+            unique_ptr<RegionFile>& region = regions[regionKey];
+            if (!region)
+            {
+                region = make_unique<RegionFile>();
+                region->Open(RegionFile::GetPath(regionPath_, static_cast<int>(regionKey.first), static_cast<int>(regionKey.second)));
+            }
+
+            if (!region->IsOpen() || !region->HasChunk(static_cast<int>(x - regionKey.first * RegionFile::size), static_cast<int>(z - regionKey.second * RegionFile::size)))
+            {
+                missingCount++;
+                continue;
+            }
+
+            tasks.push_back({ region.get(), x, z });
+        }
+
+        // Decode chunks in parallel. Chunks cover separate pixels of each map, so no locking is needed.
+        pool.ParallelFor(tasks.size(), [&](size_t i)
+        {
+            const ChunkTask& task = tasks[i];
+
+            Columns columns;
+            if (ceiling_)
+            {
+                FillCeiling(task.x, task.z, &columns);
+            }
+            else
+            {
+                thread_local vector<uint8_t> data;
+                Chunk chunk;
+                if (!task.region->ReadChunk(static_cast<int>(task.x - FloorDivide(task.x, RegionFile::size) * RegionFile::size), static_cast<int>(task.z - FloorDivide(task.z, RegionFile::size) * RegionFile::size), &data) || !ReadChunk(data, &chunk))
+                {
+                    failedCount++;
+                    return;
+                }
+                if (!chunk.generated)
+                {
+                    missingCount++;
+                    return;
+                }
+
+                FindColumns(chunk, colours_, &columns);
+            }
+
+            chunkCount++;
+
+            int64_t chunkLeft = task.x * chunkSize, chunkTop = task.z * chunkSize;
+            for (Canvas& canvas : canvases)
+            {
+                int64_t size = static_cast<int64_t>(MCMapData::defaultWidth) << canvas.scale;
+                int64_t pixelSize = int64_t(1) << canvas.scale;
+                if (chunkLeft < canvas.left + size && chunkLeft + chunkSize > canvas.left && chunkTop < canvas.top + size && chunkTop + chunkSize > canvas.top - pixelSize)
+                {
+                    DrawColumns(columns, task.x, task.z, ceiling_, &canvas);
+                }
+            }
+        });
+
+        // Shade maps.
+        pool.ParallelFor(canvases.size(), [&](size_t i)
+        {
+            ShadeCanvas(canvases[i], &(*maps)[canvases[i].index]);
+        });
+    }
+
+    if (result)
+    {
+        result->chunks = chunkCount;
+        result->missing = missingCount;
+        result->failed = failedCount;
+        result->seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    }
+
+    return failedCount == 0;
+}
+
+// Returns the region directory of a dimension.
+const filesystem::path TerrainRenderer::GetRegionPath(const filesystem::path& worldPath, const string& dimension)
+{
+    if (dimension == "minecraft:overworld")
+        return worldPath / "region";
+    if (dimension == "minecraft:the_nether")
+        return worldPath / "DIM-1" / "region";
+    if (dimension == "minecraft:the_end")
+        return worldPath / "DIM1" / "region";
+
+    // Custom dimensions are stored by namespace and name.
+    size_t separator = dimension.find(':');
+    if (separator == string::npos)
+        return worldPath / "dimensions" / "minecraft" / dimension / "region";
+
+    return worldPath / "dimensions" / dimension.substr(0, separator) / dimension.substr(separator + 1) / "region";
+}
@@ -0,0 +1,58 @@
+#ifndef TERRAIN_RENDERER_H_
+#define TERRAIN_RENDERER_H_
+
+#include "BlockColours.h"
+#include "MCMapData.h"
+#include "ThreadPool.h"
+
+#include <cstddef>
+#include <filesystem>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace Cartographer
+{
+	// Renders maps of a world's terrain from its Anvil region files, shaded by height the same way as
+	// maps drawn in game. Supports the chunk format used since Minecraft 1.18.
+	class TerrainRenderer
+	{
+	public:
+		// Largest map scale, each map pixel covers 2^scale blocks.
+		static constexpr int maxScale = 4;
+
+		// Largest radius rendered in one run, in blocks. Every map is held in memory until all are
+		// rendered, at scale 0 this is 65x65 maps.
+		static constexpr int maxRadius = 4096;
+
+		struct Result
+		{
+			size_t chunks = 0;
+			size_t missing = 0;
+			size_t failed = 0;
+			double seconds = 0.0;
+		};
+
+	private:
+		std::filesystem::path regionPath_;
+		const BlockColours& colours_;
+		bool ceiling_;
+
+	public:
+		TerrainRenderer(const std::filesystem::path& worldPath, const std::string& dimension, const BlockColours& colours);
+
+		// Placement functions. Returns the map a new map made at a block position would show. Areas
+		// are limited to maxRadius.
+		static const MCMapInfo GetMapInfo(const int& x, const int& z, const int& scale, const std::string& dimension);
+		static const std::vector<MCMapInfo> GetMapsInArea(const int& x, const int& z, const int& radius, const int& scale, const std::string& dimension);
+
+		// Render functions. Region files are memory mapped and chunks decoded in parallel, each chunk
+		// once for every map covering it. Ungenerated chunks are left transparent.
+		const bool Render(std::span<const MCMapInfo> info, std::vector<MCMapData>* maps, Vaux::ThreadPool& pool, Result* result = nullptr) const;
+
+		// Path functions.
+		static const std::filesystem::path GetRegionPath(const std::filesystem::path& worldPath, const std::string& dimension);
+	};
+}
+
+#endif //TERRAIN_RENDERER_H_
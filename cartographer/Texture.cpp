@@ -1,11 +1,23 @@
 #include "Texture.h"
+#include "JpegDecoder.h"
+#include "MappedFile.h"
+#include "Netpbm.h"
+#include "NetpbmWriter.h"
+#include "PngWriter.h"
+#include "QoiDecoder.h"
+#include "QoiWriter.h"
 
 #include <algorithm>
+#include <climits>
 #include <filesystem>
-#include <fstream>
 #include <string>
 #include <cstring>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VAUX_SSE2
+#include <emmintrin.h>
+#endif
+
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb/stb_image.h"
 
@@ -286,55 +298,102 @@ void Texture2D::ResizeCanvas(const int& width, const int& height)
 	}
 }
 
-// Loads texture data from a file.
-const bool Texture2D::LoadFromFile(const char* filename)
+// Loads texture data from a file. The file is memory mapped and decoded in place.
+const bool Texture2D::LoadFromFile(const char* filename, const int& targetWidth, const int& targetHeight, const Budget& budget)
+{
+	// Map image file.
+	MappedFile file;
+	if (!file.Open(filename))
+		return false;
+
+	// Decode mapped file.
+	return LoadFromMemory(file.GetData(), targetWidth, targetHeight, budget);
+}
+// Loads texture data from an encoded image in memory. If a target size is given, JPEG data may be decoded at a reduced size which still covers it.
+// Images are checked against the budget using their header before any pixel data is decoded.
+const bool Texture2D::LoadFromMemory(span<const std::byte> data, const int& targetWidth, const int& targetHeight, const Budget& budget)
 {
 	const int desiredChannels = 4;
 
+	const unsigned char* encoded = reinterpret_cast<const unsigned char*>(data.data());
+	int encodedSize = static_cast<int>(min(data.size(), static_cast<size_t>(INT_MAX)));
+
+	// Read image header.
+	ImageInfo info;
+	if (!ReadInfo(data, &info))
+		return false;
+
+	// Select decoding strategy, reject images which exceed the budget.
+	DecodePlan plan = PlanDecode(info, targetWidth, targetHeight, budget);
+	if (plan.decoding == Decoding::REJECTED)
+		return false;
+
 	int width, height, channels;
-	unsigned char* data = stbi_load(filename, &width, &height, &channels, desiredChannels);
 
-	// Check if data exists.
-	if (data)
+	// Check if image can be decoded in the DCT domain at reduced size.
+	if (plan.decoding == Decoding::REDUCED)
 	{
-		// Update width and height.
-		channels_ = channels;
-		width_ = width;
-		height_ = height;
+		vector<unsigned char> scaledData;
+		if (JpegDecoder::Decode(encoded, data.size(), plan.scale, &scaledData, &width, &height, &channels))
+		{
+			SetPixels(scaledData.data(), width, height, channels);
 
-		// Initialise pixel vector.
-		std::vector<Vector4i> pixel;
-		pixel.reserve(width * height);
+			// Image loaded successfully.
+			return true;
+		}
 
-		// Loop thorugh each colour in image data.
-		for (int i = 0; i < width * height * desiredChannels; i += desiredChannels)
+		// Decoder doesn't support image, check full size decode fits within budget.
+		info.jpeg = false;
+		if (PlanDecode(info, targetWidth, targetHeight, budget).decoding == Decoding::REJECTED)
+			return false;
+	}
+
+	// Decode uncompressed images directly.
+	if (Netpbm::IsNetpbm(encoded, data.size()))
+	{
+		vector<unsigned char> pixels;
+		if (Netpbm::Decode(encoded, data.size(), &pixels, &width, &height, &channels))
 		{
-			Vector4i colour;
-		
-			// Update each channel of colour.
-			colour.x = data[i];
-			colour.y = data[i + 1];
-			colour.z = data[i + 2];
-			colour.w = data[i + 3];
-		
-			// Add colour to pixel vector.
-			pixel.push_back(colour);
+			SetPixels(pixels.data(), width, height, channels);
+
+			// Image loaded successfully.
+			return true;
 		}
+	}
 
-		// Update pixel vector.
-		pixel_ = pixel;
+	// Decode QOI images, which stb doesn't support.
+	if (QoiDecoder::IsQoi(encoded, data.size()))
+	{
+		vector<unsigned char> pixels;
+		if (!QoiDecoder::Decode(encoded, data.size(), &pixels, &width, &height, &channels))
+			return false;
+
+		SetPixels(pixels.data(), width, height, channels);
+
+		// Image loaded successfully.
+		return true;
+	}
+
+	// Decode at full size.
+	unsigned char* pixels = stbi_load_from_memory(encoded, encodedSize, &width, &height, &channels, desiredChannels);
 
-		// File loaded successfully.
+	// Check if data exists.
+	if (pixels)
+	{
+		SetPixels(pixels, width, height, channels);
+		stbi_image_free(pixels);
+
+		// Image loaded successfully.
 		return true;
 	}
 	else
 	{
-		// Failed to load file.
+		// Failed to load image.
 		return false;
 	}
 }
 // Saves texture data to a file. File type based on ending.
-const bool Texture2D::SaveToFile(const char* filename) const
+const bool Texture2D::SaveToFile(const char* filename, const PngWriter::Mode& mode, ThreadPool* pool) const
 {
 	// Get file path.
 	filesystem::path filepath(filename);
@@ -346,27 +405,44 @@ const bool Texture2D::SaveToFile(const char* filename) const
 		string extension = filepath.extension().string();
 
 		// Check extension type.
-		if (extension == ".ppm")
+		if (extension == ".ppm" || extension == ".pam")
 		{
-			// Save as PMM.
-			return SaveToPPM(filename);
+			// Save as binary PPM, or PAM to keep alpha.
+			return SaveToNetpbm(filename, (extension == ".pam") ? 4 : 3);
+		}
+		else if (extension == ".qoi")
+		{
+			QoiWriter writer;
+			if (!writer.Open(filename, width_, height_))
+				return false;
+
+			// Write raw colour data one row at a time.
+			vector<unsigned char> row(static_cast<size_t>(width_) * 4);
+			for (int y = 0; y < height_; y++)
+			{
+				PackRow(y, row.data());
+				if (!writer.WriteRow(row))
+					return false;
+			}
+
+			return writer.Close();
 		}
 		else if (extension == ".png")
 		{
-			// Create new memory block.
-			unsigned char* memblock = new unsigned char[width_ * height_ * 4];
+			PngWriter writer(mode, pool);
+			if (!writer.Open(filename, width_, height_))
+				return false;
 
-			// Store raw colour data in memory block.
-			for (int i = 0; i < width_ * height_; i++)
+			// Write raw colour data one row at a time.
+			vector<unsigned char> row(static_cast<size_t>(width_) * 4);
+			for (int y = 0; y < height_; y++)
 			{
-				memblock[i * 4 + 0] = pixel_[i].x;
-				memblock[i * 4 + 1] = pixel_[i].y;
-				memblock[i * 4 + 2] = pixel_[i].z;
-				memblock[i * 4 + 3] = pixel_[i].w;
+				PackRow(y, row.data());
+				if (!writer.WriteRow(row))
+					return false;
 			}
 
-			// Write data to png.
-			stbi_write_png(filename, width_, height_, 4, memblock, 0);
+			return writer.Close();
 		}
 		else
 		{
@@ -384,41 +460,138 @@ const bool Texture2D::SaveToFile(const char* filename) const
 	return true;
 }
 
-// Saves texture to a PPM file.
-const bool Texture2D::SaveToPPM(const char* filename) const
+// Reads image dimensions and channels from a file header without decoding.
+const bool Texture2D::ReadInfo(const char* filename, ImageInfo* info)
 {
-	// Save to image.
-	ofstream outputData;
-	outputData.open(filename, ios::out | ios::ate);
-
-	// Check if file was succesfully opened.
-	if (outputData.is_open())
-	{
-		// Header
-		outputData << "P3\n";
-		outputData << width_ << " " << height_ << std::endl;
-		outputData << 255 << std::endl;
+	// Map image file, only header pages are read.
+	MappedFile file;
+	if (!file.Open(filename))
+		return false;
 
-		// Loop through each pixel in texture.
-		for (int y = 0; y < height_; y++)
-		{
-			for (int x = 0; x < width_; x++)
-			{
-				int position = (x + y * width_) * channels_;
+	return ReadInfo(file.GetData(), info);
+}
+// Reads image dimensions and channels from an encoded image header without decoding.
+const bool Texture2D::ReadInfo(span<const std::byte> data, ImageInfo* info)
+{
+	const unsigned char* encoded = reinterpret_cast<const unsigned char*>(data.data());
+	int encodedSize = static_cast<int>(min(data.size(), static_cast<size_t>(INT_MAX)));
 
-				// Send colour to file as RGB.
-				Vector4i colour = pixel_[x + y * width_];
-				outputData << colour.x << " " << colour.y << " " << colour.z << std::endl;
-			}
-		}
+	info->jpeg = JpegDecoder::IsJpeg(encoded, data.size());
 
-		// Close output file, return true.
-		outputData.close();
+	// Parse PAM and QOI headers, which stb doesn't support, along with PGM and PPM.
+	if (Netpbm::ReadInfo(encoded, data.size(), &info->width, &info->height, &info->channels))
 		return true;
+
+	if (QoiDecoder::IsQoi(encoded, data.size()))
+		return QoiDecoder::ReadInfo(encoded, data.size(), &info->width, &info->height, &info->channels);
+
+	// Parse header.
+	return stbi_info_from_memory(encoded, encodedSize, &info->width, &info->height, &info->channels) != 0;
+}
+// Selects the cheapest decoding strategy for an image, rejecting images which would exceed the budget.
+const Texture2D::DecodePlan Texture2D::PlanDecode(const ImageInfo& info, const int& targetWidth, const int& targetHeight, const Budget& budget)
+{
+	DecodePlan plan;
+	plan.width = info.width;
+	plan.height = info.height;
+
+	// Check if JPEG can be decoded at a reduced size.
+	if (info.jpeg)
+	{
+		plan.scale = JpegDecoder::SelectScale(info.width, info.height, targetWidth, targetHeight);
+	}
+
+	if (plan.scale > 1)
+	{
+		// Reduced decoding stores component planes, RGBA8 output and texture pixels.
+		plan.decoding = Decoding::REDUCED;
+		plan.width = (info.width + plan.scale - 1) / plan.scale;
+		plan.height = (info.height + plan.scale - 1) / plan.scale;
+		plan.bytes = static_cast<long long>(plan.width) * plan.height * (info.channels + 4 + sizeof(Vector4i));
 	}
 	else
 	{
-		// Failed to output file.
+		// Full decoding stores RGBA8 output and texture pixels.
+		plan.decoding = Decoding::FULL;
+		plan.bytes = static_cast<long long>(plan.width) * plan.height * (4 + sizeof(Vector4i));
+	}
+
+	// Check plan fits within budget.
+	if (static_cast<long long>(plan.width) * plan.height > budget.maxPixels || plan.bytes > budget.maxBytes)
+	{
+		plan.decoding = Decoding::REJECTED;
+	}
+
+	return plan;
+}
+
+// Updates texture from RGBA8 pixel data. Pixels are widened directly into the pixel vector.
+void Texture2D::SetPixels(const unsigned char* data, const int& width, const int& height, const int& channels)
+{
+	static_assert(sizeof(Vector4i) == sizeof(int) * 4, "Vector4i must be tightly packed.");
+
+	// Update width and height.
+	channels_ = channels;
+	width_ = width;
+	height_ = height;
+
+	// Resize pixel vector in place, treat it as an array of channels.
+	size_t count = static_cast<size_t>(width) * height * 4;
+	pixel_.resize(count / 4);
+	int* output = &pixel_.data()->x;
+
+	size_t i = 0;
+
+#ifdef VAUX_SSE2
+	// Widen four pixels at a time from 8 to 32 bits per channel.
+	const __m128i zero = _mm_setzero_si128();
+	for (; i + 16 <= count; i += 16)
+	{
+		__m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+		__m128i low = _mm_unpacklo_epi8(bytes, zero);
+		__m128i high = _mm_unpackhi_epi8(bytes, zero);
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(output + i), _mm_unpacklo_epi16(low, zero));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(output + i + 4), _mm_unpackhi_epi16(low, zero));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(output + i + 8), _mm_unpacklo_epi16(high, zero));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(output + i + 12), _mm_unpackhi_epi16(high, zero));
+	}
+#endif
+
+	// Widen remaining channels.
+	for (; i < count; i++)
+	{
+		output[i] = data[i];
+	}
+}
+
+// Saves texture to a binary PPM or PAM file, with three or four channels.
+const bool Texture2D::SaveToNetpbm(const char* filename, const int& channels) const
+{
+	NetpbmWriter writer;
+	if (!writer.Open(filename, width_, height_, channels))
 		return false;
+
+	// Pack pixels as RGBA8 a row at a time.
+	vector<unsigned char> row(static_cast<size_t>(width_) * 4);
+	bool success = true;
+	for (int y = 0; y < height_ && success; y++)
+	{
+		PackRow(y, row.data());
+		success = writer.WriteRow(row);
+	}
+
+	return writer.Close() && success;
+}
+// Narrows a row of pixels to RGBA8.
+void Texture2D::PackRow(const int& y, unsigned char* output) const
+{
+	const Vector4i* pixel = &pixel_[static_cast<size_t>(y) * width_];
+	for (int x = 0; x < width_; x++, output += 4)
+	{
+		output[0] = static_cast<unsigned char>(pixel[x].x);
+		output[1] = static_cast<unsigned char>(pixel[x].y);
+		output[2] = static_cast<unsigned char>(pixel[x].z);
+		output[3] = static_cast<unsigned char>(pixel[x].w);
 	}
 }
\ No newline at end of file
@@ -3,7 +3,11 @@
 
 #include "Vector4.h"
 #include "Vector2.h"
+#include "PngWriter.h"
+#include "ThreadPool.h"
 
+#include <cstddef>
+#include <span>
 #include <vector>
 
 namespace Vaux
@@ -24,6 +28,39 @@ namespace Vaux
 			REPEAT
 		};
 
+		enum class Decoding
+		{
+			FULL,
+			REDUCED,
+			REJECTED
+		};
+
+		// Image properties read from a file header, without decoding.
+		struct ImageInfo
+		{
+			int width = 0, height = 0;
+			int channels = 0;
+			bool jpeg = false;
+		};
+
+		// Limits on the decoded size of an image.
+		struct Budget
+		{
+			long long maxPixels;
+			long long maxBytes;
+
+			Budget(const long long& maxPixels = 100000000, const long long& maxBytes = 2000000000) : maxPixels(maxPixels), maxBytes(maxBytes) {}
+		};
+
+		// Decoding strategy selected for an image, with its expected size and memory use.
+		struct DecodePlan
+		{
+			Decoding decoding = Decoding::REJECTED;
+			int scale = 1;
+			int width = 0, height = 0;
+			long long bytes = 0;
+		};
+
 	private:
 		int channels_;
 		int width_, height_;
@@ -58,11 +95,19 @@ namespace Vaux
 		void ResizeCanvas(const int& width, const int& height);
 
 		// File functions.
-		const bool LoadFromFile(const char* filename);
-		const bool SaveToFile(const char* filename) const;
+		const bool LoadFromFile(const char* filename, const int& targetWidth = 0, const int& targetHeight = 0, const Budget& budget = Budget());
+		const bool LoadFromMemory(std::span<const std::byte> data, const int& targetWidth = 0, const int& targetHeight = 0, const Budget& budget = Budget());
+		const bool SaveToFile(const char* filename, const PngWriter::Mode& mode = PngWriter::Mode::BALANCED, ThreadPool* pool = nullptr) const;
+
+		// Header functions.
+		static const bool ReadInfo(const char* filename, ImageInfo* info);
+		static const bool ReadInfo(std::span<const std::byte> data, ImageInfo* info);
+		static const DecodePlan PlanDecode(const ImageInfo& info, const int& targetWidth, const int& targetHeight, const Budget& budget = Budget());
 
 	private:
-		const bool SaveToPPM(const char* filename) const;
+		void SetPixels(const unsigned char* data, const int& width, const int& height, const int& channels);
+		const bool SaveToNetpbm(const char* filename, const int& channels) const;
+		void PackRow(const int& y, unsigned char* output) const;
 	};
 }
 
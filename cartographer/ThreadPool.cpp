@@ -0,0 +1,213 @@
+#include "ThreadPool.h"
+
+using namespace Vaux;
+using namespace std;
+
+namespace
+{
+	// Identifies the pool and queue owned by the current worker thread.
+	thread_local const ThreadPool* currentPool = nullptr;
+	thread_local size_t currentQueue = 0;
+}
+
+ThreadPool::ThreadPool(const unsigned int& threads) : queued_(0), pending_(0), waiting_(0), next_(0), stopping_(false)
+{
+	unsigned int count = threads ? threads : DefaultThreadCount();
+
+	// Create a queue for each worker before any worker starts.
+	for (unsigned int i = 0; i < count; i++)
+	{
+		queues_.push_back(make_unique<TaskQueue>());
+	}
+
+	// Start workers.
+	for (unsigned int i = 0; i < count; i++)
+	{
+		threads_.emplace_back(&ThreadPool::WorkerLoop, this, i);
+	}
+}
+ThreadPool::~ThreadPool()
+{
+	// Finish outstanding tasks, then stop workers.
+	Wait();
+
+	{
+		lock_guard<mutex> lock(mutex_);
+		stopping_ = true;
+	}
+	wake_.notify_all();
+
+	for (thread& worker : threads_)
+	{
+		worker.join();
+	}
+}
+
+// Queues a task. Tasks submitted by a worker are queued locally, others are distributed round robin.
+void ThreadPool::Submit(function<void()> task)
+{
+	size_t index;
+	bool waiters;
+
+	{
+		lock_guard<mutex> lock(mutex_);
+		queued_++;
+		pending_++;
+		index = (currentPool == this) ? currentQueue : next_++ % queues_.size();
+		waiters = waiting_ > 0;
+	}
+
+	{
+		TaskQueue& queue = *queues_[index];
+		lock_guard<mutex> lock(queue.mutex);
+		queue.tasks.push_back(move(task));
+	}
+
+	wake_.notify_one();
+
+	// Threads waiting in ParallelFor can run the task too.
+	if (waiters)
+	{
+		idle_.notify_all();
+	}
+}
+// Blocks until all submitted tasks have completed.
+void ThreadPool::Wait()
+{
+	unique_lock<mutex> lock(mutex_);
+	idle_.wait(lock, [this] { return pending_ == 0; });
+}
+// Runs body for each index in [0, count) across the pool, returning once all have completed.
+// Completion is tracked per call, and the calling thread runs queued tasks while it waits, so
+// calls may be nested inside tasks or made from several threads at once.
+void ThreadPool::ParallelFor(const size_t& count, const function<void(size_t)>& body)
+{
+	size_t remaining = count;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		Submit([this, &body, &remaining, i]
+		{
+			body(i);
+
+			lock_guard<mutex> lock(mutex_);
+			if (--remaining == 0)
+			{
+				idle_.notify_all();
+			}
+		});
+	}
+
+	// Help with queued tasks until this call's tasks are complete.
+	size_t index = (currentPool == this) ? currentQueue : 0;
+	unique_lock<mutex> lock(mutex_);
+	waiting_++;
+
+	while (remaining > 0)
+	{
+		if (queued_ == 0)
+		{
+			idle_.wait(lock);
+			continue;
+		}
+
+		lock.unlock();
+
+		function<void()> task;
+		if (TryPop(index, &task))
+		{
+			RunTask(task);
+		}
+		else
+		{
+			// Task is still being pushed, try again.
+			this_thread::yield();
+		}
+
+		lock.lock();
+	}
+
+	waiting_--;
+}
+
+// Returns number of worker threads.
+const unsigned int ThreadPool::GetThreadCount() const
+{
+	return static_cast<unsigned int>(threads_.size());
+}
+// Returns number of hardware threads, or one if unknown.
+const unsigned int ThreadPool::DefaultThreadCount()
+{
+	unsigned int count = thread::hardware_concurrency();
+	return count ? count : 1;
+}
+
+// Runs tasks from the worker's own queue, stealing from other queues when empty.
+void ThreadPool::WorkerLoop(const size_t& index)
+{
+	currentPool = this;
+	currentQueue = index;
+
+	while (true)
+	{
+		// Sleep until a task is queued or the pool is stopping.
+		{
+			unique_lock<mutex> lock(mutex_);
+			wake_.wait(lock, [this] { return queued_ > 0 || stopping_; });
+
+			if (queued_ == 0 && stopping_)
+				return;
+		}
+
+		function<void()> task;
+		if (!TryPop(index, &task))
+		{
+			// Task is still being pushed, try again.
+			this_thread::yield();
+			continue;
+		}
+
+		RunTask(task);
+	}
+}
+// Takes the newest task from the worker's own queue, or the oldest task from another queue.
+const bool ThreadPool::TryPop(const size_t& index, function<void()>* task)
+{
+	for (size_t i = 0; i < queues_.size(); i++)
+	{
+		TaskQueue& queue = *queues_[(index + i) % queues_.size()];
+		lock_guard<mutex> lock(queue.mutex);
+
+		if (!queue.tasks.empty())
+		{
+			if (i == 0)
+			{
+				*task = move(queue.tasks.back());
+				queue.tasks.pop_back();
+			}
+			else
+			{
+				*task = move(queue.tasks.front());
+				queue.tasks.pop_front();
+			}
+
+			// Update count of queued tasks.
+			lock_guard<mutex> countLock(mutex_);
+			queued_--;
+			return true;
+		}
+	}
+
+	return false;
+}
+// Runs a task taken from a queue, then signals waiters once all tasks are complete.
+void ThreadPool::RunTask(function<void()>& task)
+{
+	task();
+
+	lock_guard<mutex> lock(mutex_);
+	if (--pending_ == 0)
+	{
+		idle_.notify_all();
+	}
+}
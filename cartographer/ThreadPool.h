@@ -0,0 +1,61 @@
+#ifndef THREAD_POOL_H_
+#define THREAD_POOL_H_
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Vaux
+{
+	// Fixed size thread pool. Each worker owns a task queue, idle workers steal from the others.
+	class ThreadPool
+	{
+	private:
+		struct TaskQueue
+		{
+			std::mutex mutex;
+			std::deque<std::function<void()>> tasks;
+		};
+
+		std::vector<std::unique_ptr<TaskQueue>> queues_;
+		std::vector<std::thread> threads_;
+
+		std::mutex mutex_;
+		std::condition_variable wake_;
+		std::condition_variable idle_;
+		size_t queued_;
+		size_t pending_;
+		size_t waiting_;
+		size_t next_;
+		bool stopping_;
+
+	public:
+		ThreadPool(const unsigned int& threads = 0);
+		ThreadPool(const ThreadPool&) = delete;
+		~ThreadPool();
+
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+		// Task functions. Wait must not be called from a task, ParallelFor may be, and runs queued
+		// tasks while its own are outstanding.
+		void Submit(std::function<void()> task);
+		void Wait();
+		void ParallelFor(const size_t& count, const std::function<void(size_t)>& body);
+
+		// Size functions.
+		const unsigned int GetThreadCount() const;
+		static const unsigned int DefaultThreadCount();
+
+	private:
+		void WorkerLoop(const size_t& index);
+		const bool TryPop(const size_t& index, std::function<void()>* task);
+		void RunTask(std::function<void()>& task);
+	};
+}
+
+#endif //THREAD_POOL_H_
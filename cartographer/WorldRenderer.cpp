@@ -0,0 +1,661 @@
+#include "WorldRenderer.h"
+#include "Compression.h"
+#include "MapManifest.h"
+#include "PngWriter.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <semaphore>
+#include <set>
+#include <string>
+#include <vector>
+
+using namespace Cartographer;
+using namespace Vaux;
+using namespace std;
+
+namespace
+{
+    // Largest map scale used by Minecraft, each map pixel covers 2^scale blocks.
+    const int maxScale = 4;
+
+    // Map placed within an atlas. Colours are only loaded while the atlas rows cross the map.
+    struct AtlasMap
+    {
+        int id = 0;
+        filesystem::path path;
+        int scale = 0;
+        int64_t left = 0, top = 0;
+        unique_ptr<MCMapData> colours;
+    };
+
+    // Manifest kept alongside rendered images by incremental renders.
+    const char* manifestName = "cartographer.manifest";
+
+    // Returns the ID from a map_<id>.dat file name.
+    const int MapID(const filesystem::path& path)
+    {
+        return atoi(path.filename().string().c_str() + 4);
+    }
+
+    // Returns the path of a map file from its ID.
+    const filesystem::path MapPath(const filesystem::path& dataPath, const int& id)
+    {
+        return dataPath / ("map_" + to_string(id) + ".dat");
+    }
+
+    // Rounds a division towards negative infinity.
+    const int64_t FloorDivide(const int64_t& a, const int64_t& b)
+    {
+        return (a >= 0) ? a / b : -((-a + b - 1) / b);
+    }
+
+    // Hashes a string, used to compare dimensions without storing their names.
+    const uint64_t HashString(const string& value)
+    {
+        return Compression::Hash64(span<const uint8_t>(reinterpret_cast<const uint8_t*>(value.data()), value.size()));
+    }
+
+    // Hashes the palette and PNG mode, so output drawn with other settings is never reused.
+    const uint64_t SettingsHash(const MCPalette& palette, const PngWriter::Mode& pngMode)
+    {
+        int mode = static_cast<int>(pngMode);
+        return Compression::Hash64(span<const uint8_t>(reinterpret_cast<const uint8_t*>(&mode), sizeof(mode)), palette.GetHash());
+    }
+
+    // Reads the size and modification time of a map file into a manifest entry.
+    const bool StatFile(const filesystem::path& path, MapManifestEntry* entry)
+    {
+        error_code error;
+        entry->size = filesystem::file_size(path, error);
+        if (error)
+            return false;
+
+        entry->modified = filesystem::last_write_time(path, error).time_since_epoch().count();
+        return !error;
+    }
+
+    // Returns true if a file exists, treating errors as missing files.
+    const bool FileExists(const filesystem::path& path)
+    {
+        error_code error;
+        return filesystem::exists(path, error);
+    }
+
+    // Returns true if a map file has the same size and modification time as when it was last rendered.
+    const bool IsUnchanged(const MapManifestEntry* previous, const MapManifestEntry& current)
+    {
+        return previous && previous->size == current.size && previous->modified == current.modified;
+    }
+
+    // Fills the placement and content hashes of a manifest entry.
+    void DescribeMap(const MCMapData& map, const MCMapInfo& info, MapManifestEntry* entry)
+    {
+        entry->scale = clamp(info.scale, 0, maxScale);
+        entry->xCenter = info.xCenter;
+        entry->zCenter = info.zCenter;
+        entry->colourHash = Compression::Hash64(map.GetData());
+        entry->dimensionHash = HashString(info.dimension);
+    }
+}
+
+WorldRenderer::WorldRenderer(const filesystem::path& worldPath, const PngWriter::Mode& pngMode) : dataPath_(worldPath / "data"), pngMode_(pngMode)
+{
+    // Default constructor.
+}
+
+// Renders each map in the world to <outputPath>/map_<id>.png. Files are enumerated as they are
+// rendered, so only a fixed number of maps per thread are held in memory at once. Incremental renders
+// skip maps whose file is unchanged since the last run, or whose colours hash to the same value.
+const bool WorldRenderer::RenderMaps(const filesystem::path& outputPath, const MCPalette& palette, ThreadPool& pool, Result* result, const bool& incremental)
+{
+    auto start = chrono::steady_clock::now();
+
+    error_code error;
+    filesystem::directory_iterator entry(dataPath_, error);
+    if (error)
+        return false;
+
+    filesystem::create_directories(outputPath, error);
+
+    // Map manifest of the previous run. Maps rendered with another palette or PNG mode are redrawn.
+    filesystem::path manifestPath = outputPath / manifestName;
+    uint64_t settingsHash = SettingsHash(palette, pngMode_);
+    MapManifest manifest;
+    if (incremental)
+        manifest.Load(manifestPath);
+
+    bool reuse = manifest.GetSettingsHash() == settingsHash;
+
+    vector<MapManifestEntry> entries;
+    vector<int32_t> found;
+    mutex entriesMutex;
+
+    atomic<size_t> rendered = 0;
+    atomic<size_t> skipped = 0;
+    atomic<size_t> failed = 0;
+
+    // Limit the number of queued maps.
+    counting_semaphore<> slots(static_cast<ptrdiff_t>(pool.GetThreadCount() * queueDepth));
+
+    for (; entry != filesystem::directory_iterator(); entry.increment(error))
+    {
+        if (error)
+            break;
+
+        if (!IsMapFile(entry->path()))
+            continue;
+
+        filesystem::path inputPath = entry->path();
+        filesystem::path imagePath = outputPath / inputPath.filename().replace_extension(".png");
+
+        MapManifestEntry record = {};
+        record.id = MapID(inputPath);
+        found.push_back(record.id);
+
+        // Skip files which haven't been modified, without reading them.
+        const MapManifestEntry* previous = nullptr;
+        if (incremental && reuse && StatFile(inputPath, &record))
+        {
+            previous = manifest.Find(record.id);
+
+            if (IsUnchanged(previous, record) && FileExists(imagePath))
+            {
+                lock_guard<mutex> lock(entriesMutex);
+                entries.push_back(*previous);
+                skipped++;
+                continue;
+            }
+        }
+
+        slots.acquire();
+
+        // Maps redrawn with new settings still record their size and modification time.
+        if (incremental && !reuse)
+            StatFile(inputPath, &record);
+
+        pool.Submit([&, inputPath, imagePath, record, previous]() mutable
+        {
+            // Decompress colours, metadata is only needed for the manifest.
+            MCMapData map;
+            MCMapInfo info;
+            bool success = map.LoadFromDatFile(inputPath.string().c_str(), incremental ? &info : nullptr);
+            bool changed = true;
+
+            if (success && incremental)
+            {
+                // Skip maps which were modified without their colours changing.
+                DescribeMap(map, info, &record);
+                changed = !previous || previous->colourHash != record.colourHash || !FileExists(imagePath);
+            }
+
+            if (success && changed)
+            {
+                // Colour IDs are written as palette indices, so maps are never expanded to RGBA.
+                success = palette.SaveIndexedPng(imagePath.string().c_str(), map, pngMode_);
+            }
+
+            if (!success)
+                failed++;
+            else if (changed)
+                rendered++;
+            else
+                skipped++;
+
+            // Record rendered maps, failed maps are retried next run.
+            if (success && incremental)
+            {
+                lock_guard<mutex> lock(entriesMutex);
+                entries.push_back(record);
+            }
+
+            slots.release();
+        });
+    }
+
+    pool.Wait();
+
+    // Remove images of deleted maps, then replace the manifest.
+    if (incremental)
+    {
+        sort(found.begin(), found.end());
+        for (const MapManifestEntry& previous : manifest.GetEntries())
+        {
+            if (!binary_search(found.begin(), found.end(), previous.id))
+            {
+                error_code removeError;
+                filesystem::remove(outputPath / ("map_" + to_string(previous.id) + ".png"), removeError);
+            }
+        }
+
+        manifest.Close();
+        if (!MapManifest::Save(manifestPath, &entries, settingsHash))
+            failed++;
+    }
+
+    result->rendered = rendered;
+    result->skipped = skipped;
+    result->failed = failed;
+    result->seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    return !error && failed == 0;
+}
+
+// Stitches every map in a dimension into one image. Maps are placed using their centre and scale,
+// one atlas pixel covers the area of a pixel in the most detailed map. Where maps overlap the map with
+// the higher ID, which was created later, is drawn on top.
+const bool WorldRenderer::RenderAtlas(const filesystem::path& outputFile, const MCPalette& palette, ThreadPool& pool, const string& dimension, const long long& maxPixels, Result* result)
+{
+    auto start = chrono::steady_clock::now();
+
+    // Find map files.
+    vector<AtlasMap> maps;
+    error_code error;
+    for (filesystem::directory_iterator entry(dataPath_, error); !error && entry != filesystem::directory_iterator(); entry.increment(error))
+    {
+        if (IsMapFile(entry->path()))
+        {
+            AtlasMap map;
+            map.id = MapID(entry->path());
+            map.path = entry->path();
+            maps.push_back(move(map));
+        }
+    }
+
+    if (error)
+        return false;
+
+    // Read map metadata in parallel, marking maps from other dimensions.
+    vector<uint8_t> placed(maps.size(), 0);
+    atomic<size_t> failed = 0;
+
+    pool.ParallelFor(maps.size(), [&](size_t i)
+    {
+        MCMapData map;
+        MCMapInfo info;
+        if (!map.LoadFromDatFile(maps[i].path.string().c_str(), &info))
+        {
+            failed++;
+            return;
+        }
+
+        int size = MCMapData::defaultWidth << clamp(info.scale, 0, maxScale);
+        maps[i].scale = clamp(info.scale, 0, maxScale);
+        maps[i].left = info.xCenter - size / 2;
+        maps[i].top = info.zCenter - size / 2;
+        placed[i] = info.dimension == dimension;
+    });
+
+    // Remove unused maps, order the rest from top to bottom.
+    size_t count = 0;
+    for (size_t i = 0; i < maps.size(); i++)
+    {
+        if (placed[i])
+            maps[count++] = move(maps[i]);
+    }
+    maps.resize(count);
+
+    sort(maps.begin(), maps.end(), [](const AtlasMap& a, const AtlasMap& b) { return a.top < b.top; });
+
+    result->rendered = 0;
+    result->failed = failed;
+
+    // Maps which can't be read have no known position, so the atlas bounds would be wrong.
+    if (failed > 0 || maps.empty())
+        return false;
+
+    // Find atlas bounds, in blocks.
+    int minScale = maxScale;
+    int64_t left = maps[0].left, top = maps[0].top, right = left, bottom = top;
+    for (const AtlasMap& map : maps)
+    {
+        int64_t size = static_cast<int64_t>(MCMapData::defaultWidth) << map.scale;
+        minScale = min(minScale, map.scale);
+        left = min(left, map.left);
+        top = min(top, map.top);
+        right = max(right, map.left + size);
+        bottom = max(bottom, map.top + size);
+    }
+
+    // Size atlas so each pixel covers one pixel of the most detailed map.
+    int64_t unit = int64_t(1) << minScale;
+    int64_t width = (right - left + unit - 1) / unit;
+    int64_t height = (bottom - top + unit - 1) / unit;
+
+    if (width > INT32_MAX / 4 || height > INT32_MAX)
+        return false;
+
+    result->width = static_cast<int>(width);
+    result->height = static_cast<int>(height);
+
+    if (width * height > maxPixels)
+        return false;
+
+    PngWriter writer(pngMode_, &pool);
+    if (!writer.Open(outputFile.string().c_str(), result->width, result->height))
+        return false;
+
+    vector<uint8_t> row(static_cast<size_t>(width) * 4);
+    vector<uint8_t> expanded(MCMapData::defaultWidth * 4);
+    vector<AtlasMap*> active;
+    size_t next = 0;
+
+    for (int64_t y = 0; y < height; y++)
+    {
+        int64_t z = top + y * unit;
+
+        // Release maps which end above this row.
+        active.erase(remove_if(active.begin(), active.end(), [&](AtlasMap* map)
+        {
+            if (z < map->top + (static_cast<int64_t>(MCMapData::defaultHeight) << map->scale))
+                return false;
+
+            map->colours.reset();
+            return true;
+        }), active.end());
+
+        // Load maps which start on this row in parallel.
+        size_t first = next;
+        while (next < maps.size() && maps[next].top <= z)
+        {
+            next++;
+        }
+
+        if (next > first)
+        {
+            pool.ParallelFor(next - first, [&](size_t i)
+            {
+                unique_ptr<MCMapData> colours = make_unique<MCMapData>();
+                if (colours->LoadFromDatFile(maps[first + i].path.string().c_str()))
+                    maps[first + i].colours = move(colours);
+            });
+
+            for (size_t i = first; i < next; i++)
+            {
+                if (maps[i].colours)
+                {
+                    active.push_back(&maps[i]);
+                    result->rendered++;
+                }
+                else
+                {
+                    result->failed++;
+                }
+            }
+
+            // Draw newer maps last.
+            sort(active.begin(), active.end(), [](const AtlasMap* a, const AtlasMap* b) { return a->id < b->id; });
+        }
+
+        // Compose row, transparent map pixels leave older maps visible.
+        fill(row.begin(), row.end(), 0);
+        for (const AtlasMap* map : active)
+        {
+            int64_t size = static_cast<int64_t>(MCMapData::defaultWidth) << map->scale;
+            int localY = static_cast<int>((z - map->top) >> map->scale);
+            palette.Expand(MCMapView(*map->colours, 0, localY, MCMapData::defaultWidth, 1), expanded.data());
+
+            int64_t firstX = (map->left - left + unit - 1) / unit;
+            int64_t lastX = min(width, (map->left + size - left + unit - 1) / unit);
+
+            for (int64_t x = firstX; x < lastX; x++)
+            {
+                const uint8_t* pixel = &expanded[((left + x * unit - map->left) >> map->scale) * 4];
+                if (pixel[3] != 0)
+                    memcpy(&row[x * 4], pixel, 4);
+            }
+        }
+
+        if (!writer.WriteRow(row))
+            return false;
+    }
+
+    bool success = writer.Close();
+    result->seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    return success && result->failed == 0;
+}
+
+// Redraws the atlas tiles of a dimension which contain maps changed since the last run. Tiles are
+// written to <outputPath>/tile_<x>_<z>.png, each covering tileSize blocks with one pixel per block.
+// Placements of unchanged maps come from the manifest, so only changed maps and the maps sharing
+// their tiles are read.
+const bool WorldRenderer::RenderAtlasTiles(const filesystem::path& outputPath, const MCPalette& palette, ThreadPool& pool, const string& dimension, Result* result)
+{
+    auto start = chrono::steady_clock::now();
+
+    // Find map files, reading their size and modification time.
+    vector<MapManifestEntry> entries;
+    error_code error;
+    for (filesystem::directory_iterator entry(dataPath_, error); !error && entry != filesystem::directory_iterator(); entry.increment(error))
+    {
+        MapManifestEntry record = {};
+        if (IsMapFile(entry->path()) && StatFile(entry->path(), &record))
+        {
+            record.id = MapID(entry->path());
+            entries.push_back(record);
+        }
+    }
+
+    if (error)
+        return false;
+
+    filesystem::create_directories(outputPath, error);
+
+    // Map manifest of the previous run. With another palette or PNG mode every map counts as changed,
+    // so all tiles are redrawn.
+    filesystem::path manifestPath = outputPath / manifestName;
+    uint64_t settingsHash = SettingsHash(palette, pngMode_);
+    MapManifest manifest;
+    manifest.Load(manifestPath);
+
+    bool reuse = manifest.GetSettingsHash() == settingsHash;
+
+    // Describe modified maps in parallel, unmodified maps keep their manifest entry.
+    vector<uint8_t> valid(entries.size(), 1);
+    vector<uint8_t> changed(entries.size(), 0);
+    atomic<size_t> failed = 0;
+
+    pool.ParallelFor(entries.size(), [&](size_t i)
+    {
+        const MapManifestEntry* previous = manifest.Find(entries[i].id);
+        if (reuse && IsUnchanged(previous, entries[i]))
+        {
+            entries[i] = *previous;
+            return;
+        }
+
+        MCMapData map;
+        MCMapInfo info;
+        if (!map.LoadFromDatFile(MapPath(dataPath_, entries[i].id).string().c_str(), &info))
+        {
+            valid[i] = 0;
+            failed++;
+            return;
+        }
+
+        DescribeMap(map, info, &entries[i]);
+
+        changed[i] = !reuse || !previous || previous->colourHash != entries[i].colourHash || previous->dimensionHash != entries[i].dimensionHash
+            || previous->scale != entries[i].scale || previous->xCenter != entries[i].xCenter || previous->zCenter != entries[i].zCenter;
+    });
+
+    // Collect tiles covered by a map, before and after it changed.
+    uint64_t dimensionHash = HashString(dimension);
+    set<pair<int64_t, int64_t>> tiles;
+
+    auto addTiles = [&](const MapManifestEntry& entry)
+    {
+        if (entry.dimensionHash != dimensionHash)
+            return;
+
+        int64_t size = static_cast<int64_t>(MCMapData::defaultWidth) << entry.scale;
+        int64_t left = entry.xCenter - size / 2;
+        int64_t top = entry.zCenter - size / 2;
+
+        for (int64_t z = FloorDivide(top, tileSize); z <= FloorDivide(top + size - 1, tileSize); z++)
+        {
+            for (int64_t x = FloorDivide(left, tileSize); x <= FloorDivide(left + size - 1, tileSize); x++)
+            {
+                tiles.insert({ x, z });
+            }
+        }
+    };
+
+    size_t count = 0;
+    size_t unchanged = 0;
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        if (!valid[i])
+            continue;
+
+        if (!changed[i])
+        {
+            unchanged++;
+        }
+        else
+        {
+            const MapManifestEntry* previous = manifest.Find(entries[i].id);
+            if (previous)
+                addTiles(*previous);
+
+            addTiles(entries[i]);
+        }
+
+        entries[count++] = entries[i];
+    }
+    entries.resize(count);
+
+    sort(entries.begin(), entries.end(), [](const MapManifestEntry& a, const MapManifestEntry& b) { return a.id < b.id; });
+
+    // Tiles of deleted maps.
+    for (const MapManifestEntry& previous : manifest.GetEntries())
+    {
+        if (!binary_search(entries.begin(), entries.end(), previous, [](const MapManifestEntry& a, const MapManifestEntry& b) { return a.id < b.id; }))
+            addTiles(previous);
+    }
+
+    manifest.Close();
+
+    // Redraw tiles in parallel.
+    vector<pair<int64_t, int64_t>> tileList(tiles.begin(), tiles.end());
+    atomic<size_t> rendered = 0;
+    atomic<bool> complete = true;
+
+    pool.ParallelFor(tileList.size(), [&](size_t t)
+    {
+        int64_t tileLeft = tileList[t].first * tileSize;
+        int64_t tileTop = tileList[t].second * tileSize;
+        filesystem::path tilePath = outputPath / ("tile_" + to_string(tileList[t].first) + "_" + to_string(tileList[t].second) + ".png");
+
+        vector<uint8_t> pixels(static_cast<size_t>(tileSize) * tileSize * 4, 0);
+        vector<uint8_t> expanded(MCMapData::defaultWidth * 4);
+        bool empty = true;
+
+        // Draw maps in ID order, so newer maps are drawn on top.
+        for (const MapManifestEntry& entry : entries)
+        {
+            if (entry.dimensionHash != dimensionHash)
+                continue;
+
+            int64_t size = static_cast<int64_t>(MCMapData::defaultWidth) << entry.scale;
+            int64_t left = entry.xCenter - size / 2;
+            int64_t top = entry.zCenter - size / 2;
+
+            // Find blocks covered by both map and tile.
+            int64_t startX = max(left, tileLeft), endX = min(left + size, tileLeft + tileSize);
+            int64_t startZ = max(top, tileTop), endZ = min(top + size, tileTop + tileSize);
+            if (startX >= endX || startZ >= endZ)
+                continue;
+
+            MCMapData map;
+            if (!map.LoadFromDatFile(MapPath(dataPath_, entry.id).string().c_str()))
+            {
+                failed++;
+                continue;
+            }
+
+            empty = false;
+            int lastRow = -1;
+
+            for (int64_t z = startZ; z < endZ; z++)
+            {
+                // Expand each map row once, scaled maps cover several tile rows per map row.
+                int row = static_cast<int>((z - top) >> entry.scale);
+                if (row != lastRow)
+                {
+                    palette.Expand(MCMapView(map, 0, row, MCMapData::defaultWidth, 1), expanded.data());
+                    lastRow = row;
+                }
+
+                uint8_t* output = &pixels[((z - tileTop) * tileSize + (startX - tileLeft)) * 4];
+                for (int64_t x = startX; x < endX; x++, output += 4)
+                {
+                    const uint8_t* pixel = &expanded[((x - left) >> entry.scale) * 4];
+                    if (pixel[3] != 0)
+                        memcpy(output, pixel, 4);
+                }
+            }
+        }
+
+        // Remove tiles which no longer contain any maps.
+        if (empty)
+        {
+            error_code removeError;
+            filesystem::remove(tilePath, removeError);
+            return;
+        }
+
+        PngWriter writer(pngMode_);
+        bool success = writer.Open(tilePath.string().c_str(), tileSize, tileSize);
+        for (int y = 0; y < tileSize && success; y++)
+        {
+            success = writer.WriteRow(span<const uint8_t>(&pixels[static_cast<size_t>(y) * tileSize * 4], static_cast<size_t>(tileSize) * 4));
+        }
+
+        if (writer.Close() && success)
+        {
+            rendered++;
+        }
+        else
+        {
+            failed++;
+            complete = false;
+        }
+    });
+
+    // Replace manifest, removing deleted maps. If a tile couldn't be written the old manifest is
+    // kept, so the same tiles are redrawn next run.
+    if (complete && !MapManifest::Save(manifestPath, &entries, settingsHash))
+        failed++;
+
+    result->rendered = rendered;
+    result->skipped = unchanged;
+    result->failed = failed;
+    result->seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    return failed == 0;
+}
+
+// Returns true if a file name has the form map_<id>.dat.
+const bool WorldRenderer::IsMapFile(const filesystem::path& path)
+{
+    string name = path.filename().string();
+
+    if (name.size() <= 8 || name.compare(0, 4, "map_") != 0 || path.extension() != ".dat")
+        return false;
+
+    // Check ID is numeric.
+    for (size_t i = 4; i < name.size() - 4; i++)
+    {
+        if (name[i] < '0' || name[i] > '9')
+            return false;
+    }
+
+    return true;
+}
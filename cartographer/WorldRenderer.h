@@ -0,0 +1,62 @@
+#ifndef WORLD_RENDERER_H_
+#define WORLD_RENDERER_H_
+
+#include "MCPalette.h"
+#include "PngWriter.h"
+#include "ThreadPool.h"
+
+#include <cstddef>
+#include <filesystem>
+#include <string>
+
+namespace Cartographer
+{
+	// Renders every map_<id>.dat file in a Minecraft world save to a PNG file.
+	class WorldRenderer
+	{
+	public:
+		// Maps queued per worker thread. Limits memory use regardless of the number of maps.
+		static constexpr unsigned int queueDepth = 4;
+
+		// Width and height of atlas tiles, in blocks.
+		static constexpr int tileSize = 1024;
+
+		struct Result
+		{
+			size_t rendered = 0;
+			size_t skipped = 0;
+			size_t failed = 0;
+			double seconds = 0.0;
+			int width = 0;
+			int height = 0;
+		};
+
+	private:
+		std::filesystem::path dataPath_;
+		Vaux::PngWriter::Mode pngMode_;
+
+	public:
+		WorldRenderer(const std::filesystem::path& worldPath, const Vaux::PngWriter::Mode& pngMode = Vaux::PngWriter::Mode::BALANCED);
+
+		// Render functions. Maps are decompressed, rendered and encoded in parallel. Incremental
+		// renders keep a manifest in the output directory and skip maps which haven't changed.
+		// Map images and atlas tiles are encoded one per thread, so parallel PNG encoding is only
+		// used for single file atlases.
+		const bool RenderMaps(const std::filesystem::path& outputPath, const MCPalette& palette, Vaux::ThreadPool& pool, Result* result, const bool& incremental = false);
+
+		// Atlas functions. Maps from one dimension are stitched into a single PNG file at their world
+		// positions, the image is encoded one row at a time so it is never held in memory. Atlases
+		// larger than maxPixels, such as maps far apart leaving a mostly empty image, are refused
+		// with their size stored in the result. Maps which can't be read are counted in the result
+		// and fail the atlas.
+		const bool RenderAtlas(const std::filesystem::path& outputFile, const MCPalette& palette, Vaux::ThreadPool& pool, const std::string& dimension, const long long& maxPixels, Result* result);
+
+		// Tiled atlas functions. Only tiles containing maps changed since the last run are redrawn.
+		const bool RenderAtlasTiles(const std::filesystem::path& outputPath, const MCPalette& palette, Vaux::ThreadPool& pool, const std::string& dimension, Result* result);
+
+		// Path functions.
+		static const bool IsMapFile(const std::filesystem::path& path);
+	};
+}
+
+#endif //WORLD_RENDERER_H_
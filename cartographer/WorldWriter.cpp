@@ -0,0 +1,300 @@
+#include "WorldWriter.h"
+#include "Compression.h"
+#include "NBT.h"
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <thread>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#endif
+
+using namespace Cartographer;
+using namespace Vaux;
+using namespace std;
+
+namespace
+{
+    // Lock which is held for the lifetime of the object. The operating system releases the lock
+    // when its owner exits, so a run which crashed never leaves the world locked. The lock file
+    // itself is left in place, removing it would let another process lock a file nobody else sees.
+    class LockFile
+    {
+    private:
+        filesystem::path path_;
+#ifdef _WIN32
+        HANDLE file_;
+#else
+        int file_;
+#endif
+
+    public:
+#ifdef _WIN32
+        LockFile(const filesystem::path& path) : path_(path), file_(INVALID_HANDLE_VALUE)
+#else
+        LockFile(const filesystem::path& path) : path_(path), file_(-1)
+#endif
+        {
+            // Default constructor.
+        }
+        ~LockFile()
+        {
+            // Release lock.
+#ifdef _WIN32
+            if (file_ != INVALID_HANDLE_VALUE)
+                CloseHandle(file_);
+#else
+            if (file_ >= 0)
+                close(file_);
+#endif
+        }
+
+        // Attempts to lock the file, retrying until timeout.
+        const bool Acquire(const int& timeout)
+        {
+            auto deadline = chrono::steady_clock::now() + chrono::milliseconds(timeout);
+
+#ifdef _WIN32
+            file_ = CreateFileW(path_.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (file_ == INVALID_HANDLE_VALUE)
+                return false;
+#else
+            file_ = open(path_.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+            if (file_ < 0)
+                return false;
+#endif
+
+            while (!TryLock())
+            {
+                if (chrono::steady_clock::now() >= deadline)
+                    return false;
+
+                this_thread::sleep_for(chrono::milliseconds(20));
+            }
+
+            return true;
+        }
+
+    private:
+        // Takes the lock without waiting.
+        const bool TryLock()
+        {
+#ifdef _WIN32
+            OVERLAPPED overlapped = {};
+            return LockFileEx(file_, LOCKFILE_EXCLUSIVE_LOCK | LOCKFILE_FAIL_IMMEDIATELY, 0, 1, 0, &overlapped) != FALSE;
+#else
+            while (flock(file_, LOCK_EX | LOCK_NB) != 0)
+            {
+                if (errno != EINTR)
+                    return false;
+            }
+
+            return true;
+#endif
+        }
+    };
+
+    // Reads the last allocated map ID from idcounts.dat. Missing files leave the ID unchanged.
+    const bool ReadLastMapID(const filesystem::path& path, int* lastID, int* dataVersion)
+    {
+        // Open ID file.
+        ifstream inputData;
+        inputData.open(path, ios::in | ios::binary | ios::ate);
+
+        // A missing file means no maps have been allocated.
+        if (!inputData.is_open())
+            return !filesystem::exists(path);
+
+        // Read compressed file in a single call.
+        vector<uint8_t> fileData(static_cast<size_t>(inputData.tellg()));
+        inputData.seekg(0, ios::beg);
+        inputData.read(reinterpret_cast<char*>(fileData.data()), fileData.size());
+        inputData.close();
+
+        vector<uint8_t> nbt;
+        if (!Compression::DecompressGzip(fileData, &nbt))
+            return false;
+
+        NBTReader reader(nbt);
+        NBTTag type;
+        string_view name;
+
+        // Check for root compound.
+        if (!reader.ReadHeader(&type, &name) || type != NBTTag::COMPOUND)
+            return false;
+
+        // Find map counter within data compound.
+        while (reader.ReadHeader(&type, &name) && type != NBTTag::END)
+        {
+            if (name == "DataVersion")
+            {
+                *dataVersion = static_cast<int>(reader.ReadInteger(type));
+            }
+            else if (name == "data" && type == NBTTag::COMPOUND)
+            {
+                while (reader.ReadHeader(&type, &name) && type != NBTTag::END)
+                {
+                    if (name == "map")
+                    {
+                        *lastID = static_cast<int>(reader.ReadInteger(type));
+                    }
+                    else
+                    {
+                        reader.Skip(type);
+                    }
+                }
+            }
+            else
+            {
+                reader.Skip(type);
+            }
+        }
+
+        return reader.IsValid();
+    }
+}
+
+WorldWriter::WorldWriter(const filesystem::path& worldPath) : dataPath_(worldPath / "data")
+{
+    // Default constructor.
+}
+
+// Reserves a contiguous range of map IDs by advancing the counter in idcounts.dat.
+// Other instances of the writer are excluded by a lock file while the counter is updated.
+const bool WorldWriter::ReserveIDs(const int& count, int* firstID)
+{
+    error_code error;
+    filesystem::create_directories(dataPath_, error);
+
+    filesystem::path countPath = dataPath_ / "idcounts.dat";
+
+    // Lock ID counter.
+    LockFile lock(GetLockPath());
+    if (!lock.Acquire(lockTimeout))
+        return false;
+
+    // Read current counter.
+    int lastID = -1;
+    int dataVersion = MCMapInfo().dataVersion;
+    if (!ReadLastMapID(countPath, &lastID, &dataVersion))
+        return false;
+
+    // Build updated counter.
+    vector<uint8_t> nbt;
+    NBTWriter writer(&nbt);
+    writer.BeginCompound("");
+    writer.BeginCompound("data");
+    writer.WriteInt("map", lastID + count);
+    writer.EndCompound();
+    writer.WriteInt("DataVersion", dataVersion);
+    writer.EndCompound();
+
+    // Replace counter file.
+    vector<uint8_t> fileData;
+    if (!Compression::CompressGzip(nbt, &fileData) || !WriteFileAtomic(countPath, fileData))
+        return false;
+
+    *firstID = lastID + 1;
+    return true;
+}
+
+// Compresses and writes maps in parallel, using IDs starting from firstID.
+const bool WorldWriter::WriteMaps(span<const MCMapView> maps, const int& firstID, ThreadPool& pool, const MCMapInfo& info)
+{
+    atomic<bool> success = true;
+
+    pool.ParallelFor(maps.size(), [&](size_t i)
+    {
+        // Encode map, then replace map file.
+        vector<uint8_t> fileData;
+        if (!maps[i].SaveToDat(&fileData, info) || !WriteFileAtomic(GetMapPath(firstID + static_cast<int>(i)), fileData))
+        {
+            success = false;
+        }
+    });
+
+    return success;
+}
+// Writes maps with their own placement, such as rendered terrain. Info is given for each map.
+const bool WorldWriter::WriteMaps(span<const MCMapView> maps, const int& firstID, ThreadPool& pool, span<const MCMapInfo> info)
+{
+    if (info.size() != maps.size())
+        return false;
+
+    atomic<bool> success = true;
+
+    pool.ParallelFor(maps.size(), [&](size_t i)
+    {
+        // Encode map, then replace map file.
+        vector<uint8_t> fileData;
+        if (!maps[i].SaveToDat(&fileData, info[i]) || !WriteFileAtomic(GetMapPath(firstID + static_cast<int>(i)), fileData))
+        {
+            success = false;
+        }
+    });
+
+    return success;
+}
+
+// Returns path of the map file for an ID.
+const filesystem::path WorldWriter::GetMapPath(const int& id) const
+{
+    return dataPath_ / ("map_" + to_string(id) + ".dat");
+}
+// Checks whether another process holds the ID counter lock.
+const bool WorldWriter::IsLocked() const
+{
+    if (!filesystem::exists(GetLockPath()))
+        return false;
+
+    LockFile lock(GetLockPath());
+    return !lock.Acquire(0);
+}
+
+// Returns the lock file held while the ID counter is updated.
+const filesystem::path WorldWriter::GetLockPath() const
+{
+    return dataPath_ / "idcounts.dat.lock";
+}
+
+// Writes data to a temporary file, then renames it over the target so readers never see a partial file.
+const bool WorldWriter::WriteFileAtomic(const filesystem::path& path, span<const uint8_t> data)
+{
+    filesystem::path temporaryPath = path;
+    temporaryPath += ".tmp";
+
+    // Write temporary file in a single call.
+    ofstream outputData;
+    outputData.open(temporaryPath, ios::out | ios::binary | ios::trunc);
+
+    if (!outputData.is_open())
+        return false;
+
+    outputData.write(reinterpret_cast<const char*>(data.data()), data.size());
+    outputData.close();
+
+    // Move temporary file into place.
+    error_code error;
+    if (!outputData.fail())
+    {
+        filesystem::rename(temporaryPath, path, error);
+    }
+
+    if (outputData.fail() || error)
+    {
+        filesystem::remove(temporaryPath, error);
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,46 @@
+#ifndef WORLD_WRITER_H_
+#define WORLD_WRITER_H_
+
+#include "MCMapData.h"
+#include "ThreadPool.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <vector>
+
+namespace Cartographer
+{
+	// Installs maps into a Minecraft world save as map_<id>.dat files.
+	class WorldWriter
+	{
+	public:
+		// Time to wait for another process to release idcounts.dat, in milliseconds. Locks are
+		// released by the operating system when their owner exits, so a crash never leaves one behind.
+		static constexpr int lockTimeout = 10000;
+
+	private:
+		std::filesystem::path dataPath_;
+
+	public:
+		WorldWriter(const std::filesystem::path& worldPath);
+
+		// ID functions.
+		const bool ReserveIDs(const int& count, int* firstID);
+		const bool IsLocked() const;
+
+		// Map functions. Maps are compressed in parallel and written with consecutive IDs.
+		// Views allow the tiles of a map wall to be written without copying.
+		const bool WriteMaps(std::span<const MCMapView> maps, const int& firstID, Vaux::ThreadPool& pool, const MCMapInfo& info = MCMapInfo());
+		const bool WriteMaps(std::span<const MCMapView> maps, const int& firstID, Vaux::ThreadPool& pool, std::span<const MCMapInfo> info);
+
+		// Path functions.
+		const std::filesystem::path GetMapPath(const int& id) const;
+		const std::filesystem::path GetLockPath() const;
+
+		// File functions.
+		static const bool WriteFileAtomic(const std::filesystem::path& path, std::span<const uint8_t> data);
+	};
+}
+
+#endif //WORLD_WRITER_H_
@@ -5,10 +5,43 @@
 #include <vector>
 #include <filesystem>
 #include <cmath>
+#include <atomic>
+#include <cstring>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_set>
+#include <unordered_map>
+#include <numeric>
+#include <climits>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
 
 #include "Vector3.h"
 #include "Texture.h"
 #include "MCMapData.h"
+#include "MCPalette.h"
+#include "ThreadPool.h"
+#include "BoundedQueue.h"
+#include "WorldWriter.h"
+#include "WorldRenderer.h"
+#include "TerrainRenderer.h"
+#include "BlockColours.h"
+#include "PngWriter.h"
+#include "Netpbm.h"
+#include "NetpbmWriter.h"
+#include "QoiWriter.h"
+#include "MappedFile.h"
+#include "FileBatch.h"
+#include "Compression.h"
+#include "MapArchive.h"
+#include "DitherState.h"
 
 using namespace std;
 using namespace Vaux;
@@ -43,23 +76,322 @@ enum class DitherType
     FLOYD_STEINBERG
 };
 
+// Largest enlargement of images made from maps, and the colour of lines between maps.
+const int maxZoom = 64;
+const uint8_t gridColour[4] = { 0, 0, 0, 255 };
+
+// Conversion of one input file, with an estimate of the memory it needs.
+struct ConversionJob
+{
+    string inputFile;
+    string outputFile;
+    bool image = false;
+    long long bytes = 0;
+};
+
+// Thread counts for the stages of batch conversion, zero sizes a stage automatically.
+struct PipelineThreads
+{
+    unsigned int load = 0;
+    unsigned int convert = 0;
+    unsigned int save = 0;
+};
+
+// File passed between the stages of batch conversion.
+struct PipelineItem
+{
+    size_t job = 0;
+    long long bytes = 0;
+    Texture2D texture;
+    MCMapData map;
+};
+
+// Nanoseconds the threads of a batch conversion stage spent working and waiting.
+struct StageTimes
+{
+    atomic<long long> busy = 0;
+    atomic<long long> starved = 0;
+    atomic<long long> blocked = 0;
+};
+
+// Quantisation error leaving a span of maps in one band of a wall, and the top row of the band below.
+struct DitherBandEdges
+{
+    vector<Vector4i> left;
+    vector<Vector4i> right;
+    vector<Vector4i> below;
+};
+
 // Function pre declaration.
 const bool LoadPaletteFromFile(const char* filename, vector<Vector3i>* output);
-const bool ConvertImageToMap(const char* inputPath, const char* outputPath, const vector<Vector3i>& paletteData, DitherType dithering = DitherType::ORDERED);
-const bool ConvertMapToImage(const char* inputPath, const char* outputPath, const vector<Vector3i>& paletteData);
+const bool ConvertImageToMap(const char* inputPath, const char* outputPath, const vector<Vector3i>& paletteData, DitherType dithering = DitherType::ORDERED, const Texture2D::Budget& budget = Texture2D::Budget());
+const bool ConvertImageToMap(const char* inputPath, MCMapData* output, const vector<Vector3i>& paletteData, DitherType dithering = DitherType::ORDERED, const Texture2D::Budget& budget = Texture2D::Budget(), const int& gridWidth = 1, const int& gridHeight = 1);
+const bool ConvertImageToMap(span<const byte> inputData, MCMapData* output, const vector<Vector3i>& paletteData, DitherType dithering = DitherType::ORDERED, const Texture2D::Budget& budget = Texture2D::Budget(), const int& gridWidth = 1, const int& gridHeight = 1);
+const bool ConvertImageToMapWall(const char* inputPath, const char* outputPath, const vector<Vector3i>& paletteData, DitherType dithering, const Texture2D::Budget& budget, const int& gridWidth, const int& gridHeight, ThreadPool* pool);
+const bool DecodeImage(span<const byte> inputData, Texture2D* output, const Texture2D::Budget& budget, const int& gridWidth = 1, const int& gridHeight = 1);
+const bool DitherImage(Texture2D* input, MCMapData* output, const vector<Vector3i>& paletteData, DitherType dithering, const int& gridWidth = 1, const int& gridHeight = 1);
+void FitImageToCanvas(Texture2D* input, const int& gridWidth = 1, const int& gridHeight = 1);
+const int FindNearestColour(const vector<Vector3i>& paletteData, const Vector3i& colour);
+const bool SaveMapWall(const MCMapData& map, const char* outputPath, const int& gridWidth, const int& gridHeight, ThreadPool* pool, span<const uint8_t> tiles = {});
+const string GetMapWallTilePath(const char* outputPath, const int& x, const int& y, const int& gridWidth, const int& gridHeight);
+const bool ConvertImageToMapWallIncremental(const char* inputPath, const char* outputPath, const vector<Vector3i>& paletteData, const Texture2D::Budget& budget, const int& gridWidth, const int& gridHeight, ThreadPool& pool);
+void DitherWallBand(const Texture2D& texture, const vector<Vector3i>& paletteData, const DitherState& state, const int& band, const int& first, const int& end, MCMapData* wall, DitherBandEdges* edges);
+const bool InstallMapsInWorld(const vector<string>& inputFiles, const filesystem::path& worldPath, const vector<Vector3i>& paletteData, const Texture2D::Budget& budget, const int& gridWidth, const int& gridHeight, const bool& deduplicate, ThreadPool& pool);
+const vector<size_t> FindDuplicateTiles(span<const MCMapView> tiles, vector<uint64_t>* hashes, ThreadPool& pool);
+const bool RenderMapsInWorld(const filesystem::path& worldPath, const filesystem::path& outputPath, const vector<Vector3i>& paletteData, ThreadPool& pool, const bool& incremental, const PngWriter::Mode& pngMode);
+const bool RenderWorldAtlas(const filesystem::path& worldPath, const filesystem::path& outputPath, const string& dimension, const vector<Vector3i>& paletteData, ThreadPool& pool, const bool& incremental, const PngWriter::Mode& pngMode, const Texture2D::Budget& budget);
+const bool InstallTerrainInWorld(const filesystem::path& worldPath, const filesystem::path& blockPath, const vector<Vector3i>& paletteData, const string& dimension, const int& x, const int& z, const int& radius, const int& scale, ThreadPool& pool);
+const bool ConvertMapToImage(const char* inputPath, const char* outputPath, const vector<Vector3i>& paletteData, const int& zoom = 1, const bool& gridLines = false, const int& gridWidth = 1, const int& gridHeight = 1, const PngWriter::Mode& pngMode = PngWriter::Mode::BALANCED, ThreadPool* pool = nullptr);
+const bool ConvertMapToImage(const MapArchive& archive, const int& id, const char* outputPath, const vector<Vector3i>& paletteData, const int& zoom = 1, const bool& gridLines = false, const int& gridWidth = 1, const int& gridHeight = 1, const PngWriter::Mode& pngMode = PngWriter::Mode::BALANCED, ThreadPool* pool = nullptr);
+const bool LoadMapWall(const char* inputPath, MCMapData* output, const int& gridWidth = 1, const int& gridHeight = 1);
+const bool LoadMapWall(const MapArchive& archive, const int& id, MCMapData* output, const int& gridWidth = 1, const int& gridHeight = 1);
+const bool SaveMapImage(const MCMapData& map, const char* outputPath, const vector<Vector3i>& paletteData, const int& zoom, const bool& gridLines, const PngWriter::Mode& pngMode, ThreadPool* pool);
+const bool WriteMapPng(const MCMapData& map, ostream& output, const vector<Vector3i>& paletteData, const int& zoom, const bool& gridLines, const PngWriter::Mode& pngMode, ThreadPool* pool);
+const bool ExpandMapImage(const MCMapData& map, const MCPalette& palette, const int& zoom, const bool& gridLines, const function<bool(span<const uint8_t>)>& writeRow);
+void CopyTileToWall(span<const uint8_t> tile, const int& x, const int& y, MCMapData* wall);
+const ConversionJob PlanConversion(const string& inputFile, const string& mapExtension, const string& imageExtension, const Texture2D::Budget& budget, const int& gridWidth, const int& gridHeight, const int& zoom);
+const bool RunConversion(const ConversionJob& job, const vector<Vector3i>& paletteData, const Texture2D::Budget& budget, const int& gridWidth, const int& gridHeight, const int& zoom, const bool& gridLines, const PngWriter::Mode& pngMode, ThreadPool* pool, const bool& incremental = false);
+const bool ConvertBatch(const vector<ConversionJob>& jobs, const vector<Vector3i>& paletteData, const Texture2D::Budget& budget, const int& gridWidth, const int& gridHeight, const int& zoom, const bool& gridLines, const PngWriter::Mode& pngMode, ThreadPool& pool, const PipelineThreads& stageThreads);
+const bool ConvertStream(const bool& sequence, const vector<Vector3i>& paletteData, const Texture2D::Budget& budget, const int& gridWidth, const int& gridHeight, const bool& datFile, const int& zoom, const bool& gridLines, const PngWriter::Mode& pngMode, ThreadPool& pool);
+const bool ConvertStreamItem(span<const uint8_t> input, ostream& output, const bool& sequence, const vector<Vector3i>& paletteData, const Texture2D::Budget& budget, const int& gridWidth, const int& gridHeight, const bool& datFile, const int& zoom, const bool& gridLines, const PngWriter::Mode& pngMode, ThreadPool& pool);
+const bool BenchmarkFileIO(const int& count);
+const bool ConvertWithArchive(const vector<string>& inputs, const filesystem::path& archivePath, const vector<Vector3i>& paletteData, const Texture2D::Budget& budget, const int& gridWidth, const int& gridHeight, const bool& compress, const bool& deduplicate, const string& imageExtension, const int& zoom, const bool& gridLines, const PngWriter::Mode& pngMode, ThreadPool& pool);
+const bool AppendMapsToArchive(const vector<string>& inputFiles, const filesystem::path& archivePath, const vector<Vector3i>& paletteData, const Texture2D::Budget& budget, const int& gridWidth, const int& gridHeight, const bool& compress, const bool& deduplicate, ThreadPool& pool);
+const bool ExportArchive(const filesystem::path& archivePath, const filesystem::path& outputPath, const bool& datFile, ThreadPool& pool);
 
 int main(int argc, char* argv[])
 {
     // Get path to exe and colour file.
     filesystem::path exeDirectory = filesystem::weakly_canonical(argv[0]).parent_path();
-    filesystem::path colourPath = filesystem::path(exeDirectory.string() + "\\colours.csv");
+    filesystem::path colourPath = exeDirectory / "colours.csv";
 
     // Load palette data.
     vector<Vector3i> paletteData;
     if(!LoadPaletteFromFile(colourPath.string().c_str(), &paletteData))
         return 1;
 
-    if (argc == 1)
+    // Parse options, collect input files.
+    Texture2D::Budget budget;
+    string mapExtension = "_map";
+    string imageExtension = ".png";
+    filesystem::path worldPath;
+    filesystem::path renderPath;
+    filesystem::path atlasPath;
+    bool terrain = false;
+    int terrainX = 0, terrainZ = 0, terrainRadius = 0, terrainScale = -1;
+    string dimension = MCMapInfo().dimension;
+    bool incremental = false;
+    unsigned int threads = 0;
+    PipelineThreads stageThreads;
+    int benchmarkMaps = 0;
+    filesystem::path archivePath;
+    filesystem::path exportPath;
+    bool compress = true;
+    bool deduplicate = true;
+    int gridWidth = 1, gridHeight = 1;
+    int zoom = 1;
+    bool gridLines = false;
+    PngWriter::Mode pngMode = PngWriter::Mode::BALANCED;
+    bool stream = false;
+    vector<string> inputFiles;
+    for (int i = 1; i < argc; i++)
+    {
+        string argument(argv[i]);
+
+        if (argument == "--max-pixels" && i + 1 < argc)
+        {
+            // Limit decoded image size in pixels.
+            budget.maxPixels = atoll(argv[++i]);
+        }
+        else if (argument == "--max-memory" && i + 1 < argc)
+        {
+            // Limit decoding memory in megabytes.
+            budget.maxBytes = atoll(argv[++i]) * 1024 * 1024;
+        }
+        else if (argument == "--dat")
+        {
+            // Write maps as map_<id>.dat files rather than raw colours.
+            mapExtension = ".dat";
+        }
+        else if (argument == "--archive" && i + 1 < argc)
+        {
+            // Store maps in, or read maps from, a single archive file.
+            archivePath = argv[++i];
+        }
+        else if (argument == "--export" && i + 1 < argc)
+        {
+            // Extract every map in an archive into a folder.
+            exportPath = argv[++i];
+        }
+        else if (argument == "--no-compression")
+        {
+            // Store archived maps uncompressed.
+            compress = false;
+        }
+        else if (argument == "--no-dedup")
+        {
+            // Give every map its own ID, even if another map has the same colours.
+            deduplicate = false;
+        }
+        else if (argument == "--world" && i + 1 < argc)
+        {
+            // Install maps into a world save.
+            worldPath = argv[++i];
+        }
+        else if (argument == "--render" && i + 1 < argc)
+        {
+            // Render every map in the world to PNG files in a directory.
+            renderPath = argv[++i];
+        }
+        else if (argument == "--atlas" && i + 1 < argc)
+        {
+            // Stitch every map in the world into a single PNG file.
+            atlasPath = argv[++i];
+        }
+        else if (argument == "--terrain" && i + 1 < argc)
+        {
+            // Render the terrain around a block as maps, e.g. 100,-200 or 100,-200,1000 for a radius.
+            string position(argv[++i]);
+            size_t first = position.find(','), second = position.find(',', first + 1);
+            terrain = first != string::npos;
+            terrainX = atoi(position.c_str());
+            terrainZ = terrain ? atoi(position.c_str() + first + 1) : 0;
+            terrainRadius = second != string::npos ? max(0, atoi(position.c_str() + second + 1)) : 0;
+        }
+        else if (argument == "--scale" && i + 1 < argc)
+        {
+            // Render terrain at a single map scale, from 0 to 4.
+            terrainScale = clamp(atoi(argv[++i]), 0, TerrainRenderer::maxScale);
+        }
+        else if (argument == "--dimension" && i + 1 < argc)
+        {
+            // Select dimension for the atlas, e.g. minecraft:the_nether.
+            dimension = argv[++i];
+        }
+        else if (argument == "--incremental")
+        {
+            // Only render, or convert from images, maps which changed since the last run.
+            incremental = true;
+        }
+        else if (argument == "--threads" && i + 1 < argc)
+        {
+            // Set number of worker threads, zero uses all cores.
+            threads = static_cast<unsigned int>(atoi(argv[++i]));
+        }
+        else if (argument == "--stages" && i + 1 < argc)
+        {
+            // Set threads for the load, convert and save stages of batch conversion, e.g. 1,6,1.
+            string stages(argv[++i]);
+            replace(stages.begin(), stages.end(), ',', ' ');
+            istringstream(stages) >> stageThreads.load >> stageThreads.convert >> stageThreads.save;
+        }
+        else if (argument == "--grid" && i + 1 < argc)
+        {
+            // Convert each image into a wall of NxM maps, e.g. 3x2.
+            string grid(argv[++i]);
+            size_t separator = grid.find_first_of("xX");
+            gridWidth = static_cast<int>(clamp(atoll(grid.c_str()), 1LL, static_cast<long long>(INT_MAX)));
+            gridHeight = separator != string::npos ? static_cast<int>(clamp(atoll(grid.c_str() + separator + 1), 1LL, static_cast<long long>(INT_MAX))) : gridWidth;
+        }
+        else if (argument == "--zoom" && i + 1 < argc)
+        {
+            // Enlarge images made from maps, e.g. 4 draws each map pixel as 4x4 pixels.
+            zoom = clamp(atoi(argv[++i]), 1, maxZoom);
+        }
+        else if (argument == "--grid-lines")
+        {
+            // Draw lines between the maps of a wall in images made from maps.
+            gridLines = true;
+        }
+        else if (argument == "--format" && i + 1 < argc)
+        {
+            // Write images made from maps as png, qoi, ppm or pam (ppm with alpha) files.
+            imageExtension = "." + string(argv[++i]);
+        }
+        else if (argument == "--png" && i + 1 < argc)
+        {
+            // Select PNG encoding, fast, balanced or parallel.
+            string mode(argv[++i]);
+            pngMode = (mode == "fast") ? PngWriter::Mode::FAST : (mode == "parallel") ? PngWriter::Mode::PARALLEL : PngWriter::Mode::BALANCED;
+        }
+        else if (argument == "--benchmark-io" && i + 1 < argc)
+        {
+            // Compare file backends by writing and reading back a number of maps.
+            benchmarkMaps = max(1, atoi(argv[++i]));
+        }
+        else if (argument == "--stream")
+        {
+            // Convert a sequence of length prefixed items from standard input to standard output.
+            stream = true;
+        }
+        else
+        {
+            inputFiles.push_back(argument);
+        }
+    }
+
+    // A wall is held as one canvas, which must fit the pixel budget and int coordinates.
+    long long maxGridPixels = min(budget.maxPixels, static_cast<long long>(INT_MAX));
+    long long gridMaps = static_cast<long long>(gridWidth) * gridHeight;
+    if (gridMaps > 1 && gridMaps > maxGridPixels / (MCMapData::defaultWidth * MCMapData::defaultHeight))
+    {
+        cerr << "A " << gridWidth << "x" << gridHeight << " grid is over the limit of " << maxGridPixels << " pixels (see --max-pixels)\n";
+        return 1;
+    }
+
+    // Create worker threads for compressing and writing maps.
+    ThreadPool pool(threads);
+
+    if (benchmarkMaps > 0)
+    {
+        // Time map files written and read by each file backend.
+        if (!BenchmarkFileIO(benchmarkMaps))
+            return 1;
+    }
+    else if (!archivePath.empty() && !exportPath.empty())
+    {
+        // Extract maps from an archive into separate files.
+        if (!ExportArchive(archivePath, exportPath, mapExtension == ".dat", pool))
+            return 1;
+    }
+    else if (!archivePath.empty())
+    {
+        // Add images to an archive, or convert archived maps into images.
+        if (!ConvertWithArchive(inputFiles, archivePath, paletteData, budget, gridWidth, gridHeight, compress, deduplicate, imageExtension, zoom, gridLines, pngMode, pool))
+            return 1;
+    }
+    else if (!worldPath.empty() && terrain)
+    {
+        // Render terrain from a world save into new maps.
+        filesystem::path blockPath = exeDirectory / "blocks.csv";
+        if (!InstallTerrainInWorld(worldPath, blockPath, paletteData, dimension, terrainX, terrainZ, terrainRadius, terrainScale, pool))
+            return 1;
+    }
+    else if (!worldPath.empty() && !atlasPath.empty())
+    {
+        // Stitch maps from a world save into an atlas.
+        if (!RenderWorldAtlas(worldPath, atlasPath, dimension, paletteData, pool, incremental, pngMode, budget))
+            return 1;
+    }
+    else if (!worldPath.empty() && !renderPath.empty())
+    {
+        // Render maps from a world save.
+        if (!RenderMapsInWorld(worldPath, renderPath, paletteData, pool, incremental, pngMode))
+            return 1;
+    }
+    else if (!worldPath.empty())
+    {
+        // Convert images into maps within a world save.
+        if (!InstallMapsInWorld(inputFiles, worldPath, paletteData, budget, gridWidth, gridHeight, deduplicate, pool))
+            return 1;
+    }
+    else if (stream || (inputFiles.size() == 1 && inputFiles[0] == "-"))
+    {
+        // Convert images or maps piped through standard input and output, without touching disk.
+        if (!ConvertStream(stream, paletteData, budget, gridWidth, gridHeight, mapExtension == ".dat", zoom, gridLines, pngMode, pool))
+            return 1;
+    }
+    else if (inputFiles.empty())
     {
         // Output text.
         cout << "Please enter file name and location (e.g. C:/image.png):\n";
@@ -74,7 +406,7 @@ int main(int argc, char* argv[])
         filename.resize(filename.size() - inputPath.extension().string().size());
 
         // Check if input is a binary file (map data).
-        if (inputPath.has_extension())
+        if (inputPath.has_extension() && inputPath.extension() != ".dat")
         {
             // Output text.
             cout << "Enter 0 for ordered dithering or 1 for Floyd-Steinberg dithering:\n";
@@ -84,55 +416,61 @@ int main(int argc, char* argv[])
             cin >> dithering;
 
             // Generate output path.
-            string outputPath(exeDirectory.string() + "\\" + filename + "_map");
+            string outputPath((exeDirectory / (filename + mapExtension)).string());
 
             // Input has a file type, attempt map conversion.
-            MCMapData outputMap;
-            if (!ConvertImageToMap(inputPath.string().c_str(), outputPath.c_str(), paletteData, DitherType(dithering)))
+            if (!ConvertImageToMapWall(inputPath.string().c_str(), outputPath.c_str(), paletteData, DitherType(dithering), budget, gridWidth, gridHeight, &pool))
                 return 1;
         }
         else
         {
             // Generate output path.
-            string outputPath(exeDirectory.string() + "\\" + filename + ".png");
+            string outputPath((exeDirectory / (filename + imageExtension)).string());
 
             // Input is binary, attempt image conversion.
-            if (!ConvertMapToImage(inputPath.string().c_str(), outputPath.c_str(), paletteData))
+            if (!ConvertMapToImage(inputPath.string().c_str(), outputPath.c_str(), paletteData, zoom, gridLines, gridWidth, gridHeight, pngMode, &pool))
                 return 1;
         }
     }
-    else
+    else if (inputFiles.size() == 1)
     {
-        for (int i = 1; i < argc; i++)
+        // Convert a single file, using every core within the conversion.
+        ConversionJob job = PlanConversion(inputFiles[0], mapExtension, imageExtension, budget, gridWidth, gridHeight, zoom);
+        if (!RunConversion(job, paletteData, budget, gridWidth, gridHeight, zoom, gridLines, pngMode, &pool, incremental))
         {
-            // Store file path.
-            filesystem::path inputPath(argv[i]);
-
-            // Store file name, remove extension.
-            string filename = inputPath.filename().string();
-            filename.resize(filename.size() - inputPath.extension().string().size());
-
-            // Check if input has an extension.
-            if (inputPath.has_extension())
+            cerr << "Failed to convert " << inputFiles[0] << "\n";
+            return 1;
+        }
+    }
+    else if (incremental)
+    {
+        // Convert files one at a time, each only dithering the maps which changed. Later files are
+        // still converted after a failure.
+        bool success = true;
+        for (const string& inputFile : inputFiles)
+        {
+            ConversionJob job = PlanConversion(inputFile, mapExtension, imageExtension, budget, gridWidth, gridHeight, zoom);
+            if (!RunConversion(job, paletteData, budget, gridWidth, gridHeight, zoom, gridLines, pngMode, &pool, incremental))
             {
-                // Generate output path.
-                string outputPath(inputPath.parent_path().string() + "\\" + filename + "_map");
-
-                // Input has a file type, attempt map conversion.
-                MCMapData outputMap;
-                if (!ConvertImageToMap(argv[i], outputPath.c_str(), paletteData, DitherType::FLOYD_STEINBERG))
-                    continue;
+                cerr << "Failed to convert " << inputFile << "\n";
+                success = false;
             }
-            else
-            {
-                // Generate output path.
-                string outputPath(inputPath.parent_path().string() + "\\" + filename + ".png");
+        }
 
-                // Input is binary, attempt image conversion.
-                if (!ConvertMapToImage(argv[i], outputPath.c_str(), paletteData))
-                    continue;
-            }
+        if (!success)
+            return 1;
+    }
+    else
+    {
+        // Convert files in parallel, one file per worker.
+        vector<ConversionJob> jobs;
+        for (const string& inputFile : inputFiles)
+        {
+            jobs.push_back(PlanConversion(inputFile, mapExtension, imageExtension, budget, gridWidth, gridHeight, zoom));
         }
+
+        if (!ConvertBatch(jobs, paletteData, budget, gridWidth, gridHeight, zoom, gridLines, pngMode, pool, stageThreads))
+            return 1;
     }
 
     // Program executed successfully.
@@ -190,33 +528,244 @@ const bool LoadPaletteFromFile(const char* filename, vector<Vector3i>* output)
     return true;
 }
 
-const bool ConvertImageToMap(const char* inputFile, const char* outputFile, const vector<Vector3i>& paletteData, DitherType dithering)
+const bool ConvertImageToMap(const char* inputFile, const char* outputFile, const vector<Vector3i>& paletteData, DitherType dithering, const Texture2D::Budget& budget)
 {
-    // Load image.
-    Texture2D inputTexture;
-    if (inputTexture.LoadFromFile(inputFile))
+    // Convert image.
+    MCMapData outputMap;
+    if (!ConvertImageToMap(inputFile, &outputMap, paletteData, dithering, budget))
+        return false;
+
+    // Save map data to file, as a locked map_<id>.dat file if requested.
+    if (filesystem::path(outputFile).extension() == ".dat")
+    {
+        if (!outputMap.SaveToDatFile(outputFile))
+            return false;
+    }
+    else if (!outputMap.SaveToFile(outputFile))
+    {
+        return false;
+    }
+
+    // Successfull conversion.
+    return true;
+}
+
+const bool ConvertImageToMapWall(const char* inputFile, const char* outputFile, const vector<Vector3i>& paletteData, DitherType dithering, const Texture2D::Budget& budget, const int& gridWidth, const int& gridHeight, ThreadPool* pool)
+{
+    // Single maps are written directly.
+    if (gridWidth == 1 && gridHeight == 1)
+        return ConvertImageToMap(inputFile, outputFile, paletteData, dithering, budget);
+
+    // Convert image into one map covering the whole wall, then slice it into tiles.
+    MCMapData outputMap;
+    if (!ConvertImageToMap(inputFile, &outputMap, paletteData, dithering, budget, gridWidth, gridHeight))
+        return false;
+
+    return SaveMapWall(outputMap, outputFile, gridWidth, gridHeight, pool);
+}
+
+const bool SaveMapWall(const MCMapData& map, const char* outputFile, const int& gridWidth, const int& gridHeight, ThreadPool* pool, span<const uint8_t> tiles)
+{
+    filesystem::path outputPath(outputFile);
+    bool datFile = outputPath.extension() == ".dat";
+
+    // Single maps are saved whole, as a locked map_<id>.dat file if requested.
+    if (gridWidth == 1 && gridHeight == 1)
+    {
+        if (!tiles.empty() && !tiles[0])
+            return true;
+
+        return datFile ? map.SaveToDatFile(outputFile) : map.SaveToFile(outputFile);
+    }
+
+    // Only the selected tiles are saved, or every tile if none are selected.
+    size_t tileCount = static_cast<size_t>(gridWidth) * gridHeight;
+    vector<string> tilePaths(tileCount);
+    vector<vector<uint8_t>> tileData(tileCount);
+    atomic<bool> success = true;
+
+    // Slice map into tiles and encode them, in parallel if a pool is given.
+    auto encodeTile = [&](size_t i)
     {
-        // Calculate individual x and y scales.
-        float scaleX = float(MCMapData::defaultWidth) / float(inputTexture.GetWidth());
-        float scaleY = float(MCMapData::defaultHeight) / float(inputTexture.GetHeight());
+        int x = static_cast<int>(i % gridWidth);
+        int y = static_cast<int>(i / gridWidth);
 
-        // Find minimum scale between x and y dimensions.
-        float scale = min(scaleX, scaleY);
+        if (!tiles.empty() && !tiles[i])
+            return;
 
-        // Scale image to fit within map dimensions.
-        inputTexture.Resize(static_cast<int>(inputTexture.GetWidth() * scale), static_cast<int>(inputTexture.GetHeight() * scale));
+        tilePaths[i] = GetMapWallTilePath(outputFile, x, y, gridWidth, gridHeight);
+
+        MCMapView tile = map.GetTile(x, y);
+        if (datFile)
+        {
+            if (!tile.SaveToDat(&tileData[i]))
+                success = false;
+        }
+        else
+        {
+            for (int row = 0; row < tile.GetHeight(); row++)
+            {
+                span<const uint8_t> colours = tile.GetRow(row);
+                tileData[i].insert(tileData[i].end(), colours.begin(), colours.end());
+            }
+        }
+    };
 
-        // Resize image canvas to map dimensions.
-        inputTexture.ResizeCanvas(MCMapData::defaultWidth, MCMapData::defaultHeight);
+    if (pool != nullptr)
+    {
+        pool->ParallelFor(tileCount, encodeTile);
     }
     else
     {
-        // Failed to load texture.
+        for (size_t i = 0; i < tileCount; i++)
+        {
+            encodeTile(i);
+        }
+    }
+
+    // Write every tile in one batch.
+    FileBatch batch;
+    for (size_t i = 0; i < tileCount; i++)
+    {
+        if (!tileData[i].empty())
+            batch.Write(tilePaths[i].c_str(), tileData[i]);
+    }
+
+    return batch.Submit() && success;
+}
+// Tiles are named after the output file, with the tile position appended to the stem.
+const string GetMapWallTilePath(const char* outputFile, const int& x, const int& y, const int& gridWidth, const int& gridHeight)
+{
+    if (gridWidth == 1 && gridHeight == 1)
+        return outputFile;
+
+    filesystem::path outputPath(outputFile);
+    return (outputPath.parent_path() / (outputPath.stem().string() + "_" + to_string(x) + "_" + to_string(y) + outputPath.extension().string())).string();
+}
+
+const bool ConvertImageToMap(const char* inputFile, MCMapData* output, const vector<Vector3i>& paletteData, DitherType dithering, const Texture2D::Budget& budget, const int& gridWidth, const int& gridHeight)
+{
+    // Map image file, it is decoded in place.
+    MappedFile file;
+    if (!file.Open(inputFile))
+        return false;
+
+    return ConvertImageToMap(file.GetData(), output, paletteData, dithering, budget, gridWidth, gridHeight);
+}
+
+const bool ConvertImageToMap(span<const byte> inputData, MCMapData* output, const vector<Vector3i>& paletteData, DitherType dithering, const Texture2D::Budget& budget, const int& gridWidth, const int& gridHeight)
+{
+    // Load image, then dither it into the map.
+    Texture2D inputTexture;
+    if (!DecodeImage(inputData, &inputTexture, budget, gridWidth, gridHeight))
+        return false;
+
+    return DitherImage(&inputTexture, output, paletteData, dithering, gridWidth, gridHeight);
+}
+
+const bool DecodeImage(span<const byte> inputData, Texture2D* output, const Texture2D::Budget& budget, const int& gridWidth, const int& gridHeight)
+{
+    // Load image, allowing reduced size decoding down to the canvas dimensions.
+    int canvasWidth = MCMapData::defaultWidth * gridWidth;
+    int canvasHeight = MCMapData::defaultHeight * gridHeight;
+    if (output->LoadFromMemory(inputData, canvasWidth, canvasHeight, budget))
+        return true;
+
+    // Explain why the image failed, giving its size and the limit it was checked against, so images
+    // rejected by the budget don't look like unreadable files.
+    Texture2D::ImageInfo info;
+    if (!Texture2D::ReadInfo(inputData, &info))
+    {
+        cerr << "No image header found in " << inputData.size() << " bytes, so the image can't be checked against the --max-pixels limit of " << budget.maxPixels << "\n";
         return false;
     }
 
+    Texture2D::DecodePlan plan = Texture2D::PlanDecode(info, canvasWidth, canvasHeight, budget);
+
+    // JPEGs the reduced size decoder can't read fall back to a full size decode, which may not fit.
+    if (plan.decoding == Texture2D::Decoding::REDUCED)
+    {
+        info.jpeg = false;
+        Texture2D::DecodePlan full = Texture2D::PlanDecode(info, canvasWidth, canvasHeight, budget);
+        if (full.decoding == Texture2D::Decoding::REJECTED)
+            plan = full;
+    }
+
+    long long pixels = static_cast<long long>(plan.width) * plan.height;
+    long long megabytes = (plan.bytes + 1024 * 1024 - 1) / (1024 * 1024);
+
+    if (plan.decoding == Texture2D::Decoding::REJECTED && pixels > budget.maxPixels)
+    {
+        cerr << "Image is " << info.width << "x" << info.height << ", decoding " << pixels << " pixels is over the --max-pixels limit of " << budget.maxPixels << "\n";
+    }
+    else if (plan.decoding == Texture2D::Decoding::REJECTED)
+    {
+        cerr << "Image is " << info.width << "x" << info.height << ", decoding needs " << megabytes << " MB, over the --max-memory limit of "
+            << budget.maxBytes / (1024 * 1024) << " MB\n";
+    }
+    else
+    {
+        cerr << "Image is " << info.width << "x" << info.height << ", decoding " << pixels << " pixels in " << megabytes << " MB is within the --max-pixels limit of "
+            << budget.maxPixels << " and --max-memory limit of " << budget.maxBytes / (1024 * 1024) << " MB, but the image data is damaged or unsupported\n";
+    }
+
+    return false;
+}
+
+void FitImageToCanvas(Texture2D* input, const int& gridWidth, const int& gridHeight)
+{
+    // Calculate canvas size, a wall of maps is dithered as a single image.
+    int canvasWidth = MCMapData::defaultWidth * gridWidth;
+    int canvasHeight = MCMapData::defaultHeight * gridHeight;
+    Texture2D& inputTexture = *input;
+
+    // Calculate individual x and y scales.
+    float scaleX = float(canvasWidth) / float(inputTexture.GetWidth());
+    float scaleY = float(canvasHeight) / float(inputTexture.GetHeight());
+
+    // Find minimum scale between x and y dimensions.
+    float scale = min(scaleX, scaleY);
+
+    // Scale image to fit within canvas dimensions.
+    inputTexture.Resize(static_cast<int>(inputTexture.GetWidth() * scale), static_cast<int>(inputTexture.GetHeight() * scale));
+
+    // Resize image canvas to canvas dimensions.
+    inputTexture.ResizeCanvas(canvasWidth, canvasHeight);
+}
+
+const int FindNearestColour(const vector<Vector3i>& paletteData, const Vector3i& colour)
+{
+    // Initialise nearest variables.
+    int nearest = 4;
+    int nearestDistance = Vector3i::LengthSqr(paletteData[nearest] - colour);
+
+    // Loop through each colour in palette skipping the first five entries (0-3 is transprency, 4 was used above).
+    for (unsigned int i = 5; i < paletteData.size(); i++)
+    {
+        // Calculate distance to sample colour, avoid sqrt calculation.
+        int distance = Vector3i::LengthSqr(paletteData[i] - colour);
+
+        // Check if colour is closer than nearest.
+        if (distance < nearestDistance)
+        {
+            // Update nearest colour.
+            nearest = i;
+            nearestDistance = distance;
+        }
+    }
+
+    return nearest;
+}
+
+const bool DitherImage(Texture2D* input, MCMapData* output, const vector<Vector3i>& paletteData, DitherType dithering, const int& gridWidth, const int& gridHeight)
+{
+    // Scale image to fit the canvas.
+    Texture2D& inputTexture = *input;
+    FitImageToCanvas(input, gridWidth, gridHeight);
+
     // Create output map.
-    MCMapData outputMap(inputTexture.GetWidth(), inputTexture.GetHeight());
+    MCMapData& outputMap = *output;
+    outputMap = MCMapData(inputTexture.GetWidth(), inputTexture.GetHeight());
 
     // Select dithering method.
     switch (dithering)
@@ -249,24 +798,8 @@ const bool ConvertImageToMap(const char* inputFile, const char* outputFile, cons
                 }
                 else
                 {
-                    // Initialise nearest variables.
-                    int nearest = 4;
-                    int nearestDistance = Vector3i::LengthSqr(paletteData[nearest] - Vector3i(sampleColour.x, sampleColour.y, sampleColour.z));
-
-                    // Loop through each colour in palette skipping the first five entries (0-3 is transprency, 4 was used above).
-                    for (unsigned int i = 5; i < paletteData.size(); i++)
-                    {
-                        // Calculate distance to sample colour, avoid sqrt calculation.
-                        int distance = Vector3i::LengthSqr(paletteData[i] - Vector3i(sampleColour.x, sampleColour.y, sampleColour.z));
-
-                        // Check if colour is closer than nearest.
-                        if (distance < nearestDistance)
-                        {
-                            // Update nearest colour.
-                            nearest = i;
-                            nearestDistance = distance;
-                        }
-                    }
+                    // Find nearest colour in palette.
+                    int nearest = FindNearestColour(paletteData, Vector3i(sampleColour.x, sampleColour.y, sampleColour.z));
 
                     // Store nearest ID in output map.
                     outputMap.Set(x, y, nearest);
@@ -311,24 +844,8 @@ const bool ConvertImageToMap(const char* inputFile, const char* outputFile, cons
                     int colourDither = static_cast<int>((255.f / 8.f) * (bayerMatrix[x % bayerWidth + (y % bayerHeight) * bayerWidth] - 0.5f));
                     sampleColour = sampleColour + Vector4i(colourDither, colourDither, colourDither, 0);
 
-                    // Initialise nearest variables.
-                    int nearest = 4;
-                    int nearestDistance = Vector3i::LengthSqr(paletteData[nearest] - Vector3i(sampleColour.x, sampleColour.y, sampleColour.z));
-
-                    // Loop through each colour in palette skipping the first five entries (0-3 is transprency, 4 was used above).
-                    for (unsigned int i = 5; i < paletteData.size(); i++)
-                    {
-                        // Calculate distance to sample colour, avoid sqrt calculation.
-                        int distance = Vector3i::LengthSqr(paletteData[i] - Vector3i(sampleColour.x, sampleColour.y, sampleColour.z));
-
-                        // Check if colour is closer than nearest.
-                        if (distance < nearestDistance)
-                        {
-                            // Update nearest colour.
-                            nearest = i;
-                            nearestDistance = distance;
-                        }
-                    }
+                    // Find nearest colour in palette.
+                    int nearest = FindNearestColour(paletteData, Vector3i(sampleColour.x, sampleColour.y, sampleColour.z));
 
                     // Store nearest ID in output map.
                     outputMap.Set(x, y, nearest);
@@ -340,50 +857,1439 @@ const bool ConvertImageToMap(const char* inputFile, const char* outputFile, cons
     }
     }
 
-    // Save map data to file.
-    if (!outputMap.SaveToFile(outputFile))
-        return false;
-
     // Successfull conversion.
     return true;
 }
 
-const bool ConvertMapToImage(const char* inputFile, const char* outputFile, const vector<Vector3i>& paletteData)
+const bool ConvertImageToMapWallIncremental(const char* inputFile, const char* outputFile, const vector<Vector3i>& paletteData, const Texture2D::Budget& budget, const int& gridWidth, const int& gridHeight, ThreadPool& pool)
 {
-    // Load map data from file.
-    MCMapData inputMap;
-    if (!inputMap.LoadFromFile(inputFile))
-        return false;
+    // Load image and fit it to the canvas, as a full conversion would.
+    Texture2D texture;
+    {
+        MappedFile file;
+        if (!file.Open(inputFile) || !DecodeImage(file.GetData(), &texture, budget, gridWidth, gridHeight))
+            return false;
+    }
 
-    // Create output image.
-    Texture2D outputTexture(inputMap.GetWidth(), inputMap.GetHeight());
+    FitImageToCanvas(&texture, gridWidth, gridHeight);
 
-    // Convert map data to image.
-    for (int y = 0; y < outputTexture.GetHeight(); y++)
+    // Hash the resized image under each map, and its first row on its own.
+    size_t tileCount = static_cast<size_t>(gridWidth) * gridHeight;
+    vector<uint64_t> sourceHashes(tileCount), topHashes(tileCount);
+    pool.ParallelFor(tileCount, [&](size_t i)
     {
-        for (int x = 0; x < outputTexture.GetWidth(); x++)
+        int x = static_cast<int>(i % gridWidth) * MCMapData::defaultWidth;
+        int y = static_cast<int>(i / gridWidth) * MCMapData::defaultHeight;
+
+        uint64_t hash = 0;
+        for (int row = 0; row < MCMapData::defaultHeight; row++)
         {
-            // Get colour ID from map data.
-            int colourID = inputMap.Get(x, y);
+            hash = Compression::Hash64(span<const uint8_t>(reinterpret_cast<const uint8_t*>(&texture.Get(x, y + row)), MCMapData::defaultWidth * sizeof(Vector4i)), hash);
+            if (row == 0)
+                topHashes[i] = hash;
+        }
+
+        sourceHashes[i] = hash;
+    });
+
+    // Load the state left by the last run, which only applies to the same grid and palette.
+    filesystem::path statePath = string(outputFile) + ".dither";
+    uint64_t paletteHash = Compression::Hash64(span<const uint8_t>(reinterpret_cast<const uint8_t*>(paletteData.data()), paletteData.size() * sizeof(Vector3i)));
+    DitherState state(gridWidth, gridHeight, paletteHash);
+    bool resumed = state.Load(statePath);
+
+    // Maps are dithered again if the image under them changed or their file is missing. Without
+    // a state, every map is. The first row of the map below starts from its pixels plus the error
+    // from this map, so a change to it dithers this map again to find the new row.
+    vector<uint8_t> dirty(tileCount), missing(tileCount), written(tileCount);
+    for (size_t i = 0; i < tileCount; i++)
+    {
+        int x = static_cast<int>(i % gridWidth);
+        int y = static_cast<int>(i / gridWidth);
+        uint64_t belowHash = (y + 1 < gridHeight) ? topHashes[i + gridWidth] : 0;
+
+        missing[i] = !filesystem::exists(GetMapWallTilePath(outputFile, x, y, gridWidth, gridHeight));
+        dirty[i] = !resumed || missing[i] || sourceHashes[i] != state.GetTile(x, y).sourceHash || belowHash != state.GetTile(x, y).belowHash;
+    }
+
+    // Error only spreads right and down, so bands of maps are dithered from the top. Each band
+    // dithers the span of maps covering its changed maps, and the change may spread beyond it.
+    MCMapData wall(MCMapData::defaultWidth * gridWidth, MCMapData::defaultHeight * gridHeight);
+    DitherBandEdges edges;
+    size_t dithered = 0;
 
-            // Check for transparency.
-            if (colourID >= 0 && colourID < 4)
+    for (int y = 0; y < gridHeight; y++)
+    {
+        int first = gridWidth, end = 0;
+        for (int x = 0; x < gridWidth; x++)
+        {
+            if (dirty[x + static_cast<size_t>(y) * gridWidth])
             {
-                // Set pixel as transparent.
-                outputTexture.Set(x, y, Vector4i(0, 0, 0, 0));
+                first = min(first, x);
+                end = x + 1;
             }
+        }
+
+        if (first >= end)
+            continue;
+
+        // Maps beside the span were dithered with the error that left it last time. If that error
+        // changed, they change too, so widen the span and dither it again.
+        while (true)
+        {
+            DitherWallBand(texture, paletteData, state, y, first, end, &wall, &edges);
+
+            const Vector4i* left = edges.left.data();
+            const Vector4i* right = edges.right.data() + static_cast<size_t>(end - first - 1) * MCMapData::defaultHeight;
+
+            if (first > 0 && !equal(left, left + MCMapData::defaultHeight, state.GetTile(first, y).left))
+                first--;
+            else if (end < gridWidth && !equal(right, right + MCMapData::defaultHeight, state.GetTile(end - 1, y).right))
+                end++;
             else
+                break;
+        }
+
+        // Store the new state, keeping maps whose colours came out the same.
+        for (int x = first; x < end; x++)
+        {
+            size_t i = x + static_cast<size_t>(y) * gridWidth;
+            DitherStateTile& tile = state.GetTile(x, y);
+            uint64_t colourHash = wall.GetTile(x, y).GetHash();
+
+            written[i] = !resumed || missing[i] || colourHash != tile.colourHash;
+            tile.sourceHash = sourceHashes[i];
+            tile.colourHash = colourHash;
+            tile.belowHash = (y + 1 < gridHeight) ? topHashes[i + gridWidth] : 0;
+            copy_n(edges.left.data() + static_cast<size_t>(x - first) * MCMapData::defaultHeight, MCMapData::defaultHeight, tile.left);
+            copy_n(edges.right.data() + static_cast<size_t>(x - first) * MCMapData::defaultHeight, MCMapData::defaultHeight, tile.right);
+            dithered++;
+
+            // Maps below are dithered again if the error reaching them changed.
+            if (y + 1 < gridHeight)
             {
-                // Set pixel using colour from palette.
-                outputTexture.Set(x, y, Vector4i(paletteData[colourID], 255));
+                const Vector4i* below = edges.below.data() + static_cast<size_t>(x - first) * MCMapData::defaultWidth;
+                DitherStateTile& tileBelow = state.GetTile(x, y + 1);
+
+                if (!equal(below, below + MCMapData::defaultWidth, tileBelow.top))
+                {
+                    copy_n(below, MCMapData::defaultWidth, tileBelow.top);
+                    dirty[i + gridWidth] = true;
+                }
             }
         }
     }
 
-    // Save image to file.
-    if (!outputTexture.SaveToFile(outputFile))
+    // Write changed maps, then the state. If writing fails the old state is kept, so the same
+    // maps are written next time.
+    if (!SaveMapWall(wall, outputFile, gridWidth, gridHeight, &pool, written) || !state.Save(statePath))
         return false;
 
-    // Successfull conversion.
+    cout << "Dithered " << dithered << " of " << tileCount << " maps, wrote " << count(written.begin(), written.end(), 1) << "\n";
     return true;
-}
\ No newline at end of file
+}
+// Dithers maps first to end - 1 of a band as DitherImage would dither the whole wall. Error from
+// the maps either side and the band above is taken from the state.
+void DitherWallBand(const Texture2D& texture, const vector<Vector3i>& paletteData, const DitherState& state, const int& band, const int& first, const int& end, MCMapData* wall, DitherBandEdges* edges)
+{
+    const int tileWidth = MCMapData::defaultWidth;
+    const int tileHeight = MCMapData::defaultHeight;
+    int canvasWidth = texture.GetWidth();
+    int canvasHeight = texture.GetHeight();
+    int x0 = first * tileWidth, x1 = end * tileWidth;
+    int y0 = band * tileHeight, y1 = y0 + tileHeight;
+
+    // Copy the span, and the row below it which receives error from its last row. The top row
+    // starts with the error it received from the band above.
+    int width = x1 - x0;
+    int rows = min(tileHeight + 1, canvasHeight - y0);
+    vector<Vector4i> pixels(static_cast<size_t>(width) * rows);
+    for (int y = 0; y < rows; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            if (y == 0 && band > 0)
+                pixels[x] = state.GetTile(first + x / tileWidth, band).top[x % tileWidth];
+            else
+                pixels[x + static_cast<size_t>(y) * width] = texture.Get(x0 + x, y0 + y);
+        }
+    }
+
+    // Spreads quantisation error from a pixel in the same order and with the same rounding as
+    // DitherImage, including clamping to the canvas. Error leaving the copy is dropped.
+    auto spread = [&](const int& x, const int& y, const Vector4i& error)
+    {
+        auto add = [&](int targetX, int targetY, const float& weight)
+        {
+            targetX = clamp(targetX, 0, canvasWidth - 1);
+            targetY = clamp(targetY, 0, canvasHeight - 1);
+            if (targetX < x0 || targetX >= x1 || targetY >= y0 + rows)
+                return;
+
+            Vector4i& pixel = pixels[(targetX - x0) + static_cast<size_t>(targetY - y0) * width];
+            pixel.w = static_cast<int>(pixel.w + error.w * weight / 16.0f);
+            pixel = pixel + Vector4i(error.x, error.y, error.z, 0) * weight / 16.0f;
+        };
+
+        add(x + 1, y, 7.0f);
+        add(x - 1, y + 1, 3.0f);
+        add(x, y + 1, 5.0f);
+        add(x + 1, y + 1, 1.0f);
+    };
+
+    edges->left.resize(static_cast<size_t>(end - first) * tileHeight);
+    edges->right.resize(static_cast<size_t>(end - first) * tileHeight);
+
+    for (int y = y0; y < y1; y++)
+    {
+        // The pixel left of the span was dithered just before it.
+        if (x0 > 0)
+            spread(x0 - 1, y, state.GetTile(first - 1, band).right[y - y0]);
+
+        for (int x = x0; x < x1; x++)
+        {
+            // Calculate nearest alpha using 1 bit colour, determine quantisation error.
+            Vector4i sampleColour = pixels[(x - x0) + static_cast<size_t>(y - y0) * width];
+            int nearestAlpha = static_cast<int>(roundf((float)sampleColour.w / 255.f) * 255);
+            Vector4i error(0, 0, 0, sampleColour.w - nearestAlpha);
+
+            if (nearestAlpha == 0)
+            {
+                wall->Set(x, y, 0);
+            }
+            else
+            {
+                int nearest = FindNearestColour(paletteData, Vector3i(sampleColour.x, sampleColour.y, sampleColour.z));
+                wall->Set(x, y, nearest);
+                error = Vector4i(Vector3i(sampleColour.x, sampleColour.y, sampleColour.z) - paletteData[nearest], error.w);
+            }
+
+            spread(x, y, error);
+
+            // Keep the error of the edge columns, which spreads into the maps beside them.
+            int column = x - x0;
+            size_t row = static_cast<size_t>(column / tileWidth) * tileHeight + (y - y0);
+            if (column % tileWidth == 0)
+                edges->left[row] = error;
+            if (column % tileWidth == tileWidth - 1)
+                edges->right[row] = error;
+        }
+
+        // The pixel right of the span was dithered just after it.
+        if (x1 < canvasWidth)
+            spread(x1, y, state.GetTile(end, band).left[y - y0]);
+    }
+
+    // Top row of the band below, with the error it received from this band.
+    if (rows > tileHeight)
+        edges->below.assign(pixels.end() - width, pixels.end());
+    else
+        edges->below.clear();
+}
+
+const bool InstallMapsInWorld(const vector<string>& inputFiles, const filesystem::path& worldPath, const vector<Vector3i>& paletteData, const Texture2D::Budget& budget, const int& gridWidth, const int& gridHeight, const bool& deduplicate, ThreadPool& pool)
+{
+    // Convert each image into a map, or a wall of maps.
+    vector<MCMapData> maps;
+    vector<string> names;
+    for (const string& inputFile : inputFiles)
+    {
+        MCMapData map;
+        if (ConvertImageToMap(inputFile.c_str(), &map, paletteData, DitherType::FLOYD_STEINBERG, budget, gridWidth, gridHeight))
+        {
+            maps.push_back(move(map));
+            names.push_back(inputFile);
+        }
+        else
+        {
+            cerr << "Failed to convert " << inputFile << "\n";
+        }
+    }
+
+    if (maps.empty())
+        return false;
+
+    // Slice each wall into tiles, left to right then top to bottom.
+    size_t tilesPerMap = static_cast<size_t>(gridWidth) * gridHeight;
+    vector<MCMapView> tiles;
+    tiles.reserve(maps.size() * tilesPerMap);
+    for (const MCMapData& map : maps)
+    {
+        for (int y = 0; y < gridHeight; y++)
+        {
+            for (int x = 0; x < gridWidth; x++)
+            {
+                tiles.push_back(map.GetTile(x, y));
+            }
+        }
+    }
+
+    // Tiles with the same colours share a map, such as blank areas of a wall or an image given twice.
+    vector<size_t> firstTile(tiles.size());
+    if (deduplicate)
+        firstTile = FindDuplicateTiles(tiles, nullptr, pool);
+    else
+        iota(firstTile.begin(), firstTile.end(), 0);
+
+    vector<MCMapView> uniqueTiles;
+    vector<int> mapIndex(tiles.size());
+    for (size_t i = 0; i < tiles.size(); i++)
+    {
+        if (firstTile[i] == i)
+        {
+            mapIndex[i] = static_cast<int>(uniqueTiles.size());
+            uniqueTiles.push_back(tiles[i]);
+        }
+        else
+        {
+            mapIndex[i] = mapIndex[firstTile[i]];
+        }
+    }
+
+    // Reserve a contiguous range of map IDs.
+    WorldWriter writer(worldPath);
+    int firstID;
+    if (!writer.ReserveIDs(static_cast<int>(uniqueTiles.size()), &firstID))
+    {
+        cerr << "Failed to reserve map IDs in " << worldPath.string() << "\n";
+        if (writer.IsLocked())
+            cerr << "Another copy of the program holds " << writer.GetLockPath().string() << ", wait for it to finish\n";
+        return false;
+    }
+
+    // Compress and write maps in parallel.
+    if (!writer.WriteMaps(uniqueTiles, firstID, pool))
+    {
+        cerr << "Failed to write maps to " << worldPath.string() << "\n";
+        return false;
+    }
+
+    // Output allocated map IDs.
+    for (size_t i = 0; i < tiles.size(); i++)
+    {
+        cout << names[i / tilesPerMap];
+        if (tilesPerMap > 1)
+            cout << " [" << (i % tilesPerMap) % gridWidth << ", " << (i % tilesPerMap) / gridWidth << "]";
+        cout << " -> " << writer.GetMapPath(firstID + mapIndex[i]).filename().string() << "\n";
+    }
+
+    if (deduplicate)
+        cout << tiles.size() << " maps stored as " << uniqueTiles.size() << " (dedup ratio " << static_cast<double>(tiles.size()) / uniqueTiles.size() << ":1)\n";
+
+    // Maps installed successfully.
+    return true;
+}
+
+const vector<size_t> FindDuplicateTiles(span<const MCMapView> tiles, vector<uint64_t>* hashes, ThreadPool& pool)
+{
+    // Hash tiles in parallel.
+    vector<uint64_t> tileHashes(tiles.size());
+    pool.ParallelFor(tiles.size(), [&](size_t i)
+    {
+        tileHashes[i] = tiles[i].GetHash();
+    });
+
+    // Each tile refers to the first tile with the same colours, or itself. Colours are compared in
+    // full, so a hash collision never merges different maps.
+    vector<size_t> firstTile(tiles.size());
+    unordered_map<uint64_t, vector<size_t>> seen;
+    for (size_t i = 0; i < tiles.size(); i++)
+    {
+        vector<size_t>& candidates = seen[tileHashes[i]];
+        auto match = find_if(candidates.begin(), candidates.end(), [&](const size_t& candidate) { return tiles[candidate].HasSameColours(tiles[i]); });
+
+        if (match != candidates.end())
+        {
+            firstTile[i] = *match;
+        }
+        else
+        {
+            firstTile[i] = i;
+            candidates.push_back(i);
+        }
+    }
+
+    if (hashes)
+        *hashes = move(tileHashes);
+
+    return firstTile;
+}
+
+const bool RenderMapsInWorld(const filesystem::path& worldPath, const filesystem::path& outputPath, const vector<Vector3i>& paletteData, ThreadPool& pool, const bool& incremental, const PngWriter::Mode& pngMode)
+{
+    // Precompute map colours.
+    MCPalette palette(paletteData);
+
+    // Render maps in parallel.
+    WorldRenderer renderer(worldPath, pngMode);
+    WorldRenderer::Result result;
+    bool success = renderer.RenderMaps(outputPath, palette, pool, &result, incremental);
+
+    // Output statistics.
+    cout << "Rendered " << result.rendered << " maps in " << result.seconds << "s";
+    if (result.seconds > 0.0)
+        cout << " (" << static_cast<size_t>(result.rendered / result.seconds) << " maps/s)";
+    if (incremental)
+        cout << ", " << result.skipped << " unchanged";
+    cout << "\n";
+
+    if (!success)
+        cerr << "Failed to render " << result.failed << " maps from " << worldPath.string() << "\n";
+
+    return success;
+}
+
+const bool RenderWorldAtlas(const filesystem::path& worldPath, const filesystem::path& outputPath, const string& dimension, const vector<Vector3i>& paletteData, ThreadPool& pool, const bool& incremental, const PngWriter::Mode& pngMode, const Texture2D::Budget& budget)
+{
+    // Precompute map colours.
+    MCPalette palette(paletteData);
+
+    WorldRenderer renderer(worldPath, pngMode);
+    WorldRenderer::Result result;
+
+    if (incremental)
+    {
+        // Redraw changed tiles of a tiled atlas.
+        bool success = renderer.RenderAtlasTiles(outputPath, palette, pool, dimension, &result);
+
+        cout << "Redrew " << result.rendered << " atlas tiles in " << result.seconds << "s, " << result.skipped << " maps unchanged\n";
+
+        if (!success)
+            cerr << "Failed to update atlas of " << dimension << " from " << worldPath.string() << "\n";
+
+        return success;
+    }
+
+    // Stitch maps into a single image, within the pixel budget.
+    if (!renderer.RenderAtlas(outputPath, palette, pool, dimension, budget.maxPixels, &result))
+    {
+        cerr << "Failed to create atlas of " << dimension << " from " << worldPath.string() << "\n";
+        if (result.failed > 0)
+        {
+            cerr << "Failed to read " << result.failed << " maps\n";
+        }
+        else if (static_cast<long long>(result.width) * result.height > budget.maxPixels)
+        {
+            cerr << "The atlas would be " << result.width << "x" << result.height << ", over the --max-pixels limit of " << budget.maxPixels
+                << ". Add --incremental to draw it as tiles, which leaves out empty areas\n";
+        }
+        return false;
+    }
+
+    // Output statistics.
+    cout << "Stitched " << result.rendered << " maps into a " << result.width << "x" << result.height << " atlas in " << result.seconds << "s\n";
+
+    return true;
+}
+
+const bool ConvertMapToImage(const char* inputFile, const char* outputFile, const vector<Vector3i>& paletteData, const int& zoom, const bool& gridLines, const int& gridWidth, const int& gridHeight, const PngWriter::Mode& pngMode, ThreadPool* pool)
+{
+    // Load maps, then draw them into an image.
+    MCMapData inputMap;
+    if (!LoadMapWall(inputFile, &inputMap, gridWidth, gridHeight))
+        return false;
+
+    return SaveMapImage(inputMap, outputFile, paletteData, zoom, gridLines, pngMode, pool);
+}
+
+const bool ConvertMapToImage(const MapArchive& archive, const int& id, const char* outputFile, const vector<Vector3i>& paletteData, const int& zoom, const bool& gridLines, const int& gridWidth, const int& gridHeight, const PngWriter::Mode& pngMode, ThreadPool* pool)
+{
+    // Read maps from the archive, then draw them into an image.
+    MCMapData inputMap;
+    if (!LoadMapWall(archive, id, &inputMap, gridWidth, gridHeight))
+        return false;
+
+    return SaveMapImage(inputMap, outputFile, paletteData, zoom, gridLines, pngMode, pool);
+}
+
+const bool LoadMapWall(const char* inputFile, MCMapData* output, const int& gridWidth, const int& gridHeight)
+{
+    filesystem::path inputPath(inputFile);
+    bool datFile = inputPath.extension() == ".dat";
+
+    // Load map data from a map_<id>.dat file or raw colours.
+    MCMapData& inputMap = *output;
+    if (gridWidth == 1 && gridHeight == 1)
+        return datFile ? inputMap.LoadFromDatFile(inputFile) : inputMap.LoadFromFile(inputFile);
+
+    // Walls are loaded from the tiles written by ConvertImageToMapWall, with the tile position
+    // appended to the stem. Every tile is read in one batch.
+    size_t tileCount = static_cast<size_t>(gridWidth) * gridHeight;
+    vector<string> tilePaths(tileCount);
+    vector<vector<uint8_t>> tileData(tileCount);
+
+    FileBatch batch;
+    for (size_t i = 0; i < tileCount; i++)
+    {
+        tilePaths[i] = GetMapWallTilePath(inputFile, static_cast<int>(i % gridWidth), static_cast<int>(i / gridWidth), gridWidth, gridHeight);
+        batch.Read(tilePaths[i].c_str(), &tileData[i]);
+    }
+
+    if (!batch.Submit())
+        return false;
+
+    inputMap = MCMapData(MCMapData::defaultWidth * gridWidth, MCMapData::defaultHeight * gridHeight);
+    for (size_t i = 0; i < tileCount; i++)
+    {
+        // Raw tiles only use as much data as the map can hold.
+        MCMapData tile;
+        if (datFile)
+        {
+            if (!tile.LoadFromDat(tileData[i]))
+                return false;
+        }
+        else
+        {
+            copy_n(tileData[i].begin(), min(tileData[i].size(), tile.GetData().size()), tile.GetData().begin());
+        }
+
+        CopyTileToWall(tile.GetData(), static_cast<int>(i % gridWidth), static_cast<int>(i / gridWidth), &inputMap);
+    }
+
+    return true;
+}
+
+const bool LoadMapWall(const MapArchive& archive, const int& id, MCMapData* output, const int& gridWidth, const int& gridHeight)
+{
+    // Walls are stored with consecutive IDs, left to right then top to bottom.
+    MCMapData& inputMap = *output;
+    inputMap = MCMapData(MCMapData::defaultWidth * gridWidth, MCMapData::defaultHeight * gridHeight);
+    for (int i = 0; i < gridWidth * gridHeight; i++)
+    {
+        const MapArchiveEntry* entry = archive.Find(id + i);
+
+        MCMapData tile;
+        if (entry == nullptr || !archive.Read(*entry, &tile))
+            return false;
+
+        CopyTileToWall(tile.GetData(), i % gridWidth, i / gridWidth, &inputMap);
+    }
+
+    return true;
+}
+
+const bool SaveMapImage(const MCMapData& inputMap, const char* outputFile, const vector<Vector3i>& paletteData, const int& zoom, const bool& gridLines, const PngWriter::Mode& pngMode, ThreadPool* pool)
+{
+    // Images are streamed a row at a time in every format.
+    string extension = filesystem::path(outputFile).extension().string();
+
+    if (extension == ".ppm" || extension == ".pam")
+    {
+        NetpbmWriter writer;
+        if (!writer.Open(outputFile, inputMap.GetWidth() * zoom, inputMap.GetHeight() * zoom, (extension == ".pam") ? 4 : 3))
+            return false;
+
+        bool success = ExpandMapImage(inputMap, MCPalette(paletteData), zoom, gridLines, [&](span<const uint8_t> row) { return writer.WriteRow(row); });
+        return writer.Close() && success;
+    }
+    else if (extension == ".qoi")
+    {
+        QoiWriter writer;
+        if (!writer.Open(outputFile, inputMap.GetWidth() * zoom, inputMap.GetHeight() * zoom))
+            return false;
+
+        bool success = ExpandMapImage(inputMap, MCPalette(paletteData), zoom, gridLines, [&](span<const uint8_t> row) { return writer.WriteRow(row); });
+        return writer.Close() && success;
+    }
+
+    // Save as PNG.
+    ofstream outputData(outputFile, ios::out | ios::binary | ios::trunc);
+    if (!outputData.is_open() || !WriteMapPng(inputMap, outputData, paletteData, zoom, gridLines, pngMode, pool))
+        return false;
+
+    outputData.close();
+
+    // Successfull conversion.
+    return !outputData.fail();
+}
+
+const bool WriteMapPng(const MCMapData& map, ostream& output, const vector<Vector3i>& paletteData, const int& zoom, const bool& gridLines, const PngWriter::Mode& pngMode, ThreadPool* pool)
+{
+    MCPalette palette(paletteData);
+
+    // Save colour IDs as an indexed image.
+    if (zoom == 1 && !gridLines)
+        return palette.SaveIndexedPng(output, map, pngMode, pool);
+
+    PngWriter writer(pngMode, pool);
+    if (!writer.Open(output, map.GetWidth() * zoom, map.GetHeight() * zoom))
+        return false;
+
+    bool success = ExpandMapImage(map, palette, zoom, gridLines, [&](span<const uint8_t> row) { return writer.WriteRow(row); });
+    return writer.Close() && success;
+}
+
+const bool ExpandMapImage(const MCMapData& map, const MCPalette& palette, const int& zoom, const bool& gridLines, const function<bool(span<const uint8_t>)>& writeRow)
+{
+    // Enlarged images are produced a row at a time, so only one output row is held in memory.
+    vector<uint8_t> row(static_cast<size_t>(map.GetWidth()) * zoom * 4);
+    vector<uint8_t> line(row.size());
+    for (int y = 0; y < map.GetHeight(); y++)
+    {
+        // Expand each map pixel to zoom pixels wide.
+        palette.ExpandZoomed(map.GetData().subspan(static_cast<size_t>(y) * map.GetWidth(), map.GetWidth()), zoom, row.data());
+
+        // Mark the left edge of each map after the first.
+        if (gridLines)
+        {
+            for (int x = MCMapData::defaultWidth; x < map.GetWidth(); x += MCMapData::defaultWidth)
+            {
+                memcpy(row.data() + static_cast<size_t>(x) * zoom * 4, gridColour, 4);
+            }
+        }
+
+        // Mark the top edge of each map after the first, then repeat the row to fill zoom rows.
+        bool edge = gridLines && y > 0 && y % MCMapData::defaultHeight == 0;
+        if (edge)
+        {
+            for (size_t x = 0; x < line.size(); x += 4)
+            {
+                memcpy(line.data() + x, gridColour, 4);
+            }
+        }
+
+        for (int repeat = 0; repeat < zoom; repeat++)
+        {
+            if (!writeRow((edge && repeat == 0) ? line : row))
+                return false;
+        }
+    }
+
+    return true;
+}
+
+void CopyTileToWall(span<const uint8_t> tile, const int& x, const int& y, MCMapData* wall)
+{
+    // Copy tile rows into the wall.
+    for (int row = 0; row < MCMapData::defaultHeight; row++)
+    {
+        span<const uint8_t> source = tile.subspan(static_cast<size_t>(row) * MCMapData::defaultWidth, MCMapData::defaultWidth);
+        size_t offset = (static_cast<size_t>(y) * MCMapData::defaultHeight + row) * wall->GetWidth() + static_cast<size_t>(x) * MCMapData::defaultWidth;
+        copy(source.begin(), source.end(), wall->GetData().begin() + offset);
+    }
+}
+const ConversionJob PlanConversion(const string& inputFile, const string& mapExtension, const string& imageExtension, const Texture2D::Budget& budget, const int& gridWidth, const int& gridHeight, const int& zoom)
+{
+    ConversionJob job;
+    job.inputFile = inputFile;
+
+    // Store file name, remove extension.
+    filesystem::path inputPath(inputFile);
+    string filename = inputPath.filename().string();
+    filename.resize(filename.size() - inputPath.extension().string().size());
+
+    // Inputs with an extension, other than map files, are images.
+    job.image = inputPath.has_extension() && inputPath.extension() != ".dat";
+    job.outputFile = (inputPath.parent_path() / (filename + (job.image ? mapExtension : imageExtension))).string();
+
+    long long canvasWidth = static_cast<long long>(MCMapData::defaultWidth) * gridWidth;
+    long long canvasHeight = static_cast<long long>(MCMapData::defaultHeight) * gridHeight;
+
+    if (job.image)
+    {
+        // Decoded image, then resized and dithered copies at canvas size. Unreadable images fail
+        // before decoding, so need no memory.
+        Texture2D::ImageInfo info;
+        if (Texture2D::ReadInfo(inputFile.c_str(), &info))
+        {
+            Texture2D::DecodePlan plan = Texture2D::PlanDecode(info, static_cast<int>(canvasWidth), static_cast<int>(canvasHeight), budget);
+            job.bytes = plan.bytes + canvasWidth * canvasHeight * (2 * sizeof(Vector4i) + 1);
+        }
+    }
+    else
+    {
+        // Tiles and the joined wall. Images are streamed, so need only a row.
+        job.bytes = canvasWidth * canvasHeight * 2;
+    }
+
+    return job;
+}
+
+const bool RunConversion(const ConversionJob& job, const vector<Vector3i>& paletteData, const Texture2D::Budget& budget, const int& gridWidth, const int& gridHeight, const int& zoom, const bool& gridLines, const PngWriter::Mode& pngMode, ThreadPool* pool, const bool& incremental)
+{
+    // Convert image into maps, or maps into an image. Incremental conversion only dithers and
+    // writes maps which changed.
+    if (job.image && incremental && pool != nullptr)
+        return ConvertImageToMapWallIncremental(job.inputFile.c_str(), job.outputFile.c_str(), paletteData, budget, gridWidth, gridHeight, *pool);
+
+    if (job.image)
+        return ConvertImageToMapWall(job.inputFile.c_str(), job.outputFile.c_str(), paletteData, DitherType::FLOYD_STEINBERG, budget, gridWidth, gridHeight, pool);
+
+    return ConvertMapToImage(job.inputFile.c_str(), job.outputFile.c_str(), paletteData, zoom, gridLines, gridWidth, gridHeight, pngMode, pool);
+}
+
+const bool ConvertBatch(const vector<ConversionJob>& jobs, const vector<Vector3i>& paletteData, const Texture2D::Budget& budget, const int& gridWidth, const int& gridHeight, const int& zoom, const bool& gridLines, const PngWriter::Mode& pngMode, ThreadPool& pool, const PipelineThreads& stageThreads)
+{
+    auto start = chrono::steady_clock::now();
+
+    // Files pass through three stages, each with its own threads: load and decode, resize and
+    // dither, then encode and save. Stages without a thread count share the pool's threads, with a
+    // quarter each for loading and saving.
+    unsigned int threads = pool.GetThreadCount();
+    PipelineThreads stages = stageThreads;
+    stages.load = stages.load ? stages.load : max(1u, threads / 4);
+    stages.save = stages.save ? stages.save : max(1u, threads / 4);
+    stages.convert = stages.convert ? stages.convert : max(1u, threads - min(threads, stages.load + stages.save));
+
+    // Queues hold one waiting file per thread of the stage reading them. A full queue holds back
+    // the stage before it, so a slow stage slows the whole pipeline rather than filling memory.
+    using Item = unique_ptr<PipelineItem>;
+    BoundedQueue<Item> loadQueue(stages.load), convertQueue(stages.convert), saveQueue(stages.save);
+    StageTimes loadTimes, convertTimes, saveTimes;
+
+    // Files are admitted in input order while their estimated memory fits within the budget, and
+    // hold it until saved. A file larger than the whole budget waits to run alone. Inputs sharing
+    // an output file wait for the one before, so the last one wins as it would one at a time.
+    mutex mutex;
+    condition_variable released;
+    unordered_set<string> busyOutputs;
+    long long available = budget.maxBytes;
+    long long peakBytes = 0;
+    size_t inFlight = 0, peakInFlight = 0;
+    vector<uint8_t> success(jobs.size(), 0);
+
+    auto finish = [&](const PipelineItem& item, const bool& converted)
+    {
+        {
+            lock_guard<std::mutex> lock(mutex);
+            success[item.job] = converted;
+            busyOutputs.erase(jobs[item.job].outputFile);
+            available += item.bytes;
+            inFlight--;
+        }
+        released.notify_all();
+    };
+
+    // Stage threads pass each file on to the next stage, or finish it once saved or failed. Time
+    // spent waiting on either queue is recorded apart from time spent working. The last thread of
+    // a stage to finish closes the queue after it, so the stages drain in order.
+    atomic<unsigned int> loadRunning(stages.load), convertRunning(stages.convert), saveRunning(stages.save);
+    auto runStage = [&](BoundedQueue<Item>& input, BoundedQueue<Item>* output, atomic<unsigned int>& running, StageTimes& times, const function<bool(PipelineItem&)>& process)
+    {
+        auto last = chrono::steady_clock::now();
+        auto elapsed = [&last]
+        {
+            auto now = chrono::steady_clock::now();
+            long long nanoseconds = chrono::duration_cast<chrono::nanoseconds>(now - last).count();
+            last = now;
+            return nanoseconds;
+        };
+
+        Item item;
+        while (input.Pop(&item))
+        {
+            times.starved += elapsed();
+            bool converted = process(*item);
+            times.busy += elapsed();
+
+            if (converted && output != nullptr)
+            {
+                output->Push(move(item));
+                times.blocked += elapsed();
+            }
+            else
+            {
+                finish(*item, converted);
+                item.reset();
+            }
+        }
+
+        times.starved += elapsed();
+
+        if (--running == 0 && output != nullptr)
+            output->Close();
+    };
+
+    // Conversions run on a single stage thread, so they don't use a pool.
+    auto load = [&](PipelineItem& item)
+    {
+        const ConversionJob& job = jobs[item.job];
+        if (!job.image)
+            return LoadMapWall(job.inputFile.c_str(), &item.map, gridWidth, gridHeight);
+
+        MappedFile file;
+        return file.Open(job.inputFile.c_str()) && DecodeImage(file.GetData(), &item.texture, budget, gridWidth, gridHeight);
+    };
+    auto convert = [&](PipelineItem& item)
+    {
+        // Maps are drawn into image rows as they are saved.
+        if (!jobs[item.job].image)
+            return true;
+
+        bool converted = DitherImage(&item.texture, &item.map, paletteData, DitherType::FLOYD_STEINBERG, gridWidth, gridHeight);
+        item.texture = Texture2D();
+        return converted;
+    };
+    auto save = [&](PipelineItem& item)
+    {
+        const ConversionJob& job = jobs[item.job];
+        if (job.image)
+            return SaveMapWall(item.map, job.outputFile.c_str(), gridWidth, gridHeight, nullptr);
+
+        return SaveMapImage(item.map, job.outputFile.c_str(), paletteData, zoom, gridLines, pngMode, nullptr);
+    };
+
+    // Stage threads are the pool's workers, each stays in its stage until the batch is done. Every
+    // stage needs a thread at once, so stage counts beyond the pool's size, from --stages or a pool
+    // of fewer than three threads, run on a pool of their own instead.
+    unsigned int stageCount = stages.load + stages.convert + stages.save;
+    unique_ptr<ThreadPool> ownPool;
+    ThreadPool* stagePool = &pool;
+    if (stageCount > threads)
+    {
+        ownPool = make_unique<ThreadPool>(stageCount);
+        stagePool = ownPool.get();
+    }
+
+    for (unsigned int i = 0; i < stages.load; i++)
+    {
+        stagePool->Submit([&] { runStage(loadQueue, &convertQueue, loadRunning, loadTimes, load); });
+    }
+    for (unsigned int i = 0; i < stages.convert; i++)
+    {
+        stagePool->Submit([&] { runStage(convertQueue, &saveQueue, convertRunning, convertTimes, convert); });
+    }
+    for (unsigned int i = 0; i < stages.save; i++)
+    {
+        stagePool->Submit([&] { runStage(saveQueue, nullptr, saveRunning, saveTimes, save); });
+    }
+
+    for (size_t i = 0; i < jobs.size(); i++)
+    {
+        auto item = make_unique<PipelineItem>();
+        item->job = i;
+        item->bytes = min(jobs[i].bytes, budget.maxBytes);
+
+        {
+            unique_lock<std::mutex> lock(mutex);
+            released.wait(lock, [&] { return available >= item->bytes && busyOutputs.count(jobs[i].outputFile) == 0; });
+            busyOutputs.insert(jobs[i].outputFile);
+            available -= item->bytes;
+            inFlight++;
+            peakBytes = max(peakBytes, budget.maxBytes - available);
+            peakInFlight = max(peakInFlight, inFlight);
+        }
+
+        loadQueue.Push(move(item));
+    }
+
+    // Drain the stages in order, each ends once the one before it has.
+    loadQueue.Close();
+    stagePool->Wait();
+
+    // Report failures in input order, then totals.
+    size_t converted = 0;
+    long long inputBytes = 0;
+    for (size_t i = 0; i < jobs.size(); i++)
+    {
+        error_code error;
+        uintmax_t size = filesystem::file_size(jobs[i].inputFile, error);
+        if (!error)
+            inputBytes += static_cast<long long>(size);
+
+        if (success[i])
+            converted++;
+        else
+            cerr << "Failed to convert " << jobs[i].inputFile << "\n";
+    }
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "Converted " << converted << " of " << jobs.size() << " files in " << seconds << "s";
+    if (seconds > 0.0)
+        cout << " (" << converted / seconds << " files/s, " << inputBytes / seconds / (1024 * 1024) << " MB/s)";
+    cout << ", at most " << peakInFlight << " at once using " << peakBytes / (1024 * 1024) << " MB\n";
+
+    // Report how each stage's threads spent their time. A stage mostly busy while the others wait
+    // is the one to give more threads.
+    auto report = [](const char* name, const unsigned int& threads, const StageTimes& times, BoundedQueue<Item>& queue)
+    {
+        double total = max(1.0, static_cast<double>(times.busy + times.starved + times.blocked));
+        cout << "  " << name << ": " << threads << " threads, " << static_cast<int>(100.0 * times.busy / total) << "% busy, "
+            << static_cast<int>(100.0 * times.starved / total) << "% waiting for input, "
+            << static_cast<int>(100.0 * times.blocked / total) << "% waiting for the next stage, "
+            << "queue peak " << queue.GetPeakSize() << "/" << queue.GetCapacity() << "\n";
+    };
+
+    report("load", stages.load, loadTimes, loadQueue);
+    report("convert", stages.convert, convertTimes, convertQueue);
+    report("save", stages.save, saveTimes, saveQueue);
+
+    return converted == jobs.size();
+}
+
+const bool InstallTerrainInWorld(const filesystem::path& worldPath, const filesystem::path& blockPath, const vector<Vector3i>& paletteData, const string& dimension, const int& x, const int& z, const int& radius, const int& scale, ThreadPool& pool)
+{
+    // Load block colours, each must be one of the base colours of the palette.
+    int colourCount = static_cast<int>(paletteData.size() / 4);
+    BlockColours colours;
+    if (!colours.LoadFromFile(blockPath.string().c_str(), colourCount))
+    {
+        cerr << "Failed to load block colours from " << blockPath.string() << ", block colours must be less than " << colourCount << ", the number of base colours in colours.csv\n";
+        return false;
+    }
+
+    if (radius > TerrainRenderer::maxRadius)
+    {
+        cerr << "A radius of " << radius << " blocks is over the limit of " << TerrainRenderer::maxRadius << "\n";
+        return false;
+    }
+
+    if (!filesystem::is_directory(TerrainRenderer::GetRegionPath(worldPath, dimension)))
+    {
+        cerr << "No region files for " << dimension << " in " << worldPath.string() << "\n";
+        return false;
+    }
+
+    // Find maps covering the area, at every scale unless one is given.
+    vector<MCMapInfo> info;
+    for (int mapScale = max(scale, 0); mapScale <= (scale < 0 ? TerrainRenderer::maxScale : scale); mapScale++)
+    {
+        vector<MCMapInfo> scaleInfo = TerrainRenderer::GetMapsInArea(x, z, radius, mapScale, dimension);
+        info.insert(info.end(), scaleInfo.begin(), scaleInfo.end());
+    }
+
+    // Decode chunks and render maps in parallel.
+    TerrainRenderer renderer(worldPath, dimension, colours);
+    TerrainRenderer::Result result;
+    vector<MCMapData> maps;
+    bool success = renderer.Render(info, &maps, pool, &result);
+
+    cout << "Rendered " << maps.size() << " maps from " << result.chunks << " chunks in " << result.seconds << "s, " << result.missing << " chunks not generated\n";
+
+    // Maps with unreadable chunks, or no terrain at all, are never installed, so no IDs are used up.
+    if (!success || result.failed > 0)
+    {
+        cerr << "Failed to read " << result.failed << " chunks, no maps were installed\n";
+        return false;
+    }
+
+    if (result.chunks == 0)
+    {
+        cerr << "No generated chunks within " << radius << " blocks of " << x << ", " << z << ", no maps were installed\n";
+        return false;
+    }
+
+    // Reserve a contiguous range of map IDs.
+    WorldWriter writer(worldPath);
+    int firstID;
+    if (!writer.ReserveIDs(static_cast<int>(maps.size()), &firstID))
+    {
+        cerr << "Failed to reserve map IDs in " << worldPath.string() << "\n";
+        if (writer.IsLocked())
+            cerr << "Another copy of the program holds " << writer.GetLockPath().string() << ", wait for it to finish\n";
+        return false;
+    }
+
+    // Compress and write maps in parallel.
+    vector<MCMapView> views(maps.begin(), maps.end());
+    if (!writer.WriteMaps(views, firstID, pool, info))
+    {
+        cerr << "Failed to write maps to " << worldPath.string() << "\n";
+        return false;
+    }
+
+    // Output allocated map IDs.
+    for (size_t i = 0; i < info.size(); i++)
+    {
+        cout << "Scale " << info[i].scale << " (" << info[i].xCenter << ", " << info[i].zCenter << ") -> " << writer.GetMapPath(firstID + static_cast<int>(i)).filename().string() << "\n";
+    }
+
+    // Maps installed successfully.
+    return true;
+}
+
+const bool ConvertStream(const bool& sequence, const vector<Vector3i>& paletteData, const Texture2D::Budget& budget, const int& gridWidth, const int& gridHeight, const bool& datFile, const int& zoom, const bool& gridLines, const PngWriter::Mode& pngMode, ThreadPool& pool)
+{
+#ifdef _WIN32
+    // Standard streams translate line endings on Windows unless switched to binary.
+    _setmode(_fileno(stdin), _O_BINARY);
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+
+    // Single items use all of standard input, output is written straight to standard output.
+    if (!sequence)
+    {
+        vector<uint8_t> input((istreambuf_iterator<char>(cin)), istreambuf_iterator<char>());
+        if (!ConvertStreamItem(input, cout, false, paletteData, budget, gridWidth, gridHeight, datFile, zoom, gridLines, pngMode, pool))
+        {
+            cerr << "Failed to convert standard input\n";
+            return false;
+        }
+
+        cout.flush();
+        return cout.good();
+    }
+
+    // Read items prefixed with their length as a 32 bit big endian value, until input ends.
+    vector<uint8_t> input;
+    size_t converted = 0, failed = 0;
+    uint8_t prefix[4];
+    while (cin.read(reinterpret_cast<char*>(prefix), sizeof(prefix)))
+    {
+        uint32_t length = (static_cast<uint32_t>(prefix[0]) << 24) | (prefix[1] << 16) | (prefix[2] << 8) | prefix[3];
+        if (length > static_cast<unsigned long long>(budget.maxBytes))
+        {
+            cerr << "Input item of " << length << " bytes exceeds the memory limit\n";
+            return false;
+        }
+
+        input.resize(length);
+        if (!cin.read(reinterpret_cast<char*>(input.data()), length))
+        {
+            cerr << "Input ended part way through an item\n";
+            return false;
+        }
+
+        // Outputs are written as records with the same prefix. Failed items give one empty record.
+        ostringstream output;
+        if (ConvertStreamItem(input, output, true, paletteData, budget, gridWidth, gridHeight, datFile, zoom, gridLines, pngMode, pool))
+        {
+            string records = output.str();
+            cout.write(records.data(), records.size());
+            converted++;
+        }
+        else
+        {
+            const char empty[4] = {};
+            cout.write(empty, sizeof(empty));
+            failed++;
+        }
+
+        cout.flush();
+    }
+
+    cerr << "Converted " << converted << " items";
+    if (failed > 0)
+        cerr << ", " << failed << " failed";
+    cerr << "\n";
+
+    return cout.good();
+}
+
+const bool ConvertStreamItem(span<const uint8_t> input, ostream& output, const bool& sequence, const vector<Vector3i>& paletteData, const Texture2D::Budget& budget, const int& gridWidth, const int& gridHeight, const bool& datFile, const int& zoom, const bool& gridLines, const PngWriter::Mode& pngMode, ThreadPool& pool)
+{
+    // Writes one output, prefixed with its length in a sequence.
+    auto writeRecord = [&](span<const uint8_t> data)
+    {
+        if (sequence)
+        {
+            uint32_t length = static_cast<uint32_t>(data.size());
+            const uint8_t prefix[4] = { static_cast<uint8_t>(length >> 24), static_cast<uint8_t>(length >> 16), static_cast<uint8_t>(length >> 8), static_cast<uint8_t>(length) };
+            output.write(reinterpret_cast<const char*>(prefix), sizeof(prefix));
+        }
+
+        output.write(reinterpret_cast<const char*>(data.data()), data.size());
+    };
+
+    // Items holding maps, as gzip compressed map_<id>.dat data or raw colours of exactly one wall,
+    // are recognised before images. Some image formats, such as TGA, have headers loose enough to
+    // match raw colours.
+    size_t tileSize = static_cast<size_t>(MCMapData::defaultWidth) * MCMapData::defaultHeight;
+    bool gzip = input.size() >= 2 && input[0] == 0x1F && input[1] == 0x8B;
+    bool raw = input.size() == tileSize * gridWidth * gridHeight;
+
+    if (gzip || raw)
+    {
+        MCMapData map(MCMapData::defaultWidth * gridWidth, MCMapData::defaultHeight * gridHeight);
+
+        if (gzip)
+        {
+            // Walls of map_<id>.dat files can't be joined in one item.
+            if (gridWidth > 1 || gridHeight > 1 || !map.LoadFromDat(input))
+                return false;
+        }
+        else
+        {
+            // Wall tiles follow each other left to right, then top to bottom.
+            for (int i = 0; i < gridWidth * gridHeight; i++)
+            {
+                CopyTileToWall(input.subspan(i * tileSize, tileSize), i % gridWidth, i / gridWidth, &map);
+            }
+        }
+
+        if (!sequence)
+            return WriteMapPng(map, output, paletteData, zoom, gridLines, pngMode, &pool);
+
+        // Buffer image to find its length.
+        ostringstream image;
+        if (!WriteMapPng(map, image, paletteData, zoom, gridLines, pngMode, &pool))
+            return false;
+
+        string data = image.str();
+        writeRecord(span<const uint8_t>(reinterpret_cast<const uint8_t*>(data.data()), data.size()));
+
+        return output.good();
+    }
+
+    // Convert image into maps, written left to right then top to bottom.
+    MCMapData wall;
+    if (!ConvertImageToMap(as_bytes(input), &wall, paletteData, DitherType::FLOYD_STEINBERG, budget, gridWidth, gridHeight))
+        return false;
+
+    vector<uint8_t> data;
+    for (int y = 0; y < gridHeight; y++)
+    {
+        for (int x = 0; x < gridWidth; x++)
+        {
+            MCMapView tile = wall.GetTile(x, y);
+            if (datFile)
+            {
+                if (!tile.SaveToDat(&data))
+                    return false;
+            }
+            else
+            {
+                data.clear();
+                for (int row = 0; row < tile.GetHeight(); row++)
+                {
+                    span<const uint8_t> colours = tile.GetRow(row);
+                    data.insert(data.end(), colours.begin(), colours.end());
+                }
+            }
+
+            writeRecord(data);
+        }
+    }
+
+    return output.good();
+}
+
+const bool BenchmarkFileIO(const int& count)
+{
+    // Maps are written to, and read back from, a temporary folder which is emptied between backends.
+    filesystem::path folder = filesystem::temp_directory_path() / "cartographer-io";
+    vector<string> paths(count);
+    vector<vector<uint8_t>> maps(count, vector<uint8_t>(static_cast<size_t>(MCMapData::defaultWidth) * MCMapData::defaultHeight));
+    for (int i = 0; i < count; i++)
+    {
+        paths[i] = (folder / ("map_" + to_string(i))).string();
+        for (size_t j = 0; j < maps[i].size(); j++)
+        {
+            maps[i][j] = static_cast<uint8_t>((i + j) % 248 + 4);
+        }
+    }
+
+    bool success = true;
+    for (FileBatch::Backend backend : { FileBatch::Backend::BLOCKING, FileBatch::Backend::IO_URING })
+    {
+        FileBatch batch(backend);
+        if (batch.GetBackend() != backend)
+        {
+            cout << "io_uring: unavailable\n";
+            continue;
+        }
+
+        error_code error;
+        filesystem::create_directories(folder, error);
+        if (error)
+        {
+            cerr << "Failed to create " << folder.string() << "\n";
+            return false;
+        }
+
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < count; i++)
+        {
+            batch.Write(paths[i].c_str(), maps[i]);
+        }
+        success = batch.Submit() && success;
+
+        double writeSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        size_t writeCalls = batch.GetStats().systemCalls;
+
+        start = chrono::steady_clock::now();
+        vector<vector<uint8_t>> readMaps(count);
+        for (int i = 0; i < count; i++)
+        {
+            batch.Read(paths[i].c_str(), &readMaps[i]);
+        }
+        success = batch.Submit() && readMaps == maps && success;
+
+        double readSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        size_t readCalls = batch.GetStats().systemCalls - writeCalls;
+
+        cout << ((backend == FileBatch::Backend::IO_URING) ? "io_uring" : "blocking") << ": "
+            << "write " << writeSeconds << "s, " << static_cast<double>(writeCalls) / count << " system calls per map, "
+            << "read " << readSeconds << "s, " << static_cast<double>(readCalls) / count << " system calls per map\n";
+
+        filesystem::remove_all(folder, error);
+    }
+
+    if (!success)
+        cerr << "Maps were not written and read back intact\n";
+
+    return success;
+}
+
+const bool ConvertWithArchive(const vector<string>& inputs, const filesystem::path& archivePath, const vector<Vector3i>& paletteData, const Texture2D::Budget& budget, const int& gridWidth, const int& gridHeight, const bool& compress, const bool& deduplicate, const string& imageExtension, const int& zoom, const bool& gridLines, const PngWriter::Mode& pngMode, ThreadPool& pool)
+{
+    // Numbers are IDs of archived maps, anything else is an image to add.
+    vector<string> inputFiles;
+    vector<int> ids;
+    for (const string& input : inputs)
+    {
+        if (!input.empty() && all_of(input.begin(), input.end(), [](const char& c) { return isdigit(static_cast<unsigned char>(c)); }))
+            ids.push_back(atoi(input.c_str()));
+        else
+            inputFiles.push_back(input);
+    }
+
+    bool success = true;
+    if (!inputFiles.empty())
+        success = AppendMapsToArchive(inputFiles, archivePath, paletteData, budget, gridWidth, gridHeight, compress, deduplicate, pool);
+
+    MapArchive archive;
+    if (!archive.Open(archivePath))
+    {
+        cerr << "Failed to open " << archivePath.string() << "\n";
+        return false;
+    }
+
+    // Without IDs, describe the archive.
+    if (inputs.empty())
+    {
+        span<const MapArchiveEntry> entries = archive.GetEntries();
+        size_t compressedCount = count_if(entries.begin(), entries.end(), [](const MapArchiveEntry& entry) { return (entry.flags & MapArchive::compressed) != 0; });
+
+        cout << archivePath.filename().string() << ": " << entries.size() << " maps";
+        if (!entries.empty())
+            cout << " (IDs " << entries.front().id << " to " << entries.back().id << ", " << compressedCount << " compressed)";
+        cout << "\n";
+    }
+
+    // Draw each map, or each wall starting from the ID, next to the archive.
+    for (const int& id : ids)
+    {
+        string outputPath = (archivePath.parent_path() / ("map_" + to_string(id) + imageExtension)).string();
+        if (!ConvertMapToImage(archive, id, outputPath.c_str(), paletteData, zoom, gridLines, gridWidth, gridHeight, pngMode, &pool))
+        {
+            cerr << "Failed to convert map " << id << "\n";
+            success = false;
+        }
+    }
+
+    return success;
+}
+
+const bool AppendMapsToArchive(const vector<string>& inputFiles, const filesystem::path& archivePath, const vector<Vector3i>& paletteData, const Texture2D::Budget& budget, const int& gridWidth, const int& gridHeight, const bool& compress, const bool& deduplicate, ThreadPool& pool)
+{
+    // Convert each image into a map, or a wall of maps.
+    vector<MCMapData> maps;
+    vector<string> names;
+    for (const string& inputFile : inputFiles)
+    {
+        MCMapData map;
+        if (ConvertImageToMap(inputFile.c_str(), &map, paletteData, DitherType::FLOYD_STEINBERG, budget, gridWidth, gridHeight))
+        {
+            maps.push_back(move(map));
+            names.push_back(inputFile);
+        }
+        else
+        {
+            cerr << "Failed to convert " << inputFile << "\n";
+        }
+    }
+
+    if (maps.empty())
+        return false;
+
+    // Slice each wall into tiles, left to right then top to bottom.
+    size_t tilesPerMap = static_cast<size_t>(gridWidth) * gridHeight;
+    vector<MCMapView> tiles;
+    tiles.reserve(maps.size() * tilesPerMap);
+    for (const MCMapData& map : maps)
+    {
+        for (int y = 0; y < gridHeight; y++)
+        {
+            for (int x = 0; x < gridWidth; x++)
+            {
+                tiles.push_back(map.GetTile(x, y));
+            }
+        }
+    }
+
+    // Tiles with the same colours share a map, within this batch and with maps already archived. A
+    // wall is drawn from consecutive IDs, so walls of several maps are only shared whole.
+    vector<size_t> firstTile(tiles.size());
+    vector<uint64_t> hashes;
+    if (deduplicate)
+        firstTile = FindDuplicateTiles(tiles, &hashes, pool);
+    else
+        iota(firstTile.begin(), firstTile.end(), 0);
+
+    MapArchive archive;
+    bool exists = archive.Open(archivePath);
+
+    // Only maps with the same info as new maps can be shared.
+    MCMapInfo defaultInfo;
+    auto shareable = [&](const MapArchiveEntry& entry)
+    {
+        return entry.scale == defaultInfo.scale && entry.xCenter == defaultInfo.xCenter && entry.zCenter == defaultInfo.zCenter &&
+            entry.dataVersion == defaultInfo.dataVersion && (entry.flags & ~MapArchive::compressed) == MapArchive::locked && entry.dimension == defaultInfo.dimension;
+    };
+
+    unordered_multimap<uint64_t, const MapArchiveEntry*> archived;
+    if (deduplicate)
+    {
+        for (const MapArchiveEntry& entry : archive.GetEntries())
+        {
+            if (shareable(entry))
+                archived.emplace(entry.colourHash, &entry);
+        }
+    }
+
+    // Returns true if an archived map can stand in for a tile. Colours are compared in full, so a
+    // hash collision never shares a map.
+    auto matchesArchived = [&](const MapArchiveEntry* entry, const size_t& tile)
+    {
+        MCMapData map;
+        return entry && shareable(*entry) && entry->colourHash == hashes[tile] && archive.Read(*entry, &map) && MCMapView(map).HasSameColours(tiles[tile]);
+    };
+
+    // Number new maps after the last one already archived.
+    int nextID = exists ? archive.GetLastID() + 1 : 0;
+    vector<int> ids(tiles.size());
+    vector<MCMapView> newTiles;
+    vector<int> newIDs;
+    size_t reused = 0;
+    unordered_multimap<size_t, size_t> walls;
+
+    for (size_t first = 0; first < tiles.size(); first += tilesPerMap)
+    {
+        // Share an earlier wall in this batch whose tiles all match.
+        int wallID = -1;
+        if (deduplicate)
+        {
+            auto [candidate, end] = walls.equal_range(firstTile[first]);
+            for (; candidate != end && wallID < 0; ++candidate)
+            {
+                if (equal(&firstTile[first], &firstTile[first] + tilesPerMap, &firstTile[candidate->second]))
+                    wallID = ids[candidate->second];
+            }
+
+            walls.emplace(firstTile[first], first);
+        }
+
+        // Share a run of archived maps, starting from a map matching the first tile.
+        if (wallID < 0)
+        {
+            auto [candidate, end] = archived.equal_range(deduplicate ? hashes[first] : 0);
+            for (; candidate != end && wallID < 0; ++candidate)
+            {
+                int id = candidate->second->id;
+                size_t tile = 0;
+                while (tile < tilesPerMap && id <= INT_MAX - static_cast<int>(tile) && matchesArchived(archive.Find(id + static_cast<int>(tile)), first + tile))
+                {
+                    tile++;
+                }
+
+                if (tile == tilesPerMap)
+                {
+                    wallID = id;
+                    reused += tilesPerMap;
+                }
+            }
+        }
+
+        if (wallID >= 0)
+        {
+            iota(&ids[first], &ids[first] + tilesPerMap, wallID);
+            continue;
+        }
+
+        // Store the wall as new maps, even where its own tiles repeat.
+        for (size_t tile = first; tile < first + tilesPerMap; tile++)
+        {
+            ids[tile] = nextID++;
+            newTiles.push_back(tiles[tile]);
+            newIDs.push_back(ids[tile]);
+        }
+    }
+
+    // The archive must be closed before it is appended to.
+    archive.Close();
+
+    vector<MCMapInfo> info(newTiles.size());
+    if (!newTiles.empty() && !MapArchive::Append(archivePath, newTiles, newIDs, info, compress, pool))
+    {
+        cerr << "Failed to add maps to " << archivePath.string() << "\n";
+        return false;
+    }
+
+    // Output allocated map IDs.
+    for (size_t i = 0; i < tiles.size(); i++)
+    {
+        cout << names[i / tilesPerMap];
+        if (tilesPerMap > 1)
+            cout << " [" << (i % tilesPerMap) % gridWidth << ", " << (i % tilesPerMap) / gridWidth << "]";
+        cout << " -> " << ids[i] << "\n";
+    }
+
+    if (deduplicate)
+    {
+        cout << tiles.size() << " maps stored as " << newTiles.size() << " new maps";
+        if (reused > 0)
+            cout << " and " << reused << " already archived";
+        cout << " (dedup ratio " << static_cast<double>(tiles.size()) / max<size_t>(1, newTiles.size() + reused) << ":1)\n";
+    }
+
+    return true;
+}
+
+const bool ExportArchive(const filesystem::path& archivePath, const filesystem::path& outputPath, const bool& datFile, ThreadPool& pool)
+{
+    MapArchive archive;
+    if (!archive.Open(archivePath))
+    {
+        cerr << "Failed to open " << archivePath.string() << "\n";
+        return false;
+    }
+
+    error_code error;
+    filesystem::create_directories(outputPath, error);
+
+    // Read and encode maps in parallel, as raw colours or map_<id>.dat files, then write them in one
+    // batch. Maps are exported a batch at a time, so memory use doesn't grow with the archive.
+    span<const MapArchiveEntry> entries = archive.GetEntries();
+    vector<string> paths(FileBatch::batchSize);
+    vector<vector<uint8_t>> files(FileBatch::batchSize);
+    atomic<size_t> failed = 0;
+    FileBatch batch;
+
+    for (size_t first = 0; first < entries.size(); first += FileBatch::batchSize)
+    {
+        size_t count = min(FileBatch::batchSize, entries.size() - first);
+
+        pool.ParallelFor(count, [&](size_t i)
+        {
+            const MapArchiveEntry& entry = entries[first + i];
+            paths[i].clear();
+
+            MCMapData map;
+            MCMapInfo info;
+            if (!archive.Read(entry, &map, &info) || (datFile && !map.SaveToDat(&files[i], info)))
+            {
+                failed++;
+                return;
+            }
+
+            if (!datFile)
+                files[i].assign(map.GetData().begin(), map.GetData().end());
+
+            paths[i] = (outputPath / ("map_" + to_string(entry.id) + (datFile ? ".dat" : ""))).string();
+        });
+
+        for (size_t i = 0; i < count; i++)
+        {
+            if (!paths[i].empty())
+                batch.Write(paths[i].c_str(), files[i]);
+        }
+
+        batch.Submit();
+    }
+
+    failed += batch.GetStats().failed;
+
+    cout << "Exported " << entries.size() - failed << " of " << entries.size() << " maps to " << outputPath.string() << "\n";
+    return failed == 0;
+}